@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Enumeration and read throughput of the variable backends. Each backend
+ *  spec given on the command line is walked with GetNextVariableName and
+ *  every variable found is read back with GetVariable.
+ *
+ *  ex. bench_backend ioctl efivarfs
+ *  ex. bench_backend -p 2000 -z 512 efivarfs:/tmp/vars
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+#define NAME_SIZE	1024
+#define DATA_SIZE	(1024 * 1024)
+
+static const char *bench_guid = "6f1f3c57-8e2a-4b1d-a0c4-5b7d9e2f1a36";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void populate(uefiop_ctx *ctx, unsigned long count, size_t size,
+	int delete)
+{
+	uint8_t *data = calloc(1, size ? size : 1);
+	uint16_t name[32];
+	char str[32];
+	efi_guid guid;
+	unsigned long i;
+
+	string_to_guid(bench_guid, &guid);
+	for (i = 0; data && i < count; i++) {
+		snprintf(str, sizeof(str), "BenchVar%05lu", i);
+		utf8_to_ucs2(name, str, strlen(str));
+		memset(data, (int)i, size);
+		uefiop_set_variable(ctx, name, (EFI_GUID *)&guid,
+			EFI_VARIABLE_NON_VOLATILE |
+			EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			EFI_VARIABLE_RUNTIME_ACCESS,
+			delete ? 0 : size, data);
+	}
+	free(data);
+}
+
+static int bench(const char *spec, unsigned long rounds, unsigned long count,
+	size_t size)
+{
+	uefiop_ctx *ctx;
+	uint16_t *name = malloc(NAME_SIZE);
+	uint8_t *data = malloc(DATA_SIZE);
+	uint64_t t0, enum_ns = 0, read_ns = 0, bytes = 0;
+	unsigned long vars = 0, reads = 0, r;
+
+	ctx = uefiop_open(spec);
+	if (!ctx || !name || !data) {
+		printf("%-24s cannot open backend\n", spec);
+		free(name);
+		free(data);
+		return UEFIOP_ERROR;
+	}
+	if (count)
+		populate(ctx, count, size, 0);
+
+	for (r = 0; r < rounds; r++) {
+		efi_guid guid;
+		uint64_t status, namesize;
+
+		/* walk the names only */
+		name[0] = 0;
+		t0 = now_ns();
+		for (;;) {
+			namesize = NAME_SIZE;
+			status = uefiop_get_next_variable_name(ctx, &namesize,
+				name, (EFI_GUID *)&guid);
+			if (status != EFI_SUCCESS)
+				break;
+			vars++;
+		}
+		enum_ns += now_ns() - t0;
+
+		/* walk again, reading every variable */
+		name[0] = 0;
+		for (;;) {
+			uint64_t datasize = DATA_SIZE;
+			uint32_t attr;
+
+			namesize = NAME_SIZE;
+			status = uefiop_get_next_variable_name(ctx, &namesize,
+				name, (EFI_GUID *)&guid);
+			if (status != EFI_SUCCESS)
+				break;
+			t0 = now_ns();
+			status = uefiop_get_variable(ctx, name,
+				(EFI_GUID *)&guid, &attr, &datasize, data);
+			read_ns += now_ns() - t0;
+			if (status == EFI_SUCCESS) {
+				reads++;
+				bytes += datasize;
+			}
+		}
+	}
+
+	printf("%-24s enumerate %10.0f names/s   read %10.0f vars/s %8.2f MB/s"
+		"  (%lu vars)\n", uefiop_backend_name(ctx),
+		enum_ns ? vars * 1e9 / enum_ns : 0.0,
+		read_ns ? reads * 1e9 / read_ns : 0.0,
+		read_ns ? bytes * 1e3 / read_ns : 0.0,
+		rounds ? vars / rounds : 0);
+
+	if (count)
+		populate(ctx, count, size, 1);
+	uefiop_close(ctx);
+	free(name);
+	free(data);
+
+	return UEFIOP_OK;
+}
+
+int main(int argc, char **argv)
+{
+	static char *default_specs[] = { "ioctl", "efivarfs", NULL };
+	unsigned long rounds = 10, count = 0;
+	size_t size = 256;
+	char **specs;
+	int c, ret = EXIT_SUCCESS;
+
+	while ((c = getopt(argc, argv, "n:p:z:")) != -1) {
+		switch (c) {
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'z':
+			size = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n rounds] [-p populate count] "
+				"[-z data size] [backend spec...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (size > DATA_SIZE)
+		size = DATA_SIZE;
+
+	specs = optind < argc ? argv + optind : default_specs;
+	for (; *specs; specs++) {
+		if (bench(*specs, rounds, count, size) != UEFIOP_OK)
+			ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
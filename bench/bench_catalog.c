@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Speed of the variable catalog: a store with many HwErrRec style and
+ *  Boot#### variables is loaded with catalog_load(), then every name is
+ *  looked up with catalog_find() and the Boot#### are listed with
+ *  catalog_prefix().
+ *
+ *  ex. bench_catalog -v 50000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+#include "catalog.h"
+
+#define BOOT_VARS	64
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void var_name(uint16_t *name, unsigned long i)
+{
+	char str[32];
+
+	if (i < BOOT_VARS)
+		snprintf(str, sizeof(str), "Boot%04lX", i);
+	else
+		snprintf(str, sizeof(str), "HwErrRec%05lu", i - BOOT_VARS);
+	utf8_to_ucs2(name, str, strlen(str));
+}
+
+static const efi_guid *var_guid(unsigned long i, const efi_guid *guids)
+{
+	return &guids[i < BOOT_VARS ? 0 : 1];
+}
+
+static int make_image(const char *image, unsigned long vars,
+	const efi_guid *guids)
+{
+	size_t size = ((vars * 96) / 4096 + 2) * 4096;
+	uint8_t *buf = malloc(size), data[8] = { 0 };
+	varstore *vs;
+	uint16_t name[32];
+	unsigned long i;
+	int fd, rc;
+
+	if (!buf || varstore_format(buf, size, true) ||
+	    !(vs = varstore_attach(buf, size))) {
+		free(buf);
+		return UEFIOP_ERROR;
+	}
+	for (i = 0; i < vars; i++) {
+		var_name(name, i);
+		varstore_set(vs, name, (EFI_GUID *)var_guid(i, guids),
+			EFI_VARIABLE_NON_VOLATILE |
+			EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			EFI_VARIABLE_RUNTIME_ACCESS, sizeof(data), data);
+	}
+	varstore_close(vs);
+
+	fd = open(image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	rc = fd == -1 || write(fd, buf, size) != (ssize_t)size;
+	if (fd != -1)
+		close(fd);
+	free(buf);
+
+	return rc ? UEFIOP_ERROR : UEFIOP_OK;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long vars = 50000, rounds = 20, found = 0, listed = 0, i, r;
+	char image[] = "/tmp/bench_catalog.XXXXXX", spec[64];
+	uint16_t (*names)[32] = NULL, boot[] = { 'B', 'o', 'o', 't', 0 };
+	const catalog_entry *first;
+	efi_guid guids[2];
+	uefiop_ctx *ctx = NULL;
+	catalog *cat = NULL;
+	uint64_t t0, dt, status;
+	int c, fd, ret = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "v:n:")) != -1) {
+		switch (c) {
+		case 'v':
+			vars = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-v variables] [-n rounds]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (vars > 99999 + BOOT_VARS)
+		vars = 99999 + BOOT_VARS;
+	if (vars <= BOOT_VARS || rounds == 0)
+		return EXIT_FAILURE;
+
+	string_to_guid("global", &guids[0]);
+	string_to_guid("hwerr", &guids[1]);
+	names = malloc(vars * sizeof(*names));
+	if (!names)
+		return EXIT_FAILURE;
+	for (i = 0; i < vars; i++)
+		var_name(names[i], i);
+
+	fd = mkstemp(image);
+	if (fd == -1) {
+		printf("cannot create %s\n", image);
+		free(names);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	if (make_image(image, vars, guids)) {
+		printf("cannot build the image\n");
+		goto out;
+	}
+	snprintf(spec, sizeof(spec), "image:%s", image);
+	ctx = uefiop_open(spec);
+	if (!ctx) {
+		printf("cannot open %s\n", spec);
+		goto out;
+	}
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++) {
+		catalog_free(cat);
+		cat = catalog_new();
+		if (!cat)
+			goto out;
+		status = catalog_load(cat, ctx);
+		if (status != EFI_SUCCESS) {
+			printf("catalog_load failed: 0x%llx\n",
+				(unsigned long long)status);
+			goto out;
+		}
+	}
+	dt = now_ns() - t0;
+	printf("%-24s %8zu vars  %10.3f ms/load\n", "catalog_load",
+		catalog_count(cat), dt / 1e6 / rounds);
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < vars; i++)
+			found += catalog_find(cat, names[i],
+				(EFI_GUID *)var_guid(i, guids)) != NULL;
+	dt = now_ns() - t0;
+	printf("%-24s %8lu found %10.1f ns/lookup\n", "catalog_find",
+		found / rounds, (double)dt / vars / rounds);
+
+	/* the first call sorts the entries */
+	catalog_prefix(cat, (EFI_GUID *)&guids[0], boot, &first);
+	t0 = now_ns();
+	for (r = 0; r < rounds * 1000; r++)
+		listed += catalog_prefix(cat, (EFI_GUID *)&guids[0], boot,
+			&first);
+	dt = now_ns() - t0;
+	printf("%-24s %8lu found %10.1f ns/query\n", "catalog_prefix Boot",
+		listed / rounds / 1000, (double)dt / rounds / 1000);
+
+	ret = found == vars * rounds && listed == BOOT_VARS * rounds * 1000 ?
+		EXIT_SUCCESS : EXIT_FAILURE;
+out:
+	catalog_free(cat);
+	uefiop_close(ctx);
+	unlink(image);
+	free(names);
+
+	return ret;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+/*
+ *  GUID parse and format rates: string_to_guid() and guid_to_string()
+ *  against the strncpy() + strtoul() parser and sprintf() formatter they
+ *  replaced, and the well known GUID lookups by name and by GUID.
+ *
+ *  ex. bench_guid -n 2000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <byteswap.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+#define GUIDS	1024
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *what, unsigned long n, uint64_t dt)
+{
+	printf("%-24s %10.1f ns/guid  %12.0f guids/s\n", what,
+		(double)dt / n, n * 1e9 / dt);
+}
+
+static int old_string_to_guid(const char *str, efi_guid *guid)
+{
+	int i;
+	char bytes_8[9] = "";
+	char bytes_4[5] = "";
+	char bytes_2[3] = "";
+
+	if (strlen(str) != 36)
+		return -1;
+	strncpy(bytes_8, str, 8);
+	if (check_segment(bytes_8, 8) < 0)
+		return -1;
+	guid->a = (uint32_t)strtoul(bytes_8, NULL, 16);
+	strncpy(bytes_4, str + 9, 4);
+	if (check_segment(bytes_4, 4) < 0)
+		return -1;
+	guid->b = (uint16_t)strtoul(bytes_4, NULL, 16);
+	strncpy(bytes_4, str + 14, 4);
+	if (check_segment(bytes_4, 4) < 0)
+		return -1;
+	guid->c = (uint16_t)strtoul(bytes_4, NULL, 16);
+	strncpy(bytes_4, str + 19, 4);
+	if (check_segment(bytes_4, 4) < 0)
+		return -1;
+	guid->d = bswap_16((uint16_t)strtoul(bytes_4, NULL, 16));
+	for (i = 0 ; i < 6 ; i++) {
+		strncpy(bytes_2, str + 24 + (2 * i), 2);
+		if (check_segment(bytes_2, 2) < 0)
+			return -1;
+		guid->e[i] = (uint8_t)strtoul(bytes_2, NULL, 16);
+	}
+	return 0;
+}
+
+static void old_guid_to_string(const efi_guid *guid, char *str)
+{
+	const uint8_t *d = (const uint8_t *)&guid->d;
+
+	sprintf(str, "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		guid->a, guid->b, guid->c, d[0], d[1], guid->e[0], guid->e[1],
+		guid->e[2], guid->e[3], guid->e[4], guid->e[5]);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = { "global", "security", "shim", "hwerr" };
+	static efi_guid guids[GUIDS];
+	static char strs[GUIDS][37];
+	unsigned long count = 2000000, i, hits = 0;
+	efi_guid g;
+	char str[37];
+	uint64_t t0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n guids]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (count == 0)
+		return EXIT_FAILURE;
+
+	srand(1);
+	for (i = 0; i < GUIDS; i++) {
+		uint8_t *p = (uint8_t *)&guids[i];
+		size_t k;
+
+		for (k = 0; k < sizeof(efi_guid); k++)
+			p[k] = rand();
+		old_guid_to_string(&guids[i], strs[i]);
+		guid_to_string(&guids[i], str);
+		if (strcmp(str, strs[i]) || string_to_guid(str, &g) ||
+		    memcmp(&g, &guids[i], sizeof(g))) {
+			printf("mismatch on %s\n", strs[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		hits += !old_string_to_guid(strs[i % GUIDS], &g);
+	report("strtoul parse", count, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		hits += !string_to_guid(strs[i % GUIDS], &g);
+	report("string_to_guid", count, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		old_guid_to_string(&guids[i % GUIDS], str);
+	report("sprintf format", count, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		guid_to_string(&guids[i % GUIDS], str);
+	report("guid_to_string", count, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		hits += !string_to_guid(names[i % 4], &g);
+	report("by name", count, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < count; i++)
+		hits += guid_name(&guids[i % GUIDS]) != NULL;
+	report("guid_name", count, now_ns() - t0);
+
+	/* keeps the loops from being optimised away */
+	if (hits == 0)
+		printf("%s\n", str);
+
+	return EXIT_SUCCESS;
+}
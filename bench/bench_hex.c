@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+/*
+ *  Hex payload throughput: the printf("%2.2x") per byte output and the
+ *  strtok_r() + strtol() per byte parsing the tools used, against
+ *  hex_encode(), hex_decode() and hexdump() on a dbx sized payload.
+ *
+ *  ex. bench_hex -z 262144 -n 50
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *what, size_t size, unsigned long rounds,
+	uint64_t dt)
+{
+	printf("%-24s %10.3f ms/payload  %10.1f MB/s\n", what,
+		dt / 1e6 / rounds, (double)size * rounds * 1e3 / dt);
+}
+
+/* the two pass parser uefivarset used for --data */
+static size_t old_decode(const char *hex, uint8_t *data)
+{
+	char *str = strdup(hex), *pch, *saveptr;
+	size_t i = 0;
+
+	if (!str)
+		return 0;
+	for (pch = strtok_r(str, " ,", &saveptr); pch;
+	     pch = strtok_r(NULL, " ,", &saveptr)) {
+		if (strlen(pch) != 2 || check_segment(pch, 2))
+			break;
+		i++;
+	}
+	strcpy(str, hex);
+	i = 0;
+	for (pch = strtok_r(str, " ,", &saveptr); pch;
+	     pch = strtok_r(NULL, " ,", &saveptr)) {
+		if (strlen(pch) != 2 || check_segment(pch, 2))
+			break;
+		data[i++] = strtol(pch, NULL, 16);
+	}
+	free(str);
+
+	return i;
+}
+
+/* separators only between bytes, the length of the result or -1 */
+static const struct {
+	const char *hex;
+	ssize_t len;
+} checks[] = {
+	{ "11 22,33\t44", 4 },
+	{ "1122", 2 },
+	{ "1 2", -1 },
+	{ "1,2", -1 },
+	{ "1 2 3 4", -1 },
+	{ "112", -1 },
+	{ "11 2", -1 },
+	{ "0011223344556677889900112233445566778899aabbccdd e", -1 },
+	{ "0011223344556677889900112233445566778899aabbccddeeff", 26 },
+	{ "0011223344556677889900112233445566778899aabbccdd e f", -1 },
+};
+
+static int self_check(void)
+{
+	uint8_t out[64];
+	size_t i;
+
+	for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+		ssize_t n = hex_decode(out, checks[i].hex,
+			strlen(checks[i].hex));
+
+		if (n != checks[i].len) {
+			printf("hex_decode(\"%s\") returned %zd, not %zd\n",
+				checks[i].hex, n, checks[i].len);
+			return UEFIOP_ERROR;
+		}
+	}
+
+	return UEFIOP_OK;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long rounds = 50, i;
+	size_t size = 262144, j;
+	uint8_t *data, *out;
+	char *dense, *spaced;
+	FILE *null;
+	uint64_t t0;
+	int c, ret = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "z:n:")) != -1) {
+		switch (c) {
+		case 'z':
+			size = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-z payload size] [-n rounds]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (size == 0 || rounds == 0)
+		return EXIT_FAILURE;
+	if (self_check())
+		return EXIT_FAILURE;
+
+	data = malloc(size);
+	out = malloc(size);
+	dense = malloc(2 * size + 1);
+	spaced = malloc(3 * size + 1);
+	null = fopen("/dev/null", "w");
+	if (!data || !out || !dense || !spaced || !null) {
+		printf("cannot set up the buffers\n");
+		goto out;
+	}
+	srand(1);
+	for (j = 0; j < size; j++)
+		data[j] = rand();
+	hex_encode(dense, data, size);
+	for (j = 0; j < size; j++) {
+		memcpy(spaced + 3 * j, dense + 2 * j, 2);
+		spaced[3 * j + 2] = ' ';
+	}
+	spaced[3 * size - 1] = '\0';
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < size; j++)
+			fprintf(null, "%2.2x", data[j]);
+		fflush(null);
+	}
+	report("printf %2.2x", size, rounds, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++) {
+		fwrite(dense, 1, hex_encode(dense, data, size), null);
+		fflush(null);
+	}
+	report("hex_encode", size, rounds, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++)
+		hexdump(null, data, size);
+	report("hexdump", size, rounds, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++) {
+		if (old_decode(spaced, out) != size) {
+			printf("strtok_r decode failed\n");
+			goto out;
+		}
+	}
+	report("strtok_r+strtol \"xx \"", size, rounds, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++) {
+		if (hex_decode(out, spaced, 3 * size - 1) != size) {
+			printf("hex_decode failed\n");
+			goto out;
+		}
+	}
+	report("hex_decode \"xx \"", size, rounds, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++) {
+		if (hex_decode(out, dense, 2 * size) != size ||
+		    memcmp(out, data, size)) {
+			printf("hex_decode failed\n");
+			goto out;
+		}
+	}
+	report("hex_decode dense", size, rounds, now_ns() - t0);
+	ret = EXIT_SUCCESS;
+
+out:
+	if (null)
+		fclose(null);
+	free(data);
+	free(out);
+	free(dense);
+	free(spaced);
+
+	return ret;
+}
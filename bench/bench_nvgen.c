@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Image generation rate of uefinvgen: a synthetic OVMF sized template is
+ *  customised with one delta manifest per VM, loading the delta, applying
+ *  it to a copy of the template and writing the image, as uefinvgen does.
+ *  A plain memcpy of the template per image is timed for comparison, and
+ *  the images are rendered once in memory only, to tell the cost of
+ *  writing the files apart.
+ *
+ *  ex. bench_nvgen -n 10000 -j 4
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+#include "manifest.h"
+
+#define TEMPLATE_SIZE	0x84000		/* OVMF_VARS.fd */
+
+static const char *global_guid = "8be4df61-93ca-11d2-aa0d-00e098032b8c";
+static const char *vendor_guid = "6f1f3c57-8e2a-4b1d-a0c4-5b7d9e2f1a36";
+
+typedef struct {
+	const uint8_t *tmpl;
+	size_t size;
+	const char *dir;
+	unsigned long images;
+	bool write;		/* or only render the images in memory */
+	unsigned long next;
+	unsigned long failed;
+} bench_gen;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void set_var(varstore *vs, const char *guidstr, const char *str,
+	size_t size)
+{
+	uint8_t *data = malloc(size);
+	uint16_t name[64];
+	efi_guid guid;
+
+	if (!data)
+		return;
+	memset(data, 0x5a, size);
+	string_to_guid(guidstr, &guid);
+	utf8_to_ucs2(name, str, strlen(str));
+	varstore_set(vs, name, (EFI_GUID *)&guid,
+		EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS |
+		EFI_VARIABLE_RUNTIME_ACCESS, size, data);
+	free(data);
+}
+
+/* a template shaped like a provisioned OVMF_VARS.fd */
+static uint8_t *make_template(size_t size, unsigned long vars)
+{
+	uint8_t *tmpl = malloc(size);
+	varstore *vs;
+	char name[32];
+	unsigned long i;
+
+	if (!tmpl || varstore_format(tmpl, size, true) ||
+	    !(vs = varstore_attach(tmpl, size))) {
+		free(tmpl);
+		return NULL;
+	}
+	set_var(vs, global_guid, "Lang", 4);
+	set_var(vs, global_guid, "PlatformLang", 6);
+	set_var(vs, global_guid, "Timeout", 2);
+	set_var(vs, global_guid, "BootOrder", 8);
+	for (i = 0; i < 4; i++) {
+		snprintf(name, sizeof(name), "Boot%04lX", i);
+		set_var(vs, global_guid, name, 120);
+	}
+	set_var(vs, global_guid, "ConIn", 64);
+	set_var(vs, global_guid, "ConOut", 64);
+	set_var(vs, global_guid, "ErrOut", 64);
+	for (i = 0; i < vars; i++) {
+		snprintf(name, sizeof(name), "Vendor%04lu", i);
+		set_var(vs, vendor_guid, name, 32 + (i % 8) * 64);
+	}
+	varstore_close(vs);
+
+	return tmpl;
+}
+
+static int write_deltas(const char *dir, unsigned long images)
+{
+	char path[4096];
+	unsigned long i;
+	FILE *fp;
+
+	for (i = 0; i < images; i++) {
+		snprintf(path, sizeof(path), "%s/vm%05lu.vars", dir, i);
+		fp = fopen(path, "w");
+		if (!fp)
+			return UEFIOP_ERROR;
+		fprintf(fp, "%s BootOrder 7 0500 0000 0100\n", global_guid);
+		fprintf(fp, "%s Boot0005 7 0100000074000400", global_guid);
+		fprintf(fp, "%096lx\n", i);
+		fprintf(fp, "%s VmId 7 %016lx\n", vendor_guid, i);
+		fclose(fp);
+	}
+
+	return UEFIOP_OK;
+}
+
+static void *worker(void *arg)
+{
+	bench_gen *gen = arg;
+	uint8_t *buf = malloc(gen->size);
+	char path[4096];
+
+	for (;;) {
+		unsigned long i = __atomic_fetch_add(&gen->next, 1,
+			__ATOMIC_RELAXED);
+		size_t line, failed;
+		manifest *m;
+		int fd;
+
+		if (!buf || i >= gen->images)
+			break;
+
+		snprintf(path, sizeof(path), "%s/vm%05lu.vars", gen->dir, i);
+		m = manifest_load(path, &line);
+		if (!m || manifest_render(m, gen->tmpl, gen->size, buf,
+				&failed) != EFI_SUCCESS) {
+			manifest_free(m);
+			__atomic_fetch_add(&gen->failed, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		manifest_free(m);
+		if (!gen->write)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/vm%05lu.fd", gen->dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1 || write(fd, buf, gen->size) != (ssize_t)gen->size)
+			__atomic_fetch_add(&gen->failed, 1, __ATOMIC_RELAXED);
+		if (fd != -1)
+			close(fd);
+	}
+	free(buf);
+
+	return NULL;
+}
+
+static void run(bench_gen *gen, pthread_t *threads, unsigned long jobs,
+	bool write)
+{
+	uint64_t t0, dt;
+	unsigned long i;
+
+	gen->write = write;
+	gen->next = 0;
+	t0 = now_ns();
+	for (i = 0; i < jobs; i++)
+		pthread_create(&threads[i], NULL, worker, gen);
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+	dt = now_ns() - t0;
+	printf("%-24s %8lu images  %10.0f images/s  %8.1f us/image  "
+		"%lu jobs, %lu failed\n", write ? "generate" : "render",
+		gen->images, gen->images * 1e9 / dt,
+		dt / 1000.0 / gen->images * jobs, jobs, gen->failed);
+}
+
+static void cleanup(const char *dir, unsigned long images)
+{
+	char path[4096];
+	unsigned long i;
+
+	for (i = 0; i < images; i++) {
+		snprintf(path, sizeof(path), "%s/vm%05lu.vars", dir, i);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/vm%05lu.fd", dir, i);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long images = 10000, vars = 32, jobs;
+	size_t size = TEMPLATE_SIZE;
+	char dir[] = "/tmp/bench_nvgen.XXXXXX";
+	pthread_t *threads;
+	bench_gen gen;
+	uint8_t *tmpl, *buf;
+	uint64_t t0, dt;
+	unsigned long i;
+	volatile uint8_t sink = 0;
+	int c, ret;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "n:j:v:")) != -1) {
+		switch (c) {
+		case 'n':
+			images = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			jobs = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			vars = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n images] [-j jobs] "
+				"[-v template vendor variables]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (jobs < 1)
+		jobs = 1;
+
+	tmpl = make_template(size, vars);
+	buf = malloc(size);
+	threads = calloc(jobs, sizeof(*threads));
+	if (!tmpl || !buf || !threads || !mkdtemp(dir)) {
+		printf("cannot set up the benchmark\n");
+		return EXIT_FAILURE;
+	}
+	if (write_deltas(dir, images)) {
+		printf("cannot write the deltas to %s\n", dir);
+		cleanup(dir, images);
+		return EXIT_FAILURE;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < images; i++) {
+		memcpy(buf, tmpl, size);
+		sink ^= buf[i % size];
+	}
+	dt = now_ns() - t0;
+	printf("%-24s %8lu images  %10.0f images/s  %8.1f us/image\n",
+		"memcpy", images, images * 1e9 / dt, dt / 1000.0 / images);
+
+	memset(&gen, 0, sizeof(gen));
+	gen.tmpl = tmpl;
+	gen.size = size;
+	gen.dir = dir;
+	gen.images = images;
+	run(&gen, threads, jobs, false);
+	run(&gen, threads, jobs, true);
+	ret = gen.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	cleanup(dir, images);
+	free(threads);
+	free(buf);
+	free(tmpl);
+
+	return ret;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Start-up cost of the uefiop tools: time init_driver()/deinit_driver()
+ *  pairs against the cost of the fork+exec of a shell that the old module
+ *  discovery paid on every cold start.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *what, uint64_t total, uint64_t min,
+	uint64_t max, unsigned long n)
+{
+	printf("%-24s %8lu runs  avg %10.2f us  min %10.2f us  max %10.2f us\n",
+		what, n, total / 1000.0 / n, min / 1000.0, max / 1000.0);
+}
+
+static int bench_driver(unsigned long n)
+{
+	uint64_t t0, dt, total = 0, min = UINT64_MAX, max = 0;
+	unsigned long i;
+	uefiop_ctx *ctx;
+
+	for (i = 0; i < n; i++) {
+		t0 = now_ns();
+		ctx = init_driver(NULL);
+		if (!ctx) {
+			printf("init_driver failed, is the efi runtime "
+				"module available?\n");
+			return UEFIOP_ERROR;
+		}
+		deinit_driver(ctx);
+		dt = now_ns() - t0;
+		total += dt;
+		if (dt < min)
+			min = dt;
+		if (dt > max)
+			max = dt;
+	}
+	report("init_driver+deinit", total, min, max, n);
+
+	return UEFIOP_OK;
+}
+
+static void bench_shell(unsigned long n)
+{
+	uint64_t t0, dt, total = 0, min = UINT64_MAX, max = 0;
+	unsigned long i;
+	pid_t pid;
+
+	for (i = 0; i < n; i++) {
+		t0 = now_ns();
+		pid = fork();
+		if (pid == 0) {
+			execl("/bin/sh", "sh", "-c", "true", NULL);
+			_exit(127);
+		}
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+		dt = now_ns() - t0;
+		total += dt;
+		if (dt < min)
+			min = dt;
+		if (dt > max)
+			max = dt;
+	}
+	report("fork+exec sh -c true", total, min, max, n);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long n = 1000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n iterations]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n == 0)
+		n = 1;
+
+	bench_shell(n);
+	if (bench_driver(n) != UEFIOP_OK)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
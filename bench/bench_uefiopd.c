@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Round trip latency and pipelined throughput of uefiopd. Run the daemon
+ *  with --fake to measure the transport alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <efi_runtime.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "uefiopd_proto.h"
+
+static uint8_t resp_buf[sizeof(uefiopd_resp_hdr) + UEFIOPD_MAX_BODY];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n <= 0)
+			return UEFIOP_ERROR;
+		p += n;
+		len -= n;
+	}
+	return UEFIOP_OK;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+
+	while (len) {
+		ssize_t n = read(fd, p, len);
+
+		if (n <= 0)
+			return UEFIOP_ERROR;
+		p += n;
+		len -= n;
+	}
+	return UEFIOP_OK;
+}
+
+static int read_resp(int fd, uefiopd_resp_hdr *hdr)
+{
+	if (read_all(fd, hdr, sizeof(*hdr)) || hdr->length > UEFIOPD_MAX_BODY)
+		return UEFIOP_ERROR;
+	return read_all(fd, resp_buf, hdr->length);
+}
+
+static size_t build_set(uint8_t *buf, uint32_t id, const efi_guid *guid,
+	const char *name, size_t datalen)
+{
+	uefiopd_req_hdr hdr;
+	uefiopd_setvariable_req r;
+	size_t namelen = strlen(name);
+	uint16_t ucs[64];
+
+	utf8_to_ucs2(ucs, name, namelen);
+	memcpy(&r.VendorGuid, guid, sizeof(r.VendorGuid));
+	r.Attributes = EFI_VARIABLE_NON_VOLATILE |
+		EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS;
+	r.VariableNameSize = (namelen + 1) * 2;
+	r.DataSize = datalen;
+
+	hdr.length = sizeof(r) + r.VariableNameSize + datalen;
+	hdr.op = UEFIOPD_SET_VARIABLE;
+	hdr.reserved = 0;
+	hdr.id = id;
+
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), &r, sizeof(r));
+	memcpy(buf + sizeof(hdr) + sizeof(r), ucs, r.VariableNameSize);
+	memset(buf + sizeof(hdr) + sizeof(r) + r.VariableNameSize, 0x5a, datalen);
+
+	return sizeof(hdr) + hdr.length;
+}
+
+static size_t build_get(uint8_t *buf, uint32_t id, const efi_guid *guid,
+	const char *name, size_t datalen)
+{
+	uefiopd_req_hdr hdr;
+	uefiopd_getvariable_req r;
+	size_t namelen = strlen(name);
+	uint16_t ucs[64];
+
+	utf8_to_ucs2(ucs, name, namelen);
+	memcpy(&r.VendorGuid, guid, sizeof(r.VendorGuid));
+	r.VariableNameSize = (namelen + 1) * 2;
+	r.DataSize = datalen;
+
+	hdr.length = sizeof(r) + r.VariableNameSize;
+	hdr.op = UEFIOPD_GET_VARIABLE;
+	hdr.reserved = 0;
+	hdr.id = id;
+
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), &r, sizeof(r));
+	memcpy(buf + sizeof(hdr) + sizeof(r), ucs, r.VariableNameSize);
+
+	return sizeof(hdr) + hdr.length;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = UEFIOPD_SOCKET;
+	unsigned long n = 100000, depth = 32, i, sent, done;
+	size_t datalen = 64, len;
+	struct sockaddr_un addr;
+	uefiopd_resp_hdr resp;
+	uint8_t *req;
+	uint64_t t0, dt;
+	efi_guid guid;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "s:n:d:z:")) != -1) {
+		switch (c) {
+		case 's':
+			path = optarg;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			depth = strtoul(optarg, NULL, 10);
+			break;
+		case 'z':
+			datalen = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-s socket] [-n requests] "
+				"[-d pipeline depth] [-z data size]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n == 0 || depth == 0 || datalen > UEFIOPD_MAX_BODY / 2) {
+		printf("Invalid arguments.\n");
+		return EXIT_FAILURE;
+	}
+
+	string_to_guid("4a6f8b1c-1d5e-4c33-9f0a-6b2d7e8c9a01", &guid);
+	req = malloc(depth * (sizeof(uefiopd_req_hdr) + 256) + datalen + 256);
+	if (!req)
+		return EXIT_FAILURE;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("Cannot connect to %s.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	len = build_set(req, 0, &guid, "UefiopdBench", datalen);
+	if (write_all(fd, req, len) || read_resp(fd, &resp) ||
+	    resp.status != EFI_SUCCESS) {
+		printf("SetVariable failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* one request in flight at a time */
+	len = build_get(req, 1, &guid, "UefiopdBench", datalen);
+	t0 = now_ns();
+	for (i = 0; i < n; i++) {
+		if (write_all(fd, req, len) || read_resp(fd, &resp) ||
+		    resp.status != EFI_SUCCESS) {
+			printf("GetVariable failed.\n");
+			return EXIT_FAILURE;
+		}
+	}
+	dt = now_ns() - t0;
+	printf("serial      %8lu requests  %8.2f us/round trip\n",
+		n, dt / 1000.0 / n);
+
+	/* keep depth requests in flight */
+	for (i = 0; i < depth; i++)
+		build_get(req + i * len, i, &guid, "UefiopdBench", datalen);
+	t0 = now_ns();
+	sent = done = 0;
+	while (done < n) {
+		unsigned long batch = depth - (sent - done);
+
+		if (batch > n - sent)
+			batch = n - sent;
+		if (batch && write_all(fd, req, batch * len))
+			return EXIT_FAILURE;
+		sent += batch;
+		if (read_resp(fd, &resp) || resp.status != EFI_SUCCESS) {
+			printf("GetVariable failed.\n");
+			return EXIT_FAILURE;
+		}
+		done++;
+	}
+	dt = now_ns() - t0;
+	printf("pipelined   %8lu requests  %8.2f us/request  depth %lu  "
+		"%.0f requests/s\n", n, dt / 1000.0 / n, depth,
+		n * 1e9 / dt);
+
+	close(fd);
+	free(req);
+
+	return EXIT_SUCCESS;
+}
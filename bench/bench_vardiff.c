@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Speed of uefivardiff on large stores: two snapshots of a store with many
+ *  HwErrRec style variables, a few of them changed, added or removed, are
+ *  compared with snapshot_diff().
+ *
+ *  ex. bench_vardiff -v 50000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+#include "snapshot.h"
+
+#define DATA_SIZE	96
+
+static const char *hwerr_guid = "414e6bdd-e47b-47cc-b244-bb61020cf516";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* every step'th variable differs in the second store, by kind in turn */
+static int make_snapshot(const char *image, const char *snap,
+	unsigned long vars, unsigned long step, int second)
+{
+	size_t size = ((vars * 160) / 4096 + 2) * 4096;
+	uint8_t *buf = malloc(size), data[DATA_SIZE];
+	uefiop_ctx *ctx;
+	varstore *vs;
+	char spec[4200], str[32];
+	uint16_t name[32];
+	efi_guid guid;
+	unsigned long i;
+	uint64_t status;
+	size_t count;
+	int fd, rc;
+
+	if (!buf || varstore_format(buf, size, true) ||
+	    !(vs = varstore_attach(buf, size))) {
+		free(buf);
+		return UEFIOP_ERROR;
+	}
+	string_to_guid(hwerr_guid, &guid);
+	for (i = 0; i < vars; i++) {
+		bool differs = second && i % step == 0;
+
+		if (differs && (i / step) % 3 == 0)
+			continue;	/* removed */
+		snprintf(str, sizeof(str), "HwErrRec%05lu%s", i,
+			differs && (i / step) % 3 == 1 ? "N" : "");
+		utf8_to_ucs2(name, str, strlen(str));
+		memset(data, (int)i, sizeof(data));
+		if (differs && (i / step) % 3 == 2)
+			data[DATA_SIZE / 2] ^= 0xff;
+		varstore_set(vs, name, (EFI_GUID *)&guid,
+			EFI_VARIABLE_NON_VOLATILE |
+			EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			EFI_VARIABLE_RUNTIME_ACCESS |
+			EFI_VARIABLE_HARDWARE_ERROR_RECORD, sizeof(data), data);
+	}
+	varstore_close(vs);
+
+	fd = open(image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	rc = fd == -1 || write(fd, buf, size) != (ssize_t)size;
+	if (fd != -1)
+		close(fd);
+	free(buf);
+	if (rc)
+		return UEFIOP_ERROR;
+
+	snprintf(spec, sizeof(spec), "image:%s", image);
+	ctx = uefiop_open(spec);
+	if (!ctx)
+		return UEFIOP_ERROR;
+	rc = snapshot_take(ctx, snap, &count, &status);
+	uefiop_close(ctx);
+
+	return rc;
+}
+
+static int count_change(snapshot *old_snap, const snapshot_entry *old_e,
+	snapshot *new_snap, const snapshot_entry *new_e,
+	unsigned int changes, void *arg)
+{
+	(*(unsigned long *)arg)++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long vars = 50000, rounds = 20, step = 100, diffs = 0, i;
+	char dir[] = "/tmp/bench_vardiff.XXXXXX";
+	char img1[64], img2[64], snap1[64], snap2[64];
+	snapshot *s1, *s2;
+	uint64_t t0, dt;
+	int c, ret = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "v:n:s:")) != -1) {
+		switch (c) {
+		case 'v':
+			vars = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			step = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-v variables] [-n rounds] "
+				"[-s every s'th variable differs]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (vars > 99999)
+		vars = 99999;
+	if (step == 0 || rounds == 0)
+		return EXIT_FAILURE;
+
+	if (!mkdtemp(dir)) {
+		printf("cannot create %s\n", dir);
+		return EXIT_FAILURE;
+	}
+	snprintf(img1, sizeof(img1), "%s/old.fd", dir);
+	snprintf(img2, sizeof(img2), "%s/new.fd", dir);
+	snprintf(snap1, sizeof(snap1), "%s/old.snap", dir);
+	snprintf(snap2, sizeof(snap2), "%s/new.snap", dir);
+
+	if (make_snapshot(img1, snap1, vars, step, 0) ||
+	    make_snapshot(img2, snap2, vars, step, 1)) {
+		printf("cannot build the snapshots\n");
+		goto out;
+	}
+	s1 = snapshot_open(snap1);
+	s2 = snapshot_open(snap2);
+	if (!s1 || !s2) {
+		printf("cannot open the snapshots\n");
+		snapshot_close(s1);
+		snapshot_close(s2);
+		goto out;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < rounds; i++)
+		snapshot_diff(s1, s2, count_change, &diffs);
+	dt = now_ns() - t0;
+	printf("%-24s %8lu vars  %8lu differences  %10.3f ms/diff  "
+		"%10.0f vars/s\n", "snapshot_diff", vars, diffs / rounds,
+		dt / 1e6 / rounds, vars * rounds * 1e9 / dt);
+
+	snapshot_close(s1);
+	snapshot_close(s2);
+	ret = EXIT_SUCCESS;
+
+out:
+	unlink(img1);
+	unlink(img2);
+	unlink(snap1);
+	unlink(snap2);
+	rmdir(dir);
+
+	return ret;
+}
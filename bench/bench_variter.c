@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+/*
+ *  Speed of a variter walk over an image, names only and with the size
+ *  probe, against a bare GetNextVariableName loop. Before timing, a few
+ *  variables are deleted in the middle of a walk to check that the walk
+ *  carries on past them.
+ *
+ *  ex. bench_variter -v 20000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+#include "variter.h"
+
+#define NAME_SIZE	1024
+
+static const char *bench_guid = "6f1f3c57-8e2a-4b1d-a0c4-5b7d9e2f1a36";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void var_name(uint16_t *name, unsigned long i)
+{
+	char str[32];
+
+	snprintf(str, sizeof(str), "BenchVar%05lu", i);
+	utf8_to_ucs2(name, str, strlen(str));
+}
+
+static unsigned long var_index(const uint16_t *name)
+{
+	char str[32];
+
+	ucs2_to_utf8(str, name, ucs2_len(name));
+	return strtoul(str + 8, NULL, 10);
+}
+
+static int make_image(const char *image, unsigned long vars,
+	const efi_guid *guid)
+{
+	size_t size = ((vars * 96) / 4096 + 2) * 4096;
+	uint8_t *buf = malloc(size), data[8] = { 0 };
+	varstore *vs;
+	uint16_t name[32];
+	unsigned long i;
+	int fd, rc;
+
+	if (!buf || varstore_format(buf, size, true) ||
+	    !(vs = varstore_attach(buf, size))) {
+		free(buf);
+		return UEFIOP_ERROR;
+	}
+	for (i = 0; i < vars; i++) {
+		var_name(name, i);
+		varstore_set(vs, name, (EFI_GUID *)guid,
+			EFI_VARIABLE_NON_VOLATILE |
+			EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			EFI_VARIABLE_RUNTIME_ACCESS, sizeof(data), data);
+	}
+	varstore_close(vs);
+
+	fd = open(image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	rc = fd == -1 || write(fd, buf, size) != (ssize_t)size;
+	if (fd != -1)
+		close(fd);
+	free(buf);
+
+	return rc ? UEFIOP_ERROR : UEFIOP_OK;
+}
+
+struct deleter {
+	uefiop_ctx *ctx;
+	unsigned long every;
+};
+
+/* deletes the variable between the name step and the size probe */
+static bool delete_some(const variter_var *var, void *arg)
+{
+	struct deleter *d = arg;
+
+	if (var_index(var->name) % d->every == 0)
+		uefiop_set_variable(d->ctx, var->name, var->guid, 0, 0, NULL);
+	return true;
+}
+
+/*
+ * Walk the image, deleting variables as they come, and expect every
+ * variable that was not deleted to be seen exactly once.
+ */
+static int self_check(uefiop_ctx *ctx, unsigned long vars)
+{
+	struct deleter d = { ctx, 7 };
+	const variter_var *var;
+	unsigned char *seen = calloc(vars, 1);
+	variter *it = variter_new(ctx, VARITER_PROBE);
+	uint64_t status;
+	unsigned long i, n, failed = 0;
+
+	if (!seen || !it) {
+		free(seen);
+		variter_free(it);
+		return UEFIOP_ERROR;
+	}
+
+	/* deleted between the calls of a step */
+	variter_set_filter(it, delete_some, &d);
+	while ((status = variter_next(it, &var)) == EFI_SUCCESS)
+		seen[var_index(var->name)]++;
+	if (status != EFI_NOT_FOUND) {
+		printf("walk with deletes stopped: 0x%llx\n",
+			(unsigned long long)status);
+		failed++;
+	}
+	for (i = 0; i < vars; i++)
+		if (seen[i] != (i % d.every != 0)) {
+			printf("BenchVar%05lu seen %u times\n", i, seen[i]);
+			failed++;
+		}
+
+	/* deleted after the step, noticed by the caller */
+	variter_free(it);
+	it = variter_new(ctx, 0);
+	memset(seen, 0, vars);
+	n = 0;
+	while (it && (status = variter_next(it, &var)) == EFI_SUCCESS) {
+		i = var_index(var->name);
+		if (++n % 3 == 0) {
+			uefiop_set_variable(ctx, var->name, var->guid, 0, 0,
+				NULL);
+			variter_drop(it);
+			continue;
+		}
+		seen[i]++;
+	}
+	if (!it || status != EFI_NOT_FOUND) {
+		printf("walk with dropped names stopped: 0x%llx\n",
+			(unsigned long long)status);
+		failed++;
+	}
+	for (i = 0; i < vars; i++)
+		if (seen[i] > 1) {
+			printf("BenchVar%05lu seen %u times\n", i, seen[i]);
+			failed++;
+		}
+	variter_free(it);
+	free(seen);
+
+	return failed ? UEFIOP_ERROR : UEFIOP_OK;
+}
+
+static int count_var(const variter_var *var, void *arg)
+{
+	(*(unsigned long *)arg)++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long vars = 20000, rounds = 20, found, r;
+	char image[] = "/tmp/bench_variter.XXXXXX", spec[64];
+	uint16_t *name = malloc(NAME_SIZE);
+	uefiop_ctx *ctx = NULL;
+	efi_guid guid, g;
+	uint64_t t0, dt, status, size;
+	int c, fd, ret = EXIT_FAILURE;
+
+	while ((c = getopt(argc, argv, "v:n:")) != -1) {
+		switch (c) {
+		case 'v':
+			vars = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-v variables] [-n rounds]\n",
+				argv[0]);
+			free(name);
+			return EXIT_FAILURE;
+		}
+	}
+	if (vars > 99999)
+		vars = 99999;
+	if (vars == 0 || rounds == 0 || !name) {
+		free(name);
+		return EXIT_FAILURE;
+	}
+
+	string_to_guid(bench_guid, &guid);
+	fd = mkstemp(image);
+	if (fd == -1) {
+		printf("cannot create %s\n", image);
+		free(name);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	snprintf(spec, sizeof(spec), "image:%s", image);
+
+	if (make_image(image, vars, &guid) || !(ctx = uefiop_open(spec))) {
+		printf("cannot build %s\n", spec);
+		goto out;
+	}
+	if (self_check(ctx, vars)) {
+		printf("self check failed\n");
+		goto out;
+	}
+	uefiop_close(ctx);
+	ctx = NULL;
+	if (make_image(image, vars, &guid) || !(ctx = uefiop_open(spec))) {
+		printf("cannot build %s\n", spec);
+		goto out;
+	}
+
+	t0 = now_ns();
+	for (r = 0, found = 0; r < rounds; r++) {
+		name[0] = 0;
+		for (;;) {
+			size = NAME_SIZE;
+			status = uefiop_get_next_variable_name(ctx, &size,
+				name, (EFI_GUID *)&g);
+			if (status != EFI_SUCCESS)
+				break;
+			found++;
+		}
+	}
+	dt = now_ns() - t0;
+	printf("%-24s %8lu vars  %10.1f ns/var\n", "GetNextVariableName",
+		found / rounds, (double)dt / found);
+
+	t0 = now_ns();
+	for (r = 0, found = 0; r < rounds; r++)
+		variter_walk(ctx, 0, NULL, NULL, count_var, &found, &status);
+	dt = now_ns() - t0;
+	printf("%-24s %8lu vars  %10.1f ns/var\n", "variter_walk",
+		found / rounds, (double)dt / found);
+
+	t0 = now_ns();
+	for (r = 0, found = 0; r < rounds; r++)
+		variter_walk(ctx, VARITER_PROBE, NULL, NULL, count_var, &found,
+			&status);
+	dt = now_ns() - t0;
+	printf("%-24s %8lu vars  %10.1f ns/var\n", "variter_walk probe",
+		found / rounds, (double)dt / found);
+
+	ret = found == vars * rounds ? EXIT_SUCCESS : EXIT_FAILURE;
+out:
+	uefiop_close(ctx);
+	unlink(image);
+	free(name);
+
+	return ret;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_BACKEND_H_
+#define _UEFIOP_BACKEND_H_
+
+#include <stdint.h>
+
+#include "efi_runtime.h"
+
+/*
+ * A backend implements the runtime services behind a uefiop_ctx. open()
+ * gets the part of the backend spec after the ':' (NULL if there is none)
+ * and returns the backend's private state, or NULL with errno set. Ops a
+ * backend cannot provide are left NULL, the context then returns
+ * EFI_UNSUPPORTED. The context serialises all calls into a backend.
+ */
+typedef struct {
+	const char *name;
+	void *(*open)(const char *path);
+	void (*close)(void *priv);
+	uint64_t (*get_variable)(void *priv, const uint16_t *name,
+		const EFI_GUID *guid, uint32_t *attr, uint64_t *size,
+		void *data);
+	uint64_t (*set_variable)(void *priv, const uint16_t *name,
+		const EFI_GUID *guid, uint32_t attr, uint64_t size,
+		const void *data);
+	uint64_t (*get_next_variable_name)(void *priv, uint64_t *size,
+		uint16_t *name, EFI_GUID *guid);
+	uint64_t (*query_variable_info)(void *priv, uint32_t attr,
+		uint64_t *max_storage, uint64_t *remaining,
+		uint64_t *max_size);
+	uint64_t (*get_time)(void *priv, EFI_TIME *time,
+		EFI_TIME_CAPABILITIES *cap);
+	uint64_t (*set_time)(void *priv, EFI_TIME *time);
+	uint64_t (*get_wakeup_time)(void *priv, uint8_t *enabled,
+		uint8_t *pending, EFI_TIME *time);
+	uint64_t (*set_wakeup_time)(void *priv, uint8_t enabled,
+		EFI_TIME *time);
+	void (*reset_system)(void *priv, int type, uint64_t status,
+		uint64_t size, void *data);
+} uefiop_backend_ops;
+
+extern const uefiop_backend_ops uefiop_ioctl_backend;
+extern const uefiop_backend_ops uefiop_efivarfs_backend;
+extern const uefiop_backend_ops uefiop_image_backend;
+extern const uefiop_backend_ops uefiop_snapshot_backend;
+
+#endif /* _UEFIOP_BACKEND_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_CATALOG_H_
+#define _UEFIOP_CATALOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libuefiop.h"
+
+/*
+ * An in memory catalog of variable names. The few distinct GUIDs of a
+ * store are interned in a table and referred to by their id, the names
+ * are kept one after the other in a single UCS-2 arena, so an entry is
+ * only 8 bytes. Lookups go through an open addressing hash on the GUID id
+ * and the name, prefix queries through the entries sorted by GUID id and
+ * then name.
+ */
+typedef struct {
+	uint32_t	name_offset;	/* in characters, into the arena */
+	uint16_t	name_len;	/* in characters, terminator excluded */
+	uint16_t	guid_id;
+} catalog_entry;
+
+typedef struct catalog catalog;
+
+catalog *catalog_new(void);
+void catalog_free(catalog *cat);
+
+/*
+ * Add every variable reachable through ctx with GetNextVariableName.
+ * Returns the EFI status of the call that failed, EFI_OUT_OF_RESOURCES
+ * if the catalog could not grow, or EFI_SUCCESS.
+ */
+uint64_t catalog_load(catalog *cat, uefiop_ctx *ctx);
+
+/* a name already in the catalog is not added twice */
+int catalog_add(catalog *cat, const uint16_t *name, const EFI_GUID *guid);
+const catalog_entry *catalog_find(catalog *cat, const uint16_t *name,
+	const EFI_GUID *guid);
+
+/* the entries, sorted by GUID id and then name */
+size_t catalog_count(catalog *cat);
+const catalog_entry *catalog_entries(catalog *cat);
+
+/*
+ * The entries of guid whose name starts with prefix, as "Boot" for all
+ * the Boot#### of the global GUID: returns their number with *first set
+ * to the first of them in catalog_entries().
+ */
+size_t catalog_prefix(catalog *cat, const EFI_GUID *guid,
+	const uint16_t *prefix, const catalog_entry **first);
+
+/* the distinct GUIDs, indexed by guid id */
+size_t catalog_guid_count(catalog *cat);
+const EFI_GUID *catalog_guid(catalog *cat, const catalog_entry *e);
+const EFI_GUID *catalog_guids(catalog *cat);
+
+/* NUL terminated */
+const uint16_t *catalog_name(catalog *cat, const catalog_entry *e);
+
+#endif /* _UEFIOP_CATALOG_H_ */
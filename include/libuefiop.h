@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016-2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _LIBUEFIOP_H_
+#define _LIBUEFIOP_H_
+
+#include <stdint.h>
+
+#include "efi_runtime.h"
+#include "uefiop.h"
+
+/*
+ * libuefiop gives access to the UEFI runtime services through an opaque
+ * context. All state lives in the context, and calls on one context are
+ * serialised internally, so a context may be shared between threads.
+ *
+ * The runtime service calls return the EFI status of the call, or
+ * EFI_DEVICE_ERROR when the call could not be passed to the firmware.
+ */
+typedef struct uefiop_ctx uefiop_ctx;
+
+/*
+ * Open a context on the backend given by spec:
+ *   "ioctl[:<device>]"	the efi runtime driver, /dev/efi_runtime or
+ *			/dev/efi_test by default, loading the module if needed
+ *   "/dev/<device>"	same as "ioctl:/dev/<device>"
+ *   "efivarfs[:<dir>]"	efivarfs, /sys/firmware/efi/efivars by default, or
+ *			a directory laid out the same way
+ *   "image:<file>"	a firmware variable store image such as OVMF_VARS.fd,
+ *			opened read only if the file cannot be written
+ *   "snapshot:<file>"	a snapshot taken by uefisnapshot, read only
+ * A NULL spec takes $UEFIOP_BACKEND, or else the efi runtime driver with
+ * efivarfs as the fallback. Returns NULL and sets errno on failure.
+ */
+uefiop_ctx *uefiop_open(const char *spec);
+void uefiop_close(uefiop_ctx *ctx);
+const char *uefiop_backend_name(uefiop_ctx *ctx);
+
+uint64_t uefiop_get_variable(uefiop_ctx *ctx, const uint16_t *name,
+	const EFI_GUID *guid, uint32_t *attr, uint64_t *size, void *data);
+uint64_t uefiop_set_variable(uefiop_ctx *ctx, const uint16_t *name,
+	const EFI_GUID *guid, uint32_t attr, uint64_t size, const void *data);
+uint64_t uefiop_get_next_variable_name(uefiop_ctx *ctx, uint64_t *size,
+	uint16_t *name, EFI_GUID *guid);
+uint64_t uefiop_query_variable_info(uefiop_ctx *ctx, uint32_t attr,
+	uint64_t *max_storage, uint64_t *remaining, uint64_t *max_size);
+uint64_t uefiop_get_time(uefiop_ctx *ctx, EFI_TIME *time,
+	EFI_TIME_CAPABILITIES *cap);
+uint64_t uefiop_set_time(uefiop_ctx *ctx, EFI_TIME *time);
+uint64_t uefiop_get_wakeup_time(uefiop_ctx *ctx, uint8_t *enabled,
+	uint8_t *pending, EFI_TIME *time);
+uint64_t uefiop_set_wakeup_time(uefiop_ctx *ctx, uint8_t enabled,
+	EFI_TIME *time);
+void uefiop_reset_system(uefiop_ctx *ctx, int type, uint64_t status,
+	uint64_t size, void *data);
+
+#endif /* _LIBUEFIOP_H_ */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_MANIFEST_H_
+#define _UEFIOP_MANIFEST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "efi_runtime.h"
+#include "varstore.h"
+#include "libuefiop.h"
+
+/*
+ * A manifest lists variables to set or delete, one per line:
+ *
+ *   # comment
+ *   <guid> <name> <attributes> <data>
+ *
+ * where the attributes are hex as for uefivarset -a, and the data is hex
+ * bytes (blanks between bytes allowed), @<file> for the content of a
+ * file, or - to delete the variable.
+ */
+typedef struct {
+	EFI_GUID guid;
+	uint16_t *name;
+	uint32_t attr;
+	uint8_t *data;
+	size_t size;
+	bool remove;
+} manifest_entry;
+
+typedef struct {
+	manifest_entry *entries;
+	size_t count;
+} manifest;
+
+/*
+ * Returns NULL and sets errno on failure, with *line set to the offending
+ * line, or 0 if the manifest could not be read.
+ */
+manifest *manifest_load(const char *path, size_t *line);
+void manifest_free(manifest *m);
+
+/*
+ * Set the variables of the manifest in a store. Deleting a variable the
+ * store does not hold succeeds. Returns the EFI status of the first write
+ * that failed, with *failed set to its entry.
+ */
+uint64_t manifest_apply_store(const manifest *m, varstore *vs,
+	size_t *failed);
+
+/*
+ * Copy the template store image to buf and apply the manifest to the copy.
+ * Returns the EFI status as manifest_apply_store().
+ */
+uint64_t manifest_render(const manifest *m, const void *tmpl, size_t size,
+	void *buf, size_t *failed);
+
+/*
+ * Bring the variables reached through ctx to the state the manifest
+ * describes with as few SetVariable calls as possible: an entry followed
+ * by a later set or delete of the same variable is dropped, and a set
+ * that would not change the data or attributes of the variable, or a
+ * delete of a variable that does not exist, is skipped. Appends and
+ * authenticated writes are always made. The current value of each
+ * variable is read once, up to the size of the data to set.
+ *
+ * cb, when not NULL, is called for each write before it is made, and with
+ * MANIFEST_DRY_RUN no write is made. Returns the EFI status of the first
+ * read or write that failed, with *failed set to its entry.
+ */
+#define MANIFEST_DRY_RUN	0x1
+
+typedef struct {
+	size_t writes;
+	size_t unchanged;	/* skipped, the variable already matches */
+	size_t coalesced;	/* dropped, a later entry overrides them */
+} manifest_stats;
+
+typedef void (*manifest_write_cb)(const manifest_entry *e, void *arg);
+
+uint64_t manifest_apply(const manifest *m, uefiop_ctx *ctx,
+	unsigned int flags, manifest_write_cb cb, void *arg,
+	manifest_stats *stats, size_t *failed);
+
+#endif /* _UEFIOP_MANIFEST_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_SIZEHINT_H_
+#define _UEFIOP_SIZEHINT_H_
+
+#include <stdint.h>
+
+#include "efi_runtime.h"
+
+#define SIZEHINT_DIR_ENV	"UEFIOP_CACHE"
+
+/*
+ * The size hint cache remembers the data size of variables, one small
+ * file per GUID and name, so that a variable can be read with a buffer
+ * of the right size on the first GetVariable call. A hint is only a
+ * guess: a stale one costs at most the second call it was meant to save.
+ *
+ * The cache lives in $UEFIOP_CACHE, else UEFIOP_RUN_DIR/sizehint for
+ * root, which is emptied on every boot, else $XDG_CACHE_HOME/uefiop or
+ * ~/.cache/uefiop. Returns a malloc()ed path, creating the directory, or
+ * NULL with errno set.
+ */
+char *sizehint_dir(void);
+
+/* Returns the cached size of the variable, or 0 if there is none */
+uint64_t sizehint_get(const char *dir, const uint16_t *name,
+	const EFI_GUID *guid);
+
+/* Returns UEFIOP_OK or UEFIOP_ERROR with errno set */
+int sizehint_put(const char *dir, const uint16_t *name, const EFI_GUID *guid,
+	uint64_t size);
+
+#endif /* _UEFIOP_SIZEHINT_H_ */
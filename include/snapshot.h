@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_SNAPSHOT_H_
+#define _UEFIOP_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libuefiop.h"
+#include "variter.h"
+
+/*
+ * A snapshot file holds every variable of a store, laid out to be used
+ * straight from an mmap():
+ *
+ *   snapshot_header
+ *   snapshot_entry[count]	sorted by guid, then name
+ *   names			UCS-2, NUL terminated
+ *   data			8 byte aligned
+ *
+ * All offsets are from the start of the file, little endian.
+ */
+#define SNAPSHOT_MAGIC		"UEFISNAP"
+#define SNAPSHOT_VERSION	1
+
+typedef struct {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	count;
+	uint64_t	index_offset;
+	uint64_t	names_offset;
+	uint64_t	data_offset;
+	uint64_t	file_size;
+	uint64_t	reserved[2];
+} __attribute__ ((packed)) snapshot_header;
+
+typedef struct {
+	EFI_GUID	guid;
+	uint32_t	attr;
+	uint32_t	name_size;	/* in bytes, terminator included */
+	uint64_t	name_offset;
+	uint64_t	data_offset;
+	uint64_t	data_size;
+	uint64_t	hash;		/* hash64() of the data */
+} __attribute__ ((packed)) snapshot_entry;
+
+typedef struct snapshot snapshot;
+
+/*
+ * Read every variable through ctx into a new snapshot file at path. On
+ * failure returns UEFIOP_ERROR with *status the EFI status of the runtime
+ * service that failed, or EFI_SUCCESS and errno set if the file could not
+ * be written.
+ */
+int snapshot_take(uefiop_ctx *ctx, const char *path, size_t *count,
+	uint64_t *status);
+/* only the variables that match, NULL for all of them */
+int snapshot_take_match(uefiop_ctx *ctx, const char *path,
+	const variter_match *match, size_t *count, uint64_t *status);
+
+/* returns NULL and sets errno, ENOEXEC if path is not a snapshot */
+snapshot *snapshot_open(const char *path);
+void snapshot_close(snapshot *snap);
+
+size_t snapshot_count(snapshot *snap);
+const snapshot_entry *snapshot_entries(snapshot *snap);
+const snapshot_entry *snapshot_find(snapshot *snap, const uint16_t *name,
+	const EFI_GUID *guid);
+const uint16_t *snapshot_name(snapshot *snap, const snapshot_entry *e);
+const uint8_t *snapshot_data(snapshot *snap, const snapshot_entry *e);
+
+/*
+ * Walk two snapshots in index order and call cb for every variable that
+ * differs: old_e is NULL for an added variable, new_e for a removed one,
+ * otherwise changes tells what changed. Payloads are compared by hash,
+ * and byte by byte only when the hashes match. A non zero return from cb
+ * stops the walk and is returned.
+ */
+#define SNAPSHOT_ATTR_CHANGED	0x1
+#define SNAPSHOT_DATA_CHANGED	0x2
+
+typedef int (*snapshot_diff_cb)(snapshot *old_snap,
+	const snapshot_entry *old_e, snapshot *new_snap,
+	const snapshot_entry *new_e, unsigned int changes, void *arg);
+
+int snapshot_diff(snapshot *old_snap, snapshot *new_snap,
+	snapshot_diff_cb cb, void *arg);
+
+/* the order of the snapshot index */
+int snapshot_compare(const EFI_GUID *guid1, const uint16_t *name1,
+	const EFI_GUID *guid2, const uint16_t *name2);
+
+#endif /* _UEFIOP_SNAPSHOT_H_ */
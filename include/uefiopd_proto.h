@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016-2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOPD_PROTO_H_
+#define _UEFIOPD_PROTO_H_
+
+/*
+ * Wire format of the uefiopd Unix socket.
+ *
+ * Every message is a fixed header followed by length bytes of body, in host
+ * byte order (the socket is local only). A request body starts with the
+ * op specific struct below, followed by the variable length fields in the
+ * order given. Responses carry the EFI status of the call and echo the
+ * request id, requests on one connection are answered in order, so a
+ * client may pipeline as many requests as it likes.
+ */
+
+#define UEFIOPD_SOCKET		"/run/uefiop/uefiopd.sock"
+
+/* largest body accepted in either direction */
+#define UEFIOPD_MAX_BODY	(1024 * 1024)
+
+enum {
+	UEFIOPD_GET_VARIABLE = 1,
+	UEFIOPD_SET_VARIABLE,
+	UEFIOPD_GET_NEXT_VARIABLE_NAME,
+	UEFIOPD_GET_TIME,
+	UEFIOPD_QUERY_VARIABLE_INFO,
+};
+
+typedef struct {
+	uint32_t	length;		/* bytes of body following the header */
+	uint16_t	op;
+	uint16_t	reserved;
+	uint32_t	id;		/* echoed in the response */
+} __attribute__ ((packed)) uefiopd_req_hdr;
+
+typedef struct {
+	uint32_t	length;
+	uint16_t	op;
+	uint16_t	reserved;
+	uint32_t	id;
+	uint64_t	status;		/* EFI status of the call */
+} __attribute__ ((packed)) uefiopd_resp_hdr;
+
+/* request: + VariableName, response: + Data when status is EFI_SUCCESS */
+typedef struct {
+	EFI_GUID	VendorGuid;
+	uint32_t	VariableNameSize;	/* bytes, including the NULL */
+	uint64_t	DataSize;		/* size of the client's buffer */
+} __attribute__ ((packed)) uefiopd_getvariable_req;
+
+typedef struct {
+	uint32_t	Attributes;
+	uint64_t	DataSize;		/* required size when too small */
+} __attribute__ ((packed)) uefiopd_getvariable_resp;
+
+/* request: + VariableName + Data, response: empty */
+typedef struct {
+	EFI_GUID	VendorGuid;
+	uint32_t	Attributes;
+	uint32_t	VariableNameSize;
+	uint64_t	DataSize;
+} __attribute__ ((packed)) uefiopd_setvariable_req;
+
+/* request: + current VariableName, response: + next VariableName */
+typedef struct {
+	EFI_GUID	VendorGuid;
+	uint32_t	VariableNameSize;	/* bytes of the current name */
+	uint64_t	BufferSize;		/* size of the client's buffer */
+} __attribute__ ((packed)) uefiopd_getnextvariablename_req;
+
+typedef struct {
+	EFI_GUID	VendorGuid;
+	uint64_t	VariableNameSize;
+} __attribute__ ((packed)) uefiopd_getnextvariablename_resp;
+
+/* request: empty */
+typedef struct {
+	EFI_TIME		Time;
+	EFI_TIME_CAPABILITIES	Capabilities;
+} __attribute__ ((packed)) uefiopd_gettime_resp;
+
+typedef struct {
+	uint32_t	Attributes;
+} __attribute__ ((packed)) uefiopd_queryvariableinfo_req;
+
+typedef struct {
+	uint64_t	MaximumVariableStorageSize;
+	uint64_t	RemainingVariableStorageSize;
+	uint64_t	MaximumVariableSize;
+} __attribute__ ((packed)) uefiopd_queryvariableinfo_resp;
+
+#endif /* _UEFIOPD_PROTO_H_ */
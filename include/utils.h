@@ -33,44 +33,34 @@
 #ifndef _UEFIOP_UTILS_
 #define _UEFIOP_UTILS_
 
-#define BITS_PER_LONG	(sizeof(long) * 8)
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
-#define HIGH_BIT_SET	(1UL << (BITS_PER_LONG-1))
+#include "libuefiop.h"
 
-#define EFI_SUCCESS			0
-#define EFI_LOAD_ERROR			(1 | HIGH_BIT_SET)
-#define EFI_INVALID_PARAMETER		(2 | HIGH_BIT_SET)
-#define EFI_UNSUPPORTED			(3 | HIGH_BIT_SET)
-#define EFI_BAD_BUFFER_SIZE 		(4 | HIGH_BIT_SET)
-#define EFI_BUFFER_TOO_SMALL		(5 | HIGH_BIT_SET)
-#define EFI_NOT_READY			(6 | HIGH_BIT_SET)
-#define EFI_DEVICE_ERROR		(7 | HIGH_BIT_SET)
-#define EFI_WRITE_PROTECTED		(8 | HIGH_BIT_SET)
-#define EFI_OUT_OF_RESOURCES		(9 | HIGH_BIT_SET)
-#define EFI_VOLUME_CORRUPTED		(10 | HIGH_BIT_SET)
-#define EFI_VOLUME_FULL			(11 | HIGH_BIT_SET)
-#define EFI_NO_MEDIA			(12 | HIGH_BIT_SET)
-#define EFI_MEDIA_CHANGED		(13 | HIGH_BIT_SET)
-#define EFI_NOT_FOUND			(14 | HIGH_BIT_SET)
-#define EFI_ACCESS_DENIED		(15 | HIGH_BIT_SET)
-#define EFI_NO_RESPONSE			(16 | HIGH_BIT_SET)
-#define EFI_NO_MAPPING			(17 | HIGH_BIT_SET)
-#define EFI_TIMEOUT			(18 | HIGH_BIT_SET)
-#define EFI_NOT_STARTED			(19 | HIGH_BIT_SET)
-#define EFI_ALREADY_STARTED		(20 | HIGH_BIT_SET)
-#define EFI_ABORTED			(21 | HIGH_BIT_SET)
-#define EFI_ICMP_ERROR			(22 | HIGH_BIT_SET)
-#define EFI_TFTP_ERROR			(23 | HIGH_BIT_SET)
-#define EFI_PROTOCOL_ERROR		(24 | HIGH_BIT_SET)
-#define EFI_INCOMPATIBLE_VERSION	(25 | HIGH_BIT_SET)
-#define EFI_SECURITY_VIOLATION		(26 | HIGH_BIT_SET)
-#define EFI_CRC_ERROR			(27 | HIGH_BIT_SET)
-#define EFI_END_OF_MEDIA		(28 | HIGH_BIT_SET)
-#define EFI_END_OF_FILE			(31 | HIGH_BIT_SET)
-#define EFI_INVALID_LANGUAGE		(32 | HIGH_BIT_SET)
-#define EFI_COMPROMISED_DATA		(33 | HIGH_BIT_SET)
-#define EFI_IP_ADDRESS_CONFLICT		(34 | HIGH_BIT_SET)
-#define EFI_HTTP_ERROR			(35 | HIGH_BIT_SET)
+#define UEFIOP_RUN_DIR		"/run/uefiop"
+#define UEFIOP_USERS_FILE	UEFIOP_RUN_DIR "/users"
+
+#define HASH64_SEED		0xcbf29ce484222325ULL
+
+/*
+ * The tools are also linked into the multi-call uefiop binary, where each
+ * tool's main() is renamed to <tool>_main().
+ */
+#ifdef UEFIOP_MULTICALL
+#define UEFIOP_MAIN(tool)	tool##_main
+#else
+#define UEFIOP_MAIN(tool)	main
+#endif
+
+/* the content of a file, see payload_load() */
+typedef struct {
+	uint8_t		*data;
+	size_t		size;
+	bool		mapped;
+} payload;
 
 typedef struct {
 	uint32_t	a;
@@ -81,13 +71,54 @@ typedef struct {
 } efi_guid;
 
 void print_status_info(const uint64_t status);
+void fprint_status_info(FILE *fp, const uint64_t status);
 void version(void);
-int init_driver(void);
-void deinit_driver(int fd);
+uefiop_ctx *init_driver(const char *backend);
+void deinit_driver(uefiop_ctx *ctx);
 int check_segment(const char *str, size_t len);
+/* a GUID, optionally in braces, or the name of a well known one */
 int string_to_guid(const char *str, efi_guid *guid);
-void str_to_ucs(uint16_t *des, const char *str, size_t len);
-void ucs_to_str(char *des, const uint16_t *str, size_t len);
+/* str holds 37 characters */
+void guid_to_string(const efi_guid *guid, char *str);
+/* the name of a well known vendor GUID, such as "global", or NULL */
+const char *guid_name(const efi_guid *guid);
+/* split "<guid>:<name>", as "global:BootOrder", returns 0 or -1 */
+int parse_var_spec(const char *spec, efi_guid *guid, const char **name);
+/* a number of bytes, optionally with a K, M or G suffix, returns 0 or -1 */
+int parse_size(const char *str, uint64_t *size);
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+/* dst holds 2 * len + 1 characters, returns the number of digits */
+size_t hex_encode(char *dst, const void *src, size_t len);
+/*
+ * Hex bytes, optionally separated by blanks or commas, to dst, which
+ * holds len / 2 bytes. Returns the number of bytes, or -1 for a character
+ * that is not a hex digit or an odd number of digits.
+ */
+ssize_t hex_decode(uint8_t *dst, const char *src, size_t len);
+/* hexdump -C style lines with offsets, returns UEFIOP_OK or UEFIOP_ERROR */
+int hexdump(FILE *fp, const void *data, size_t len);
+/*
+ * Load a file, or stdin for "-", mapping regular files in place of reading
+ * them. Returns UEFIOP_OK, or UEFIOP_ERROR with errno set.
+ */
+int payload_load(const char *path, payload *p);
+void payload_free(payload *p);
+/* write all of iov, which is updated, returns UEFIOP_OK or UEFIOP_ERROR */
+int write_iov(int fd, struct iovec *iov, int cnt);
+/* the number of characters of a NUL terminated UCS-2 string */
+size_t ucs2_len(const uint16_t *str);
+/*
+ * len bytes of UTF-8 to a NUL terminated UCS-2 string, dst holds len + 1
+ * characters. Returns the number of characters, or -1 if the text is not
+ * UTF-8 or has characters beyond the BMP.
+ */
+ssize_t utf8_to_ucs2(uint16_t *dst, const char *src, size_t len);
+/*
+ * len UCS-2 characters to NUL terminated UTF-8, dst holds 3 * len + 1
+ * bytes. Returns the number of bytes.
+ */
+size_t ucs2_to_utf8(char *dst, const uint16_t *src, size_t len);
 
 #endif /* _UEFIOP_UTILS_ */
 
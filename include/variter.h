@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_VARITER_H_
+#define _UEFIOP_VARITER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libuefiop.h"
+
+/*
+ * Streaming enumeration of the variables of a store. The iterator owns a
+ * single name buffer, grown to the longest name met, so a walk takes the
+ * same memory whatever the number of variables. The views it hands out
+ * are borrowed: they stay valid until the next call on the iterator.
+ */
+typedef struct {
+	const uint16_t	*name;
+	const EFI_GUID	*guid;
+	uint32_t	attr;	/* with VARITER_PROBE or a size match */
+	uint64_t	size;	/* with VARITER_PROBE or a size match */
+} variter_var;
+
+/* size each variable with a zero length GetVariable, no data is read */
+#define VARITER_PROBE	0x1
+
+typedef struct variter variter;
+
+/*
+ * A filter is called right after GetNextVariableName, before any
+ * GetVariable call, with only the name and GUID of the view set. The
+ * variables it returns false for are skipped.
+ */
+typedef bool (*variter_filter)(const variter_var *var, void *arg);
+
+/*
+ * What a variable must match to be returned, checked in two stages: the
+ * GUID and name right after GetNextVariableName, then, for the variables
+ * that pass, the attributes and size through a zero length GetVariable,
+ * so no payload is read for a variable that is skipped. The attributes
+ * and size of the view are set when the second stage ran.
+ */
+typedef struct {
+	const EFI_GUID	*guid;		/* NULL for any */
+	const char	*name;		/* fnmatch() glob, NULL for any */
+	uint32_t	attr;		/* attributes that must all be set */
+	uint64_t	min_size;
+	uint64_t	max_size;	/* 0 for no limit */
+} variter_match;
+
+/* returns NULL and sets errno on failure */
+variter *variter_new(uefiop_ctx *ctx, unsigned int flags);
+/* with a name buffer of name_size bytes to start with */
+variter *variter_new_size(uefiop_ctx *ctx, unsigned int flags,
+	uint64_t name_size);
+void variter_free(variter *it);
+void variter_set_filter(variter *it, variter_filter filter, void *arg);
+/* match is copied, the strings it points to must outlive the iterator */
+void variter_set_match(variter *it, const variter_match *match);
+/* whether the match has a size or attributes stage */
+bool variter_match_probes(const variter_match *match);
+
+/* carry on after name and guid, as for an interrupted walk */
+int variter_seek(variter *it, const uint16_t *name, const EFI_GUID *guid);
+
+/*
+ * Step to the next variable. Returns EFI_SUCCESS with *var set,
+ * EFI_NOT_FOUND past the last variable, or the EFI status of the call
+ * that failed, EFI_OUT_OF_RESOURCES if the name buffer could not grow.
+ * A variable deleted between the calls of a step is skipped.
+ */
+uint64_t variter_next(variter *it, const variter_var **var);
+
+/*
+ * The variable variter_next returned has been deleted since, e.g. a read
+ * of it gave EFI_NOT_FOUND: step back to the one before so the next call
+ * does not ask the firmware for the successor of an unknown name.
+ */
+void variter_drop(variter *it);
+
+/*
+ * Call cb for every variable the filter and match, if any, let through. A non zero
+ * return from cb stops the walk and is returned. Returns UEFIOP_ERROR with
+ * *status set when the enumeration fails, 0 once every variable was seen.
+ */
+typedef int (*variter_cb)(const variter_var *var, void *arg);
+
+int variter_walk(uefiop_ctx *ctx, unsigned int flags,
+	const variter_match *match, variter_filter filter, variter_cb cb,
+	void *arg, uint64_t *status);
+
+#endif /* _UEFIOP_VARITER_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#ifndef _UEFIOP_VARSTORE_H_
+#define _UEFIOP_VARSTORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "efi_runtime.h"
+
+/*
+ * A firmware variable store, as found in OVMF_VARS.fd and other NV
+ * firmware volume images, mapped from a file. Lookups are served from an
+ * index built when the store is opened and point straight into the
+ * mapping. Writes append a new record and retire the old one the way the
+ * firmware does, so the image stays readable by the firmware.
+ */
+typedef struct varstore varstore;
+
+typedef struct {
+	const uint16_t *name;	/* in the image, NUL terminated */
+	size_t name_size;	/* in bytes, terminator included */
+	const uint8_t *data;	/* in the image */
+	size_t data_size;
+	EFI_GUID guid;
+	uint32_t attr;
+	size_t offset;		/* of the record header in the image */
+	bool live;
+} varstore_var;
+
+/*
+ * Map the image at path and index its variables. A store opened read
+ * only refuses writes with EFI_WRITE_PROTECTED. Returns NULL and sets
+ * errno on failure, ENOEXEC if no variable store is found in the file.
+ */
+varstore *varstore_open(const char *path, bool writable);
+/* the same on an image in memory, buf must outlive the store */
+varstore *varstore_attach(void *buf, size_t size);
+void varstore_close(varstore *vs);
+bool varstore_authenticated(varstore *vs);
+
+/*
+ * The varstore_var pointers returned stay valid until the next
+ * varstore_set() on the store.
+ */
+const varstore_var *varstore_find(varstore *vs, const uint16_t *name,
+	const EFI_GUID *guid);
+const varstore_var *varstore_next(varstore *vs, const varstore_var *var);
+
+/* SetVariable() semantics, returns the EFI status */
+uint64_t varstore_set(varstore *vs, const uint16_t *name,
+	const EFI_GUID *guid, uint32_t attr, size_t size, const void *data);
+
+/*
+ * Squeeze out deleted and superseded records in place, returns the bytes
+ * reclaimed. A full store is also compacted by varstore_set().
+ */
+size_t varstore_compact(varstore *vs);
+
+/* sizes of the variable area, of what it holds and of the free tail */
+void varstore_usage(varstore *vs, size_t *total, size_t *used,
+	size_t *remaining);
+
+/* write an empty store of size bytes, a multiple of 4K, to buf */
+int varstore_format(void *buf, size_t size, bool auth);
+
+#endif /* _UEFIOP_VARSTORE_H_ */
@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "libuefiop.h"
+#include "backend.h"
+#include "utils.h"
+
+/*
+ *  Variables as files of efivarfs: one file named <name>-<guid> per
+ *  variable, holding the 32 bit attributes followed by the data. The same
+ *  layout in an ordinary directory works as well, which is handy for tests.
+ */
+
+#define EFIVARFS_PATH		"/sys/firmware/efi/efivars"
+#define EFIVARFS_MAGIC		0xde5e81e4
+#define GUID_STR_LEN		36
+#define ATTR_SIZE		sizeof(uint32_t)
+
+typedef struct {
+	uint16_t *name;
+	size_t name_size;	/* in bytes, terminator included */
+	efi_guid guid;
+} efivarfs_entry;
+
+typedef struct {
+	int dirfd;
+	bool efivarfs;		/* a mounted efivarfs, not a plain directory */
+	uint8_t *buf;		/* bounce buffer for attributes + data */
+	size_t buf_size;
+	efivarfs_entry *entries;	/* directory listing being enumerated */
+	size_t count;
+	size_t cursor;		/* entry returned last */
+} efivarfs_backend;
+
+static uint64_t errno_to_status(int err)
+{
+	switch (err) {
+	case ENOENT:
+		return EFI_NOT_FOUND;
+	case EINVAL:
+	case ENAMETOOLONG:
+		return EFI_INVALID_PARAMETER;
+	case ENOSPC:
+	case ENOMEM:
+		return EFI_OUT_OF_RESOURCES;
+	case EPERM:
+	case EACCES:
+	case EROFS:
+		return EFI_WRITE_PROTECTED;
+	case EOPNOTSUPP:
+		return EFI_UNSUPPORTED;
+	default:
+		return EFI_DEVICE_ERROR;
+	}
+}
+
+static int bounce_reserve(efivarfs_backend *be, size_t size)
+{
+	uint8_t *buf;
+
+	if (size <= be->buf_size)
+		return UEFIOP_OK;
+	buf = realloc(be->buf, size);
+	if (!buf)
+		return UEFIOP_ERROR;
+	be->buf = buf;
+	be->buf_size = size;
+
+	return UEFIOP_OK;
+}
+
+/* build "<name>-<guid>", with the name in UTF-8 as efivarfs has it */
+static int var_file_name(
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	char *file,
+	size_t len)
+{
+	char utf8[3 * NAME_MAX + 1];
+	size_t units = ucs2_len(name);
+	efi_guid g;
+	size_t i;
+
+	if (units == 0 || units > NAME_MAX)
+		return UEFIOP_ERROR;
+	i = ucs2_to_utf8(utf8, name, units);
+	if (i + GUID_STR_LEN + 2 > len || memchr(utf8, '/', i))
+		return UEFIOP_ERROR;
+	memcpy(file, utf8, i);
+	file[i++] = '-';
+	memcpy(&g, guid, sizeof(g));
+	guid_to_string(&g, file + i);
+
+	return UEFIOP_OK;
+}
+
+static bool entry_is(const efivarfs_entry *e, const uint16_t *name,
+	size_t name_size, const EFI_GUID *guid)
+{
+	return e->name_size == name_size &&
+		!memcmp(e->name, name, name_size) &&
+		!memcmp(&e->guid, guid, sizeof(*guid));
+}
+
+static bool set_immutable(int fd, bool on)
+{
+	int flags, was;
+
+	if (ioctl(fd, FS_IOC_GETFLAGS, &flags))
+		return false;
+	was = flags & FS_IMMUTABLE_FL;
+	if (on)
+		flags |= FS_IMMUTABLE_FL;
+	else
+		flags &= ~FS_IMMUTABLE_FL;
+	if (!!was != on)
+		(void)ioctl(fd, FS_IOC_SETFLAGS, &flags);
+
+	return was;
+}
+
+static void free_entries(efivarfs_backend *be)
+{
+	size_t i;
+
+	for (i = 0; i < be->count; i++)
+		free(be->entries[i].name);
+	free(be->entries);
+	be->entries = NULL;
+	be->count = 0;
+	be->cursor = 0;
+}
+
+static int load_entries(efivarfs_backend *be)
+{
+	struct dirent *de;
+	size_t cap = 0;
+	DIR *dir;
+	int fd;
+
+	free_entries(be);
+
+	fd = openat(be->dirfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1 || (dir = fdopendir(fd)) == NULL) {
+		if (fd != -1)
+			close(fd);
+		return UEFIOP_ERROR;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		size_t len = strlen(de->d_name);
+		efivarfs_entry *e;
+		ssize_t n;
+
+		if (len < GUID_STR_LEN + 2 ||
+		    de->d_name[len - GUID_STR_LEN - 1] != '-')
+			continue;
+
+		if (be->count == cap) {
+			cap = cap ? cap * 2 : 64;
+			e = realloc(be->entries, cap * sizeof(*e));
+			if (!e)
+				goto error;
+			be->entries = e;
+		}
+		e = &be->entries[be->count];
+		if (string_to_guid(de->d_name + len - GUID_STR_LEN, &e->guid))
+			continue;
+		len -= GUID_STR_LEN + 1;
+		e->name = malloc((len + 1) * sizeof(uint16_t));
+		if (!e->name)
+			goto error;
+		n = utf8_to_ucs2(e->name, de->d_name, len);
+		if (n < 0) {
+			/* not a name a variable can have */
+			free(e->name);
+			continue;
+		}
+		e->name_size = (n + 1) * sizeof(uint16_t);
+		be->count++;
+	}
+	closedir(dir);
+
+	return UEFIOP_OK;
+
+error:
+	closedir(dir);
+	free_entries(be);
+	return UEFIOP_ERROR;
+}
+
+static void *efivarfs_open(const char *path)
+{
+	efivarfs_backend *be;
+	struct statfs sfs;
+
+	be = calloc(1, sizeof(*be));
+	if (!be)
+		return NULL;
+
+	be->dirfd = open(path ? path : EFIVARFS_PATH,
+		O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (be->dirfd == -1) {
+		int err = errno;
+
+		free(be);
+		errno = err;
+		return NULL;
+	}
+	if (!fstatfs(be->dirfd, &sfs) && sfs.f_type == EFIVARFS_MAGIC)
+		be->efivarfs = true;
+
+	/* the default path only counts when efivarfs is mounted there */
+	if (!path && !be->efivarfs) {
+		close(be->dirfd);
+		free(be);
+		errno = ENODEV;
+		return NULL;
+	}
+
+	return be;
+}
+
+static void efivarfs_close(void *priv)
+{
+	efivarfs_backend *be = priv;
+
+	free_entries(be);
+	free(be->buf);
+	close(be->dirfd);
+	free(be);
+}
+
+static uint64_t efivarfs_get_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t *attr,
+	uint64_t *size,
+	void *data)
+{
+	efivarfs_backend *be = priv;
+	char file[NAME_MAX + 1];
+	struct stat statbuf;
+	uint64_t status = EFI_SUCCESS;
+	ssize_t n;
+	int fd;
+
+	if (var_file_name(name, guid, file, sizeof(file)))
+		return EFI_INVALID_PARAMETER;
+
+	fd = openat(be->dirfd, file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return errno_to_status(errno);
+	if (fstat(fd, &statbuf)) {
+		status = errno_to_status(errno);
+		goto out;
+	}
+
+	/*
+	 *  A size probe, or a buffer the data cannot fit in, only needs the
+	 *  attributes: the size comes from the stat(), no payload is copied.
+	 */
+	if (statbuf.st_size >= (off_t)ATTR_SIZE &&
+	    (!data || *size < (uint64_t)statbuf.st_size - ATTR_SIZE)) {
+		n = pread(fd, attr, ATTR_SIZE, 0);
+		if (n != ATTR_SIZE) {
+			status = n < 0 ? errno_to_status(errno) :
+				EFI_DEVICE_ERROR;
+			goto out;
+		}
+		*size = statbuf.st_size - ATTR_SIZE;
+		if (*size)
+			status = EFI_BUFFER_TOO_SMALL;
+		goto out;
+	}
+
+	/*
+	 *  efivarfs fetches the whole variable from the firmware on every
+	 *  read(), so read attributes and data in one go, with room to spare
+	 *  in case the variable grew since the stat().
+	 */
+	for (;;) {
+		size_t want = statbuf.st_size + 4096;
+
+		if (bounce_reserve(be, want)) {
+			status = EFI_OUT_OF_RESOURCES;
+			goto out;
+		}
+		n = pread(fd, be->buf, be->buf_size, 0);
+		if (n < 0) {
+			status = errno_to_status(errno);
+			goto out;
+		}
+		if ((size_t)n < be->buf_size)
+			break;
+		statbuf.st_size = be->buf_size * 2;
+	}
+	if ((size_t)n < ATTR_SIZE) {
+		status = EFI_DEVICE_ERROR;
+		goto out;
+	}
+
+	memcpy(attr, be->buf, ATTR_SIZE);
+	if (*size < n - ATTR_SIZE || (!data && n > (ssize_t)ATTR_SIZE)) {
+		*size = n - ATTR_SIZE;
+		status = EFI_BUFFER_TOO_SMALL;
+		goto out;
+	}
+	*size = n - ATTR_SIZE;
+	if (*size)
+		memcpy(data, be->buf + ATTR_SIZE, *size);
+
+out:
+	close(fd);
+	return status;
+}
+
+static uint64_t efivarfs_delete(efivarfs_backend *be, const char *file)
+{
+	int fd;
+
+	fd = openat(be->dirfd, file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return errno_to_status(errno);
+	set_immutable(fd, false);
+	close(fd);
+
+	if (unlinkat(be->dirfd, file, 0))
+		return errno_to_status(errno);
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t efivarfs_set_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	uint64_t size,
+	const void *data)
+{
+	efivarfs_backend *be = priv;
+	char file[NAME_MAX + 1];
+	bool append = attr & EFI_VARIABLE_APPEND_WRITE;
+	bool immutable = false;
+	int fd, flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	uint8_t *buf;
+	size_t len;
+	ssize_t n;
+
+	if (var_file_name(name, guid, file, sizeof(file)))
+		return EFI_INVALID_PARAMETER;
+
+	if (size == 0 && !append)
+		return efivarfs_delete(be, file);
+
+	/* efivarfs files of non-standard variables are immutable */
+	fd = openat(be->dirfd, file, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		immutable = set_immutable(fd, false);
+		close(fd);
+	}
+
+	if (bounce_reserve(be, ATTR_SIZE + size))
+		return EFI_OUT_OF_RESOURCES;
+	buf = be->buf;
+	memcpy(buf, &attr, ATTR_SIZE);
+	memcpy(buf + ATTR_SIZE, data, size);
+	len = ATTR_SIZE + size;
+
+	/*
+	 *  efivarfs takes the attributes, APPEND_WRITE included, and the data
+	 *  in one single write(). In a plain directory the file content is
+	 *  the variable, so emulate overwrite and append on the file itself.
+	 */
+	if (!be->efivarfs) {
+		if (!append) {
+			flags |= O_TRUNC;
+		} else if (!faccessat(be->dirfd, file, F_OK, 0)) {
+			flags |= O_APPEND;
+			buf += ATTR_SIZE;
+			len -= ATTR_SIZE;
+		} else {
+			attr &= ~EFI_VARIABLE_APPEND_WRITE;
+			memcpy(buf, &attr, ATTR_SIZE);
+		}
+	}
+
+	fd = openat(be->dirfd, file, flags, 0644);
+	if (fd == -1)
+		return errno_to_status(errno);
+
+	n = write(fd, buf, len);
+	if (n < 0) {
+		int err = errno;
+
+		close(fd);
+		return errno_to_status(err);
+	}
+	if (immutable)
+		set_immutable(fd, true);
+	close(fd);
+
+	return (size_t)n == len ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+static uint64_t efivarfs_get_next_variable_name(
+	void *priv,
+	uint64_t *size,
+	uint16_t *name,
+	EFI_GUID *guid)
+{
+	efivarfs_backend *be = priv;
+	efivarfs_entry *e;
+	size_t next, size_in;
+
+	if (name[0] == 0) {
+		/* a new walk, take a fresh listing of the directory */
+		if (load_entries(be))
+			return EFI_DEVICE_ERROR;
+		next = 0;
+	} else {
+		/* normally the caller passes back the entry returned last */
+		size_in = (ucs2_len(name) + 1) * sizeof(uint16_t);
+		next = be->cursor;
+		if (next >= be->count ||
+		    !entry_is(&be->entries[next], name, size_in, guid)) {
+			for (next = 0; next < be->count; next++) {
+				if (entry_is(&be->entries[next], name, size_in,
+						guid))
+					break;
+			}
+			if (next == be->count)
+				return EFI_INVALID_PARAMETER;
+		}
+		next++;
+	}
+
+	if (next >= be->count)
+		return EFI_NOT_FOUND;
+
+	e = &be->entries[next];
+	if (*size < e->name_size) {
+		*size = e->name_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = e->name_size;
+	memcpy(name, e->name, e->name_size);
+	memcpy(guid, &e->guid, sizeof(*guid));
+	be->cursor = next;
+
+	return EFI_SUCCESS;
+}
+
+/*
+ *  efivarfs reports the variable storage through statfs(). The largest
+ *  single variable is not exposed, so the remaining space is reported.
+ */
+static uint64_t efivarfs_query_variable_info(
+	void *priv,
+	uint32_t attr,
+	uint64_t *max_storage,
+	uint64_t *remaining,
+	uint64_t *max_size)
+{
+	efivarfs_backend *be = priv;
+	struct statfs sfs;
+
+	(void)attr;	/* one storage for every kind of variable */
+	if (fstatfs(be->dirfd, &sfs))
+		return errno_to_status(errno);
+
+	*max_storage = (uint64_t)sfs.f_blocks * sfs.f_bsize;
+	*remaining = (uint64_t)sfs.f_bfree * sfs.f_bsize;
+	*max_size = *remaining;
+
+	return EFI_SUCCESS;
+}
+
+const uefiop_backend_ops uefiop_efivarfs_backend = {
+	.name = "efivarfs",
+	.open = efivarfs_open,
+	.close = efivarfs_close,
+	.get_variable = efivarfs_get_variable,
+	.set_variable = efivarfs_set_variable,
+	.get_next_variable_name = efivarfs_get_next_variable_name,
+	.query_variable_info = efivarfs_query_variable_info,
+};
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libuefiop.h"
+#include "backend.h"
+#include "varstore.h"
+
+/*
+ *  Variables of a firmware variable store image, e.g. the OVMF_VARS.fd of
+ *  a virtual machine, edited in place without booting it.
+ */
+
+static void *image_open(const char *path)
+{
+	varstore *vs;
+
+	if (!path) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	vs = varstore_open(path, true);
+	if (!vs && (errno == EACCES || errno == EROFS || errno == EPERM))
+		vs = varstore_open(path, false);
+
+	return vs;
+}
+
+static void image_close(void *priv)
+{
+	varstore_close(priv);
+}
+
+static uint64_t image_get_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t *attr,
+	uint64_t *size,
+	void *data)
+{
+	const varstore_var *var;
+
+	var = varstore_find(priv, name, guid);
+	if (!var)
+		return EFI_NOT_FOUND;
+
+	*attr = var->attr;
+	if (*size < var->data_size || (!data && var->data_size)) {
+		*size = var->data_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = var->data_size;
+	if (var->data_size)
+		memcpy(data, var->data, var->data_size);
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t image_set_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	uint64_t size,
+	const void *data)
+{
+	return varstore_set(priv, name, guid, attr, size, data);
+}
+
+static uint64_t image_get_next_variable_name(
+	void *priv,
+	uint64_t *size,
+	uint16_t *name,
+	EFI_GUID *guid)
+{
+	const varstore_var *var = NULL;
+
+	if (name[0]) {
+		var = varstore_find(priv, name, guid);
+		if (!var)
+			return EFI_INVALID_PARAMETER;
+	}
+
+	var = varstore_next(priv, var);
+	if (!var)
+		return EFI_NOT_FOUND;
+
+	if (*size < var->name_size) {
+		*size = var->name_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = var->name_size;
+	memcpy(name, var->name, var->name_size);
+	memcpy(guid, &var->guid, sizeof(*guid));
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t image_query_variable_info(
+	void *priv,
+	uint32_t attr,
+	uint64_t *max_storage,
+	uint64_t *remaining,
+	uint64_t *max_size)
+{
+	size_t total, used, free;
+
+	(void)attr;	/* one storage for every kind of variable */
+	varstore_usage(priv, &total, &used, &free);
+	*max_storage = total;
+	*remaining = free;
+	*max_size = free;
+
+	return EFI_SUCCESS;
+}
+
+const uefiop_backend_ops uefiop_image_backend = {
+	.name = "image",
+	.open = image_open,
+	.close = image_close,
+	.get_variable = image_get_variable,
+	.set_variable = image_set_variable,
+	.get_next_variable_name = image_get_next_variable_name,
+	.query_variable_info = image_query_variable_info,
+};
@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2016-2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/module.h>
+
+#include "libuefiop.h"
+#include "backend.h"
+#include "utils.h"
+
+static int check_device(const char *devname)
+{
+	struct stat statbuf;
+
+	if (stat(devname, &statbuf))
+		return UEFIOP_ERROR;
+
+	if (S_ISCHR(statbuf.st_mode))
+		return UEFIOP_OK;
+
+	return UEFIOP_ERROR;
+}
+
+static int check_module_loaded_procfs(
+	const char *module,
+	bool *loaded)
+{
+	FILE *fp;
+	size_t len = strlen(module);
+
+	if ((fp = fopen("/proc/modules", "r")) != NULL) {
+		char buffer[1024];
+
+		while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+			if (!strncmp(buffer, module, len) && buffer[len] == ' ') {
+				*loaded = true;
+				break;
+			}
+		}
+		(void)fclose(fp);
+		return UEFIOP_OK;
+	}
+
+	/* errno is left as fopen() set it */
+	return UEFIOP_ERROR;
+}
+
+/*
+ *  Every loaded module owns a /sys/module/<name> directory, so a single
+ *  stat() answers the question without reading /proc/modules. The procfs
+ *  scan is only kept for systems without sysfs mounted.
+ */
+static int check_module_loaded(
+	const char *module,
+	bool *loaded)
+{
+	char path[PATH_MAX];
+	struct stat statbuf;
+
+	*loaded = false;
+
+	if (stat("/sys/module", &statbuf))
+		return check_module_loaded_procfs(module, loaded);
+
+	snprintf(path, sizeof(path), "/sys/module/%s", module);
+	if (!stat(path, &statbuf) && S_ISDIR(statbuf.st_mode))
+		*loaded = true;
+
+	return UEFIOP_OK;
+}
+
+
+/* EBUSY when the module is loaded, but without its device */
+static int check_module_loaded_no_dev(char *module)
+{
+	bool loaded;
+
+	if (check_module_loaded(module, &loaded) != UEFIOP_OK)
+		return UEFIOP_OK;
+	if (loaded) {
+		errno = EBUSY;
+		return UEFIOP_ERROR;
+	}
+	return UEFIOP_OK;
+}
+
+static int uefiop_exec(char *const argv[])
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	switch (pid) {
+	case -1:
+		/* Ooops */
+		return UEFIOP_ERROR;
+	case 0:
+		/* Child */
+		execvp(argv[0], argv);
+		_exit(127);
+	default:
+		/* Parent */
+		if (waitpid(pid, &status, 0) != pid)
+			return UEFIOP_ERROR;
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			return UEFIOP_ERROR;
+		return UEFIOP_OK;
+	}
+}
+
+static bool module_name_match(const char *file, const char *module)
+{
+	/* module file names may use '-' where the module name uses '_' */
+	for (; *module; file++, module++) {
+		if (*file == *module)
+			continue;
+		if ((*file == '-' || *file == '_') && *module == '_')
+			continue;
+		return false;
+	}
+	return !strncmp(file, ".ko", 3) && (file[3] == '\0' || file[3] == '.');
+}
+
+/*
+ *  Look up the module in modules.dep. Only modules without dependencies
+ *  are resolved, anything else is left to modprobe.
+ */
+static int find_module_path(
+	const char *module,
+	char *path,
+	size_t len)
+{
+	struct utsname uts;
+	char line[PATH_MAX + 256];
+	FILE *fp;
+	int n, ret = UEFIOP_ERROR;
+
+	if (uname(&uts))
+		return UEFIOP_ERROR;
+
+	snprintf(line, sizeof(line), "/lib/modules/%s/modules.dep", uts.release);
+	if ((fp = fopen(line, "r")) == NULL)
+		return UEFIOP_ERROR;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *colon, *base;
+
+		if ((colon = strchr(line, ':')) == NULL)
+			continue;
+		*colon = '\0';
+		base = strrchr(line, '/');
+		base = base ? base + 1 : line;
+		if (!module_name_match(base, module))
+			continue;
+		if (strspn(colon + 1, " \t\n") != strlen(colon + 1))
+			break;
+		if (line[0] == '/')
+			n = snprintf(path, len, "%s", line);
+		else
+			n = snprintf(path, len, "/lib/modules/%s/%s", uts.release, line);
+		if (n >= 0 && (size_t)n < len)
+			ret = UEFIOP_OK;
+		break;
+	}
+	(void)fclose(fp);
+
+	return ret;
+}
+
+static int kernel_load_module(const char *module)
+{
+	char path[PATH_MAX];
+	const char *ext;
+	int modfd, flags = 0, ret;
+
+	if (find_module_path(module, path, sizeof(path)) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+
+	/* let the kernel decompress .ko.xz/.ko.gz/.ko.zst itself */
+	ext = strstr(path, ".ko");
+	if (ext && ext[3] == '.')
+		flags |= MODULE_INIT_COMPRESSED_FILE;
+
+	modfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (modfd < 0)
+		return UEFIOP_ERROR;
+
+	ret = syscall(SYS_finit_module, modfd, "", flags);
+	if (ret && errno == EEXIST)
+		ret = 0;
+	close(modfd);
+
+	return ret ? UEFIOP_ERROR : UEFIOP_OK;
+}
+
+static int load_module(
+	char *module,
+	const char *devname)
+{
+	char *argv[] = { "modprobe", module, NULL };
+	bool loaded;
+
+	if (kernel_load_module(module) != UEFIOP_OK &&
+	    uefiop_exec(argv) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+
+	if (check_module_loaded(module, &loaded) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+
+	if (!loaded)
+		return UEFIOP_ERROR;
+
+	if (check_device(devname) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+
+	return UEFIOP_OK;
+}
+
+
+/*
+ *  Find the efi runtime device, loading a module for it if needed. On
+ *  success *devname is the device and *module the module that was loaded,
+ *  or NULL if the device was already there.
+ */
+static int lib_load_module(const char **devname, char **module)
+{
+	*module = NULL;
+
+	/* Check if dev is already available */
+	*devname = "/dev/efi_runtime";
+	if (check_device(*devname) == UEFIOP_OK)
+		return UEFIOP_OK;
+	*devname = "/dev/efi_test";
+	if (check_device(*devname) == UEFIOP_OK)
+		return UEFIOP_OK;
+
+	/* Since the devices can't be found, the module should be not loaded */
+	if (check_module_loaded_no_dev("efi_runtime") != UEFIOP_OK)
+		return UEFIOP_ERROR;
+	if (check_module_loaded_no_dev("efi_test") != UEFIOP_OK)
+		return UEFIOP_ERROR;
+
+	/* Now try to load the module */
+
+	*devname = "/dev/efi_runtime";
+	*module = "efi_runtime";
+	if (load_module(*module, *devname) == UEFIOP_OK)
+		return UEFIOP_OK;
+	*devname = "/dev/efi_test";
+	*module = "efi_test";
+	if (load_module(*module, *devname) == UEFIOP_OK)
+		return UEFIOP_OK;
+
+	*devname = NULL;
+	*module = NULL;
+	errno = ENODEV;
+
+	return UEFIOP_ERROR;
+}
+
+static int lib_unload_module(char *tmp_name)
+{
+	bool loaded;
+	char *argv[] = { "modprobe", "-r", tmp_name, NULL };
+
+	/* No module, not much to do */
+	if (!tmp_name)
+		return UEFIOP_OK;
+
+	/* If it is not loaded, no need to unload it */
+	if (check_module_loaded(tmp_name, &loaded) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+	if (!loaded)
+		return UEFIOP_OK;
+
+	if (syscall(SYS_delete_module, tmp_name, O_NONBLOCK) &&
+	    uefiop_exec(argv) != UEFIOP_OK) {
+		errno = EBUSY;
+		return UEFIOP_ERROR;
+	}
+
+	/* Module should not be loaded at this point */
+	if (check_module_loaded(tmp_name, &loaded) != UEFIOP_OK)
+		return UEFIOP_ERROR;
+	if (loaded) {
+		errno = EBUSY;
+		return UEFIOP_ERROR;
+	}
+
+	return UEFIOP_OK;
+}
+
+/*
+ *  Users of the efi runtime module are tracked across processes in
+ *  UEFIOP_USERS_FILE, serialised with flock(). The first line names the
+ *  module that uefiop loaded itself ("-" when it was already there), the
+ *  following lines hold the pid of every active user. Pids of processes
+ *  that died without calling deinit_driver() are dropped on the next
+ *  access, so a crashed tool cannot pin the module forever.
+ */
+typedef struct {
+	int lockfd;
+	char *owner;
+	pid_t *pids;
+	size_t count;
+} driver_users;
+
+static bool keep_module(void)
+{
+	const char *env = getenv("UEFIOP_KEEP_MODULE");
+
+	return env && *env && strcmp(env, "0");
+}
+
+static char *known_module(const char *name)
+{
+	if (!strcmp(name, "efi_runtime"))
+		return "efi_runtime";
+	if (!strcmp(name, "efi_test"))
+		return "efi_test";
+	return NULL;
+}
+
+static int users_lock(driver_users *users)
+{
+	struct stat statbuf;
+	char *buf, *line, *saveptr;
+	ssize_t len;
+
+	users->owner = NULL;
+	users->pids = NULL;
+	users->count = 0;
+
+	(void)mkdir(UEFIOP_RUN_DIR, 0755);
+	users->lockfd = open(UEFIOP_USERS_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (users->lockfd == -1)
+		return UEFIOP_ERROR;
+
+	if (flock(users->lockfd, LOCK_EX) || fstat(users->lockfd, &statbuf))
+		goto error;
+
+	buf = malloc(statbuf.st_size + 1);
+	users->pids = malloc((statbuf.st_size / 2 + 1) * sizeof(pid_t));
+	if (!buf || !users->pids) {
+		free(buf);
+		goto error;
+	}
+
+	len = pread(users->lockfd, buf, statbuf.st_size, 0);
+	buf[len > 0 ? len : 0] = '\0';
+
+	line = strtok_r(buf, "\n", &saveptr);
+	if (line)
+		users->owner = known_module(line);
+	while ((line = strtok_r(NULL, "\n", &saveptr)) != NULL) {
+		pid_t pid = (pid_t)strtol(line, NULL, 10);
+
+		if (pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH))
+			users->pids[users->count++] = pid;
+	}
+	free(buf);
+
+	return UEFIOP_OK;
+
+error:
+	close(users->lockfd);
+	users->lockfd = -1;
+	free(users->pids);
+	users->pids = NULL;
+	return UEFIOP_ERROR;
+}
+
+static void users_unlock(driver_users *users)
+{
+	FILE *fp;
+	size_t i;
+
+	if (users->lockfd == -1)
+		return;
+
+	if (ftruncate(users->lockfd, 0) == 0 &&
+	    (fp = fdopen(dup(users->lockfd), "w")) != NULL) {
+		fprintf(fp, "%s\n", users->owner ? users->owner : "-");
+		for (i = 0; i < users->count; i++)
+			fprintf(fp, "%d\n", users->pids[i]);
+		fclose(fp);
+	}
+
+	/* closing the last descriptor drops the lock */
+	close(users->lockfd);
+	users->lockfd = -1;
+	free(users->pids);
+	users->pids = NULL;
+}
+
+static void users_add(driver_users *users, pid_t pid)
+{
+	pid_t *pids = realloc(users->pids, (users->count + 1) * sizeof(pid_t));
+
+	if (!pids)
+		return;
+	users->pids = pids;
+	users->pids[users->count++] = pid;
+}
+
+static void users_remove(driver_users *users, pid_t pid)
+{
+	size_t i;
+
+	for (i = 0; i < users->count; i++) {
+		if (users->pids[i] == pid) {
+			users->pids[i] = users->pids[--users->count];
+			return;
+		}
+	}
+}
+
+typedef struct {
+	int fd;
+	char *module;		/* loaded by this backend, when not tracked */
+	bool registered;	/* listed in UEFIOP_USERS_FILE */
+} ioctl_backend;
+
+static void release_module(ioctl_backend *be)
+{
+	driver_users users;
+
+	if (!be->registered) {
+		lib_unload_module(be->module);
+		be->module = NULL;
+		return;
+	}
+	be->registered = false;
+
+	if (users_lock(&users) != UEFIOP_OK)
+		return;
+
+	users_remove(&users, getpid());
+	if (users.count == 0 && users.owner && !keep_module()) {
+		lib_unload_module(users.owner);
+		users.owner = NULL;
+	}
+	users_unlock(&users);
+}
+
+/*
+ *  Open the efi runtime device at devname, or find it (loading a module
+ *  for it if needed) when devname is NULL.
+ */
+static void *ioctl_open(const char *devname)
+{
+	ioctl_backend *be;
+	driver_users users;
+	char *module;
+	int err;
+
+	be = calloc(1, sizeof(*be));
+	if (!be)
+		return NULL;
+	be->fd = -1;
+
+	if (devname) {
+		if (check_device(devname) != UEFIOP_OK) {
+			err = ENODEV;
+			goto error;
+		}
+	} else {
+		/* without a users file fall back to per-process load/unload */
+		users_lock(&users);
+
+		if (lib_load_module(&devname, &module) != UEFIOP_OK) {
+			err = errno == EBUSY ? EBUSY : ENODEV;
+			users_unlock(&users);
+			goto error;
+		}
+
+		if (users.lockfd != -1) {
+			/* the module belongs to all users, the last one unloads it */
+			if (module && !keep_module())
+				users.owner = module;
+			users_add(&users, getpid());
+			be->registered = true;
+		} else if (!keep_module()) {
+			be->module = module;
+		}
+		users_unlock(&users);
+	}
+
+	be->fd = open(devname, O_RDWR | O_CLOEXEC);
+	if (be->fd == -1) {
+		err = errno;
+		goto error;
+	}
+
+	return be;
+
+error:
+	release_module(be);
+	free(be);
+	errno = err;
+
+	return NULL;
+}
+
+static void ioctl_close(void *priv)
+{
+	ioctl_backend *be = priv;
+
+	close(be->fd);
+	release_module(be);
+	free(be);
+}
+
+/*
+ *  The driver fills in the EFI status even when the ioctl itself fails,
+ *  so a status that is never written means the call did not reach the
+ *  firmware at all.
+ */
+static uint64_t be_ioctl(void *priv, unsigned long request, void *arg,
+	uint64_t *status)
+{
+	ioctl_backend *be = priv;
+
+	*status = EFI_DEVICE_ERROR;
+	ioctl(be->fd, request, arg);
+
+	return *status;
+}
+
+static uint64_t ioctl_get_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t *attr,
+	uint64_t *size,
+	void *data)
+{
+	uint64_t status;
+	struct efi_getvariable getvariable;
+
+	getvariable.VariableName = (uint16_t *)name;
+	getvariable.VendorGuid = (EFI_GUID *)guid;
+	getvariable.Attributes = attr;
+	getvariable.DataSize = size;
+	getvariable.Data = data;
+	getvariable.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_GET_VARIABLE, &getvariable, &status);
+}
+
+static uint64_t ioctl_set_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	uint64_t size,
+	const void *data)
+{
+	uint64_t status;
+	struct efi_setvariable setvariable;
+
+	setvariable.VariableName = (uint16_t *)name;
+	setvariable.VendorGuid = (EFI_GUID *)guid;
+	setvariable.Attributes = attr;
+	setvariable.DataSize = size;
+	setvariable.Data = (void *)data;
+	setvariable.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_SET_VARIABLE, &setvariable, &status);
+}
+
+static uint64_t ioctl_get_next_variable_name(
+	void *priv,
+	uint64_t *size,
+	uint16_t *name,
+	EFI_GUID *guid)
+{
+	uint64_t status;
+	struct efi_getnextvariablename getnextvariablename;
+
+	getnextvariablename.VariableNameSize = size;
+	getnextvariablename.VariableName = name;
+	getnextvariablename.VendorGuid = guid;
+	getnextvariablename.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_GET_NEXTVARIABLENAME,
+		&getnextvariablename, &status);
+}
+
+static uint64_t ioctl_query_variable_info(
+	void *priv,
+	uint32_t attr,
+	uint64_t *max_storage,
+	uint64_t *remaining,
+	uint64_t *max_size)
+{
+	uint64_t status;
+	struct efi_queryvariableinfo queryvariableinfo;
+
+	queryvariableinfo.Attributes = attr;
+	queryvariableinfo.MaximumVariableStorageSize = max_storage;
+	queryvariableinfo.RemainingVariableStorageSize = remaining;
+	queryvariableinfo.MaximumVariableSize = max_size;
+	queryvariableinfo.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_QUERY_VARIABLEINFO,
+		&queryvariableinfo, &status);
+}
+
+static uint64_t ioctl_get_time(
+	void *priv,
+	EFI_TIME *time,
+	EFI_TIME_CAPABILITIES *cap)
+{
+	uint64_t status;
+	struct efi_gettime gettime;
+
+	gettime.Time = time;
+	gettime.Capabilities = cap;
+	gettime.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_GET_TIME, &gettime, &status);
+}
+
+static uint64_t ioctl_set_time(
+	void *priv,
+	EFI_TIME *time)
+{
+	uint64_t status;
+	struct efi_settime settime;
+
+	settime.Time = time;
+	settime.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_SET_TIME, &settime, &status);
+}
+
+static uint64_t ioctl_get_wakeup_time(
+	void *priv,
+	uint8_t *enabled,
+	uint8_t *pending,
+	EFI_TIME *time)
+{
+	uint64_t status;
+	struct efi_getwakeuptime getwakeuptime;
+
+	getwakeuptime.Enabled = enabled;
+	getwakeuptime.Pending = pending;
+	getwakeuptime.Time = time;
+	getwakeuptime.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_GET_WAKETIME, &getwakeuptime, &status);
+}
+
+static uint64_t ioctl_set_wakeup_time(
+	void *priv,
+	uint8_t enabled,
+	EFI_TIME *time)
+{
+	uint64_t status;
+	struct efi_setwakeuptime setwakeuptime;
+
+	setwakeuptime.Enabled = enabled;
+	setwakeuptime.Time = time;
+	setwakeuptime.status = &status;
+
+	return be_ioctl(priv, EFI_RUNTIME_SET_WAKETIME, &setwakeuptime, &status);
+}
+
+static void ioctl_reset_system(
+	void *priv,
+	int type,
+	uint64_t status,
+	uint64_t size,
+	void *data)
+{
+	ioctl_backend *be = priv;
+	struct efi_resetsystem resetsystem;
+
+	resetsystem.reset_type = type;
+	resetsystem.status = status;
+	resetsystem.data_size = size;
+	resetsystem.data = data;
+
+	ioctl(be->fd, EFI_RUNTIME_RESET_SYSTEM, &resetsystem);
+}
+
+const uefiop_backend_ops uefiop_ioctl_backend = {
+	.name = "ioctl",
+	.open = ioctl_open,
+	.close = ioctl_close,
+	.get_variable = ioctl_get_variable,
+	.set_variable = ioctl_set_variable,
+	.get_next_variable_name = ioctl_get_next_variable_name,
+	.query_variable_info = ioctl_query_variable_info,
+	.get_time = ioctl_get_time,
+	.set_time = ioctl_set_time,
+	.get_wakeup_time = ioctl_get_wakeup_time,
+	.set_wakeup_time = ioctl_set_wakeup_time,
+	.reset_system = ioctl_reset_system,
+};
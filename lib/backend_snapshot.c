@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libuefiop.h"
+#include "backend.h"
+#include "snapshot.h"
+
+/*
+ *  Variables of a snapshot file, read only. Walking the variables returns
+ *  them in the order of the snapshot index.
+ */
+
+static void *snapshot_backend_open(const char *path)
+{
+	if (!path) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snapshot_open(path);
+}
+
+static void snapshot_backend_close(void *priv)
+{
+	snapshot_close(priv);
+}
+
+static uint64_t snapshot_get_variable(
+	void *priv,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t *attr,
+	uint64_t *size,
+	void *data)
+{
+	const snapshot_entry *e;
+
+	e = snapshot_find(priv, name, guid);
+	if (!e)
+		return EFI_NOT_FOUND;
+
+	*attr = e->attr;
+	if (*size < e->data_size || (!data && e->data_size)) {
+		*size = e->data_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = e->data_size;
+	if (e->data_size)
+		memcpy(data, snapshot_data(priv, e), e->data_size);
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t snapshot_get_next_variable_name(
+	void *priv,
+	uint64_t *size,
+	uint16_t *name,
+	EFI_GUID *guid)
+{
+	const snapshot_entry *e = snapshot_entries(priv);
+	size_t next = 0;
+
+	if (name[0]) {
+		const snapshot_entry *cur = snapshot_find(priv, name, guid);
+
+		if (!cur)
+			return EFI_INVALID_PARAMETER;
+		next = cur - e + 1;
+	}
+	if (next >= snapshot_count(priv))
+		return EFI_NOT_FOUND;
+
+	e += next;
+	if (*size < e->name_size) {
+		*size = e->name_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = e->name_size;
+	memcpy(name, snapshot_name(priv, e), e->name_size);
+	memcpy(guid, &e->guid, sizeof(*guid));
+
+	return EFI_SUCCESS;
+}
+
+const uefiop_backend_ops uefiop_snapshot_backend = {
+	.name = "snapshot",
+	.open = snapshot_backend_open,
+	.close = snapshot_backend_close,
+	.get_variable = snapshot_get_variable,
+	.get_next_variable_name = snapshot_get_next_variable_name,
+};
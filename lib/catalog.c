@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "uefiop.h"
+#include "catalog.h"
+#include "utils.h"
+
+#define NAME_SIZE	1024
+#define MAX_GUIDS	65536
+#define MAX_NAME_LEN	65535
+
+struct catalog {
+	EFI_GUID *guids;
+	size_t guid_count;
+	size_t guid_cap;
+	size_t last_guid;	/* the id found last, runs share a GUID */
+	uint16_t *arena;
+	size_t arena_used;	/* in characters */
+	size_t arena_cap;
+	catalog_entry *entries;	/* in the order added, until sorted */
+	size_t count;
+	size_t entries_cap;
+	bool sorted;
+	catalog_entry *slots;	/* hash table, name_len 0 when free */
+	size_t slot_mask;
+};
+
+static int grow(void **buf, size_t *cap, size_t need, size_t size,
+	size_t first)
+{
+	size_t n = *cap ? *cap : first;
+	void *p;
+
+	if (need <= *cap)
+		return UEFIOP_OK;
+	while (n < need)
+		n *= 2;
+	p = realloc(*buf, n * size);
+	if (!p)
+		return UEFIOP_ERROR;
+	*buf = p;
+	*cap = n;
+
+	return UEFIOP_OK;
+}
+
+/* a word at a time, names are short and hashed on every lookup */
+static uint64_t hash_name(const uint16_t *name, size_t len, uint16_t guid_id)
+{
+	const uint8_t *p = (const uint8_t *)name;
+	size_t size = len * sizeof(uint16_t);
+	uint64_t h = HASH64_SEED ^ guid_id, w;
+
+	for (; size >= 8; size -= 8, p += 8) {
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	if (size) {
+		w = 0;
+		memcpy(&w, p, size);
+		h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+
+	return h ^ (h >> 32);
+}
+
+catalog *catalog_new(void)
+{
+	return calloc(1, sizeof(catalog));
+}
+
+void catalog_free(catalog *cat)
+{
+	if (!cat)
+		return;
+	free(cat->guids);
+	free(cat->arena);
+	free(cat->entries);
+	free(cat->slots);
+	free(cat);
+}
+
+/* the id of guid, or -1 if it is not in the catalog and add is false */
+static long guid_id(catalog *cat, const EFI_GUID *guid, bool add)
+{
+	size_t i;
+
+	if (cat->last_guid < cat->guid_count &&
+	    !memcmp(&cat->guids[cat->last_guid], guid, sizeof(*guid)))
+		return cat->last_guid;
+	for (i = 0; i < cat->guid_count; i++) {
+		if (!memcmp(&cat->guids[i], guid, sizeof(*guid))) {
+			cat->last_guid = i;
+			return i;
+		}
+	}
+	if (!add)
+		return -1;
+
+	if (cat->guid_count == MAX_GUIDS) {
+		errno = E2BIG;
+		return -1;
+	}
+	if (grow((void **)&cat->guids, &cat->guid_cap, cat->guid_count + 1,
+		 sizeof(EFI_GUID), 16))
+		return -1;
+	memcpy(&cat->guids[cat->guid_count], guid, sizeof(*guid));
+	cat->last_guid = cat->guid_count;
+
+	return cat->guid_count++;
+}
+
+static catalog_entry *probe(catalog *cat, const uint16_t *name, size_t len,
+	uint16_t id)
+{
+	size_t i = hash_name(name, len, id) & cat->slot_mask;
+
+	for (;; i = (i + 1) & cat->slot_mask) {
+		catalog_entry *s = &cat->slots[i];
+
+		if (!s->name_len ||
+		    (s->name_len == len && s->guid_id == id &&
+		     !memcmp(cat->arena + s->name_offset, name,
+			     len * sizeof(uint16_t))))
+			return s;
+	}
+}
+
+/* keep the table at most half full */
+static int rehash(catalog *cat)
+{
+	size_t size = cat->slots ? (cat->slot_mask + 1) * 2 : 1024, i;
+	catalog_entry *old = cat->slots;
+	size_t old_size = old ? cat->slot_mask + 1 : 0;
+
+	cat->slots = calloc(size, sizeof(*cat->slots));
+	if (!cat->slots) {
+		cat->slots = old;
+		return UEFIOP_ERROR;
+	}
+	cat->slot_mask = size - 1;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].name_len)
+			*probe(cat, cat->arena + old[i].name_offset,
+				old[i].name_len, old[i].guid_id) = old[i];
+	}
+	free(old);
+
+	return UEFIOP_OK;
+}
+
+int catalog_add(catalog *cat, const uint16_t *name, const EFI_GUID *guid)
+{
+	size_t len = ucs2_len(name);
+	catalog_entry *s;
+	long id;
+
+	if (len == 0 || len > MAX_NAME_LEN ||
+	    cat->arena_used + len + 1 > UINT32_MAX) {
+		errno = EINVAL;
+		return UEFIOP_ERROR;
+	}
+	id = guid_id(cat, guid, true);
+	if (id < 0)
+		return UEFIOP_ERROR;
+	if ((cat->count + 1) * 2 > (cat->slots ? cat->slot_mask + 1 : 0) &&
+	    rehash(cat))
+		return UEFIOP_ERROR;
+
+	s = probe(cat, name, len, id);
+	if (s->name_len)
+		return UEFIOP_OK;
+
+	if (grow((void **)&cat->arena, &cat->arena_cap,
+		 cat->arena_used + len + 1, sizeof(uint16_t), 16384) ||
+	    grow((void **)&cat->entries, &cat->entries_cap, cat->count + 1,
+		 sizeof(catalog_entry), 1024))
+		return UEFIOP_ERROR;
+
+	memcpy(cat->arena + cat->arena_used, name,
+		(len + 1) * sizeof(uint16_t));
+	s->name_offset = cat->arena_used;
+	s->name_len = len;
+	s->guid_id = id;
+	cat->arena_used += len + 1;
+	cat->entries[cat->count++] = *s;
+	cat->sorted = false;
+
+	return UEFIOP_OK;
+}
+
+const catalog_entry *catalog_find(catalog *cat, const uint16_t *name,
+	const EFI_GUID *guid)
+{
+	size_t len = ucs2_len(name);
+	catalog_entry *s;
+	long id;
+
+	if (!cat->count || len == 0 || len > MAX_NAME_LEN)
+		return NULL;
+	id = guid_id(cat, guid, false);
+	if (id < 0)
+		return NULL;
+	s = probe(cat, name, len, id);
+
+	return s->name_len ? s : NULL;
+}
+
+uint64_t catalog_load(catalog *cat, uefiop_ctx *ctx)
+{
+	uint64_t status, size, name_cap = NAME_SIZE;
+	uint16_t *name, *p;
+	EFI_GUID guid;
+
+	name = malloc(name_cap);
+	if (!name)
+		return EFI_OUT_OF_RESOURCES;
+	name[0] = 0;
+
+	for (;;) {
+		size = name_cap;
+		status = uefiop_get_next_variable_name(ctx, &size, name, &guid);
+		/* the buffer still holds the previous name, ask again */
+		if (status == EFI_BUFFER_TOO_SMALL && size > name_cap) {
+			p = realloc(name, size);
+			if (!p) {
+				status = EFI_OUT_OF_RESOURCES;
+				break;
+			}
+			name = p;
+			name_cap = size;
+			continue;
+		}
+		if (status == EFI_NOT_FOUND) {
+			status = EFI_SUCCESS;
+			break;
+		}
+		if (status != EFI_SUCCESS)
+			break;
+		if (catalog_add(cat, name, &guid)) {
+			status = EFI_OUT_OF_RESOURCES;
+			break;
+		}
+	}
+	free(name);
+
+	return status;
+}
+
+static int compare_names(const uint16_t *name1, const uint16_t *name2)
+{
+	for (; *name1 && *name1 == *name2; name1++, name2++)
+		;
+	return (int)*name1 - (int)*name2;
+}
+
+static int compare_entries(const void *p1, const void *p2, void *arg)
+{
+	const catalog_entry *e1 = p1, *e2 = p2;
+	const uint16_t *arena = arg;
+
+	if (e1->guid_id != e2->guid_id)
+		return (int)e1->guid_id - (int)e2->guid_id;
+	return compare_names(arena + e1->name_offset,
+		arena + e2->name_offset);
+}
+
+static void sort_entries(catalog *cat)
+{
+	if (cat->sorted)
+		return;
+	qsort_r(cat->entries, cat->count, sizeof(*cat->entries),
+		compare_entries, cat->arena);
+	cat->sorted = true;
+}
+
+size_t catalog_count(catalog *cat)
+{
+	return cat->count;
+}
+
+const catalog_entry *catalog_entries(catalog *cat)
+{
+	sort_entries(cat);
+	return cat->entries;
+}
+
+/* the first entry of id not before prefix, or past it when past is set */
+static size_t bound(catalog *cat, uint16_t id, const uint16_t *prefix,
+	size_t len, bool past)
+{
+	size_t lo = 0, hi = cat->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const catalog_entry *e = &cat->entries[mid];
+		const uint16_t *name = cat->arena + e->name_offset;
+		int rc;
+
+		if (e->guid_id != id) {
+			rc = (int)e->guid_id - (int)id;
+		} else {
+			size_t i;
+
+			/* only the first len characters of the name count */
+			for (i = 0; i < len && name[i] == prefix[i]; i++)
+				;
+			rc = i == len ? 0 : (int)name[i] - (int)prefix[i];
+		}
+		if (rc < 0 || (past && rc == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+size_t catalog_prefix(catalog *cat, const EFI_GUID *guid,
+	const uint16_t *prefix, const catalog_entry **first)
+{
+	size_t len = ucs2_len(prefix), lo;
+	long id = guid_id(cat, guid, false);
+
+	*first = NULL;
+	if (id < 0)
+		return 0;
+	sort_entries(cat);
+	lo = bound(cat, id, prefix, len, false);
+	*first = &cat->entries[lo];
+
+	return bound(cat, id, prefix, len, true) - lo;
+}
+
+size_t catalog_guid_count(catalog *cat)
+{
+	return cat->guid_count;
+}
+
+const EFI_GUID *catalog_guid(catalog *cat, const catalog_entry *e)
+{
+	return &cat->guids[e->guid_id];
+}
+
+const EFI_GUID *catalog_guids(catalog *cat)
+{
+	return cat->guids;
+}
+
+const uint16_t *catalog_name(catalog *cat, const catalog_entry *e)
+{
+	return cat->arena + e->name_offset;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+/*
+ *  The tools share one context per process, so that the commands run by
+ *  uefiop batch all go through the same open driver. A nested call gets
+ *  the context already open; it may not ask for another backend, which
+ *  would otherwise be read or written in place of the one it named.
+ */
+static uefiop_ctx *driver_ctx = NULL;
+static char *driver_spec = NULL;	/* NULL for the default backend */
+static int driver_refs = 0;
+
+uefiop_ctx *init_driver(const char *backend)
+{
+	uefiop_ctx *ctx;
+
+	if (driver_refs > 0) {
+		if (backend && *backend &&
+		    (!driver_spec || strcmp(backend, driver_spec))) {
+			printf("Backend \"%s\" is not the open one, \"%s\". "
+				"Aborted.\n", backend,
+				driver_spec ? driver_spec :
+				uefiop_backend_name(driver_ctx));
+			return NULL;
+		}
+		driver_refs++;
+		return driver_ctx;
+	}
+
+	if (!backend || !*backend)
+		backend = getenv("UEFIOP_BACKEND");
+	if (backend && !*backend)
+		backend = NULL;
+
+	ctx = uefiop_open(backend);
+	if (!ctx) {
+		if (errno == ENODEV)
+			printf("Cannot load efi runtime module. Aborted.\n");
+		else if (errno == EBUSY)
+			printf("The efi runtime module is loaded, but its device "
+				"is not available. Aborted.\n");
+		else if (errno == EINVAL)
+			printf("Unknown backend \"%s\". Aborted.\n", backend);
+		else if (errno == ENOEXEC)
+			printf("No variable store in \"%s\". Aborted.\n", backend);
+		else
+			printf("Cannot open efi runtime driver. Aborted.\n");
+		return NULL;
+	}
+
+	if (backend) {
+		driver_spec = strdup(backend);
+		if (!driver_spec) {
+			printf("Cannot alloc memory. Aborted.\n");
+			uefiop_close(ctx);
+			return NULL;
+		}
+	}
+	driver_ctx = ctx;
+	driver_refs = 1;
+
+	return ctx;
+}
+
+void deinit_driver(uefiop_ctx *ctx)
+{
+	if (!ctx || ctx != driver_ctx || --driver_refs > 0)
+		return;
+
+	uefiop_close(ctx);
+	free(driver_spec);
+	driver_ctx = NULL;
+	driver_spec = NULL;
+}
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "uefiop.h"
+#include "manifest.h"
+#include "snapshot.h"
+#include "utils.h"
+
+static int read_file(const char *path, uint8_t **bufp, size_t *sizep)
+{
+	struct stat statbuf;
+	uint8_t *buf;
+	size_t done = 0;
+	int fd, err;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return UEFIOP_ERROR;
+	if (fstat(fd, &statbuf))
+		goto error;
+
+	/* one spare byte, so that text can be NUL terminated */
+	buf = malloc(statbuf.st_size + 1);
+	if (!buf)
+		goto error;
+	while (done < (size_t)statbuf.st_size) {
+		ssize_t n = read(fd, buf + done, statbuf.st_size - done);
+
+		if (n <= 0) {
+			if (n == 0)
+				errno = EIO;
+			free(buf);
+			goto error;
+		}
+		done += n;
+	}
+	close(fd);
+	*bufp = buf;
+	*sizep = done;
+
+	return UEFIOP_OK;
+
+error:
+	err = errno;
+	close(fd);
+	errno = err;
+	return UEFIOP_ERROR;
+}
+
+/* hex bytes, optionally separated by blanks or commas */
+static int parse_hex(const char *str, uint8_t **datap, size_t *sizep)
+{
+	size_t len = strlen(str);
+	uint8_t *data;
+	ssize_t n;
+
+	data = malloc(len / 2 + 1);
+	if (!data)
+		return UEFIOP_ERROR;
+	n = hex_decode(data, str, len);
+	if (n <= 0) {
+		free(data);
+		return UEFIOP_ERROR;
+	}
+	*datap = data;
+	*sizep = n;
+
+	return UEFIOP_OK;
+}
+
+static char *next_word(char **p)
+{
+	char *word;
+
+	while (**p == ' ' || **p == '\t')
+		(*p)++;
+	if (**p == '\0')
+		return NULL;
+	word = *p;
+	while (**p && **p != ' ' && **p != '\t')
+		(*p)++;
+	if (**p)
+		*(*p)++ = '\0';
+
+	return word;
+}
+
+static int parse_line(char *line, manifest_entry *e)
+{
+	char *p = line, *guid, *name, *attr, *end;
+	efi_guid g;
+	size_t len;
+
+	guid = next_word(&p);
+	name = next_word(&p);
+	attr = next_word(&p);
+	while (*p == ' ' || *p == '\t')
+		p++;
+	len = strlen(p);
+	while (len && (p[len - 1] == ' ' || p[len - 1] == '\t' ||
+		       p[len - 1] == '\r'))
+		p[--len] = '\0';
+	if (!guid || !name || !attr || !*p)
+		return UEFIOP_ERROR;
+
+	if (string_to_guid(guid, &g))
+		return UEFIOP_ERROR;
+	memcpy(&e->guid, &g, sizeof(e->guid));
+
+	e->attr = strtoul(attr, &end, 16);
+	if (*end)
+		return UEFIOP_ERROR;
+
+	len = strlen(name);
+	e->name = malloc((len + 1) * sizeof(uint16_t));
+	if (!e->name)
+		return UEFIOP_ERROR;
+	if (utf8_to_ucs2(e->name, name, len) < 0)
+		return UEFIOP_ERROR;
+
+	if (!strcmp(p, "-"))
+		e->remove = true;
+	else if (p[0] == '@')
+		return read_file(p + 1, &e->data, &e->size);
+	else
+		return parse_hex(p, &e->data, &e->size);
+
+	return UEFIOP_OK;
+}
+
+manifest *manifest_load(const char *path, size_t *line)
+{
+	manifest *m;
+	uint8_t *buf;
+	char *p, *next;
+	size_t size, cap = 0;
+	int err;
+
+	*line = 0;
+	if (read_file(path, &buf, &size))
+		return NULL;
+	buf[size] = '\0';
+
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		free(buf);
+		return NULL;
+	}
+
+	for (p = (char *)buf; p; p = next) {
+		manifest_entry *e;
+		char *s;
+
+		next = strchr(p, '\n');
+		if (next)
+			*next++ = '\0';
+		(*line)++;
+
+		for (s = p; *s == ' ' || *s == '\t' || *s == '\r'; s++)
+			;
+		if (*s == '\0' || *s == '#')
+			continue;
+
+		if (m->count == cap) {
+			cap = cap ? cap * 2 : 16;
+			e = realloc(m->entries, cap * sizeof(*e));
+			if (!e)
+				goto error;
+			m->entries = e;
+		}
+		e = &m->entries[m->count];
+		memset(e, 0, sizeof(*e));
+		m->count++;
+		errno = 0;
+		if (parse_line(s, e)) {
+			/* a syntax error, unless a file could not be read */
+			if (!errno)
+				errno = EINVAL;
+			goto error;
+		}
+	}
+	free(buf);
+	*line = 0;
+
+	return m;
+
+error:
+	err = errno;
+	free(buf);
+	manifest_free(m);
+	errno = err;
+	return NULL;
+}
+
+void manifest_free(manifest *m)
+{
+	size_t i;
+
+	if (!m)
+		return;
+
+	for (i = 0; i < m->count; i++) {
+		free(m->entries[i].name);
+		free(m->entries[i].data);
+	}
+	free(m->entries);
+	free(m);
+}
+
+uint64_t manifest_apply_store(const manifest *m, varstore *vs, size_t *failed)
+{
+	size_t i;
+
+	for (i = 0; i < m->count; i++) {
+		const manifest_entry *e = &m->entries[i];
+		uint64_t status;
+
+		if (e->remove) {
+			status = varstore_set(vs, e->name, &e->guid, 0, 0, NULL);
+			if (status == EFI_NOT_FOUND)
+				status = EFI_SUCCESS;
+		} else {
+			status = varstore_set(vs, e->name, &e->guid, e->attr,
+				e->size, e->data);
+		}
+		if (status != EFI_SUCCESS) {
+			*failed = i;
+			return status;
+		}
+	}
+
+	return EFI_SUCCESS;
+}
+
+uint64_t manifest_render(const manifest *m, const void *tmpl, size_t size,
+	void *buf, size_t *failed)
+{
+	varstore *vs;
+	uint64_t status;
+
+	memcpy(buf, tmpl, size);
+	vs = varstore_attach(buf, size);
+	if (!vs)
+		return errno == ENOEXEC ? EFI_VOLUME_CORRUPTED :
+			EFI_OUT_OF_RESOURCES;
+
+	status = manifest_apply_store(m, vs, failed);
+	varstore_close(vs);
+
+	return status;
+}
+
+static int compare_entries(const void *p1, const void *p2, void *arg)
+{
+	const manifest_entry *entries = arg;
+	size_t i1 = *(const size_t *)p1, i2 = *(const size_t *)p2;
+	int rc;
+
+	rc = snapshot_compare(&entries[i1].guid, entries[i1].name,
+		&entries[i2].guid, entries[i2].name);
+	if (rc)
+		return rc;
+	return i1 < i2 ? -1 : i1 > i2;
+}
+
+/*
+ * Mark the entries a later set or delete of the same variable overrides,
+ * appends after the last of those still count.
+ */
+static int coalesce(const manifest *m, bool *dropped, size_t *count)
+{
+	size_t *order, i, j, k;
+
+	*count = 0;
+	order = malloc(m->count * sizeof(*order));
+	if (!order)
+		return UEFIOP_ERROR;
+	for (i = 0; i < m->count; i++)
+		order[i] = i;
+	qsort_r(order, m->count, sizeof(*order), compare_entries,
+		m->entries);
+
+	for (i = 0; i < m->count; i = j) {
+		size_t last = m->count;
+
+		for (j = i; j < m->count &&
+		     !snapshot_compare(&m->entries[order[i]].guid,
+			m->entries[order[i]].name,
+			&m->entries[order[j]].guid,
+			m->entries[order[j]].name); j++) {
+			const manifest_entry *e = &m->entries[order[j]];
+
+			if (e->remove || !(e->attr & EFI_VARIABLE_APPEND_WRITE))
+				last = j;
+		}
+		for (k = i; last != m->count && k < last; k++) {
+			dropped[order[k]] = true;
+			(*count)++;
+		}
+	}
+	free(order);
+
+	return UEFIOP_OK;
+}
+
+/* whether the variable already holds what e would write */
+static uint64_t unchanged(uefiop_ctx *ctx, const manifest_entry *e,
+	uint8_t *buf, bool *same)
+{
+	uint64_t status, size = e->remove ? 0 : e->size;
+	uint32_t attr;
+
+	*same = false;
+	if (!e->remove && (e->attr & (EFI_VARIABLE_APPEND_WRITE |
+			EFI_VARIABLE_AUTHENTICATED_WRITE_ACCESS |
+			EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS)))
+		return EFI_SUCCESS;
+
+	status = uefiop_get_variable(ctx, e->name, &e->guid, &attr, &size,
+		e->remove ? NULL : buf);
+	if (e->remove) {
+		*same = status == EFI_NOT_FOUND;
+		return status == EFI_NOT_FOUND ||
+			status == EFI_BUFFER_TOO_SMALL ? EFI_SUCCESS : status;
+	}
+	if (status == EFI_NOT_FOUND || status == EFI_BUFFER_TOO_SMALL)
+		return EFI_SUCCESS;
+	if (status != EFI_SUCCESS)
+		return status;
+	*same = attr == e->attr && size == e->size &&
+		!memcmp(buf, e->data, size);
+
+	return EFI_SUCCESS;
+}
+
+uint64_t manifest_apply(const manifest *m, uefiop_ctx *ctx,
+	unsigned int flags, manifest_write_cb cb, void *arg,
+	manifest_stats *stats, size_t *failed)
+{
+	uint64_t status = EFI_SUCCESS;
+	size_t i, max = 1;
+	bool *dropped, same;
+	uint8_t *buf;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < m->count; i++)
+		if (!m->entries[i].remove && m->entries[i].size > max)
+			max = m->entries[i].size;
+	dropped = calloc(m->count + 1, sizeof(*dropped));
+	buf = malloc(max);
+	if (!dropped || !buf ||
+	    coalesce(m, dropped, &stats->coalesced)) {
+		free(dropped);
+		free(buf);
+		*failed = 0;
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	for (i = 0; i < m->count; i++) {
+		const manifest_entry *e = &m->entries[i];
+
+		if (dropped[i])
+			continue;
+		status = unchanged(ctx, e, buf, &same);
+		if (status != EFI_SUCCESS)
+			break;
+		if (same) {
+			stats->unchanged++;
+			continue;
+		}
+
+		if (cb)
+			cb(e, arg);
+		if (!(flags & MANIFEST_DRY_RUN)) {
+			if (e->remove)
+				status = uefiop_set_variable(ctx, e->name,
+					&e->guid, 0, 0, NULL);
+			else
+				status = uefiop_set_variable(ctx, e->name,
+					&e->guid, e->attr, e->size, e->data);
+			if (status != EFI_SUCCESS)
+				break;
+		}
+		stats->writes++;
+	}
+	if (status != EFI_SUCCESS)
+		*failed = i;
+	free(dropped);
+	free(buf);
+
+	return status;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "uefiop.h"
+#include "sizehint.h"
+#include "utils.h"
+
+char *sizehint_dir(void)
+{
+	const char *env;
+	char *dir = NULL;
+
+	env = getenv(SIZEHINT_DIR_ENV);
+	if (env && *env) {
+		dir = strdup(env);
+	} else if (geteuid() == 0) {
+		(void)mkdir(UEFIOP_RUN_DIR, 0755);
+		dir = strdup(UEFIOP_RUN_DIR "/sizehint");
+	} else if ((env = getenv("XDG_CACHE_HOME")) && *env) {
+		if (asprintf(&dir, "%s/uefiop", env) < 0)
+			dir = NULL;
+	} else if ((env = getenv("HOME")) && *env) {
+		if (asprintf(&dir, "%s/.cache", env) < 0)
+			return NULL;
+		(void)mkdir(dir, 0700);
+		free(dir);
+		if (asprintf(&dir, "%s/.cache/uefiop", env) < 0)
+			dir = NULL;
+	} else {
+		errno = ENOENT;
+		return NULL;
+	}
+	if (!dir)
+		return NULL;
+
+	if (mkdir(dir, 0700) && errno != EEXIST) {
+		free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+/* <dir>/<guid>-<hash of the name>, the name may hold any character */
+static int hint_path(const char *dir, const uint16_t *name,
+	const EFI_GUID *guid, char *path, size_t size)
+{
+	char guidstr[37];
+	efi_guid g;
+	size_t len = 0;
+	int n;
+
+	while (name[len])
+		len++;
+	memcpy(&g, guid, sizeof(g));
+	guid_to_string(&g, guidstr);
+	n = snprintf(path, size, "%s/%s-%016llx", dir, guidstr,
+		(unsigned long long)hash64(name, len * 2, HASH64_SEED));
+	if (n < 0 || (size_t)n >= size) {
+		errno = ENAMETOOLONG;
+		return UEFIOP_ERROR;
+	}
+
+	return UEFIOP_OK;
+}
+
+uint64_t sizehint_get(const char *dir, const uint16_t *name,
+	const EFI_GUID *guid)
+{
+	char path[PATH_MAX];
+	char buf[24];
+	ssize_t n;
+	int fd;
+
+	if (hint_path(dir, name, guid, path, sizeof(path)))
+		return 0;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+
+	return strtoull(buf, NULL, 10);
+}
+
+int sizehint_put(const char *dir, const uint16_t *name, const EFI_GUID *guid,
+	uint64_t size)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	char buf[24];
+	ssize_t n;
+	int fd, len, err;
+
+	if (hint_path(dir, name, guid, path, sizeof(path)))
+		return UEFIOP_ERROR;
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >=
+	    sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		return UEFIOP_ERROR;
+	}
+
+	/* readers never see a half written hint */
+	fd = mkstemp(tmp);
+	if (fd == -1)
+		return UEFIOP_ERROR;
+	len = snprintf(buf, sizeof(buf), "%llu\n", (unsigned long long)size);
+	n = write(fd, buf, len);
+	if (n != len) {
+		if (n >= 0)
+			errno = ENOSPC;
+		goto error;
+	}
+	if (close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	if (rename(tmp, path)) {
+		fd = -1;
+		goto error;
+	}
+
+	return UEFIOP_OK;
+
+error:
+	err = errno;
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	errno = err;
+	return UEFIOP_ERROR;
+}
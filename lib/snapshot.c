@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "uefiop.h"
+#include "snapshot.h"
+#include "variter.h"
+#include "utils.h"
+
+#define DATA_CHUNK	65536
+#define ALIGN8(x)	(((x) + 7) & ~(size_t)7)
+
+struct snapshot {
+	uint8_t *map;
+	size_t size;
+	const snapshot_header *hdr;
+	const snapshot_entry *entries;
+};
+
+/* the snapshot being taken, offsets are relative to names and data */
+typedef struct {
+	snapshot_entry *entries;
+	size_t count;
+	size_t entries_cap;
+	uint8_t *names;
+	size_t names_size;
+	size_t names_cap;
+	uint8_t *data;
+	size_t data_size;
+	size_t data_cap;
+} snapshot_builder;
+
+static int reserve(uint8_t **buf, size_t *cap, size_t need)
+{
+	size_t size = *cap ? *cap : DATA_CHUNK;
+	uint8_t *p;
+
+	if (need <= *cap)
+		return UEFIOP_OK;
+	while (size < need)
+		size *= 2;
+	p = realloc(*buf, size);
+	if (!p)
+		return UEFIOP_ERROR;
+	*buf = p;
+	*cap = size;
+
+	return UEFIOP_OK;
+}
+
+static size_t ucs_size(const uint16_t *name)
+{
+	size_t i;
+
+	for (i = 0; name[i]; i++)
+		;
+	return (i + 1) * sizeof(uint16_t);
+}
+
+int snapshot_compare(const EFI_GUID *guid1, const uint16_t *name1,
+	const EFI_GUID *guid2, const uint16_t *name2)
+{
+	int rc = memcmp(guid1, guid2, sizeof(*guid1));
+
+	if (rc)
+		return rc;
+	for (; *name1 && *name1 == *name2; name1++, name2++)
+		;
+	return (int)*name1 - (int)*name2;
+}
+
+static int compare_entries(const void *p1, const void *p2, void *arg)
+{
+	const snapshot_entry *e1 = p1, *e2 = p2;
+	const uint8_t *names = arg;
+
+	return snapshot_compare(&e1->guid,
+		(const uint16_t *)(names + e1->name_offset), &e2->guid,
+		(const uint16_t *)(names + e2->name_offset));
+}
+
+/* read the variable straight into the data region of the snapshot */
+static uint64_t read_variable(uefiop_ctx *ctx, snapshot_builder *b,
+	const uint16_t *name, const EFI_GUID *guid, uint64_t hint,
+	snapshot_entry *e)
+{
+	uint64_t status, size;
+	size_t need = hint ? hint : DATA_CHUNK;
+	uint32_t attr;
+
+	b->data_size = ALIGN8(b->data_size);
+	for (;;) {
+		if (reserve(&b->data, &b->data_cap, b->data_size + need))
+			return EFI_OUT_OF_RESOURCES;
+		size = b->data_cap - b->data_size;
+		status = uefiop_get_variable(ctx, name, guid, &attr, &size,
+			b->data + b->data_size);
+		if (status != EFI_BUFFER_TOO_SMALL)
+			break;
+		need = size;
+	}
+	if (status != EFI_SUCCESS)
+		return status;
+
+	e->attr = attr;
+	e->data_offset = b->data_size;
+	e->data_size = size;
+	e->hash = hash64(b->data + b->data_size, size, HASH64_SEED);
+	b->data_size += size;
+
+	return EFI_SUCCESS;
+}
+
+static int write_snapshot(const char *path, snapshot_builder *b)
+{
+	static const uint8_t pad[8];
+	snapshot_header hdr;
+	struct iovec iov[5];
+	char *tmp = NULL;
+	size_t i, names_offset, data_offset;
+	int fd = -1, err;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.count = b->count;
+	hdr.index_offset = sizeof(hdr);
+	names_offset = sizeof(hdr) + b->count * sizeof(snapshot_entry);
+	data_offset = ALIGN8(names_offset + b->names_size);
+	hdr.names_offset = names_offset;
+	hdr.data_offset = data_offset;
+	hdr.file_size = data_offset + b->data_size;
+
+	for (i = 0; i < b->count; i++) {
+		b->entries[i].name_offset += names_offset;
+		b->entries[i].data_offset += data_offset;
+	}
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = b->entries;
+	iov[1].iov_len = b->count * sizeof(snapshot_entry);
+	iov[2].iov_base = b->names;
+	iov[2].iov_len = b->names_size;
+	iov[3].iov_base = (void *)pad;
+	iov[3].iov_len = data_offset - names_offset - b->names_size;
+	iov[4].iov_base = b->data;
+	iov[4].iov_len = b->data_size;
+
+	/* write a temporary file and rename it, an old snapshot stays intact */
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return UEFIOP_ERROR;
+	fd = mkstemp(tmp);
+	if (fd == -1)
+		goto error;
+
+	if (write_iov(fd, iov, 5))
+		goto error;
+	if (fchmod(fd, 0644) || close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	fd = -1;
+	if (rename(tmp, path))
+		goto error;
+	free(tmp);
+
+	return UEFIOP_OK;
+
+error:
+	err = errno;
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+	errno = err;
+	return UEFIOP_ERROR;
+}
+
+int snapshot_take(uefiop_ctx *ctx, const char *path, size_t *count,
+	uint64_t *status)
+{
+	return snapshot_take_match(ctx, path, NULL, count, status);
+}
+
+int snapshot_take_match(uefiop_ctx *ctx, const char *path,
+	const variter_match *match, size_t *count, uint64_t *status)
+{
+	snapshot_builder b;
+	const variter_var *var;
+	variter *it;
+	int rc = UEFIOP_ERROR;
+
+	memset(&b, 0, sizeof(b));
+	*status = EFI_SUCCESS;
+	it = variter_new(ctx, 0);
+	if (!it)
+		return UEFIOP_ERROR;
+	variter_set_match(it, match);
+
+	for (;;) {
+		snapshot_entry *e;
+
+		*status = variter_next(it, &var);
+		if (*status == EFI_NOT_FOUND)
+			break;
+		if (*status != EFI_SUCCESS)
+			goto out;
+
+		if (b.count == b.entries_cap) {
+			size_t cap = b.entries_cap ? b.entries_cap * 2 : 256;
+
+			e = realloc(b.entries, cap * sizeof(*e));
+			if (!e) {
+				*status = EFI_SUCCESS;
+				goto out;
+			}
+			b.entries = e;
+			b.entries_cap = cap;
+		}
+		e = &b.entries[b.count];
+		memset(e, 0, sizeof(*e));
+		memcpy(&e->guid, var->guid, sizeof(e->guid));
+
+		/* a size match already probed the size of the data */
+		*status = read_variable(ctx, &b, var->name, var->guid,
+			var->size, e);
+		if (*status == EFI_NOT_FOUND) {
+			variter_drop(it);	/* deleted in the meantime */
+			continue;
+		}
+		if (*status != EFI_SUCCESS)
+			goto out;
+
+		e->name_size = ucs_size(var->name);
+		if (reserve(&b.names, &b.names_cap,
+			    b.names_size + e->name_size)) {
+			*status = EFI_SUCCESS;
+			goto out;
+		}
+		memcpy(b.names + b.names_size, var->name, e->name_size);
+		e->name_offset = b.names_size;
+		b.names_size += e->name_size;
+		b.count++;
+	}
+	*status = EFI_SUCCESS;
+
+	qsort_r(b.entries, b.count, sizeof(*b.entries), compare_entries,
+		b.names);
+	if (write_snapshot(path, &b))
+		goto out;
+	*count = b.count;
+	rc = UEFIOP_OK;
+
+out:
+	variter_free(it);
+	free(b.entries);
+	free(b.names);
+	free(b.data);
+
+	return rc;
+}
+
+snapshot *snapshot_open(const char *path)
+{
+	snapshot *snap;
+	struct stat statbuf;
+	const snapshot_header *hdr;
+	size_t i;
+	int fd, err;
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		goto error;
+	if (fstat(fd, &statbuf)) {
+		close(fd);
+		goto error;
+	}
+	if ((size_t)statbuf.st_size < sizeof(snapshot_header)) {
+		close(fd);
+		errno = ENOEXEC;
+		goto error;
+	}
+	snap->size = statbuf.st_size;
+	snap->map = mmap(NULL, snap->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (snap->map == MAP_FAILED) {
+		snap->map = NULL;
+		goto error;
+	}
+
+	/* check that everything the index points to is in the file */
+	hdr = snap->hdr = (const snapshot_header *)snap->map;
+	errno = ENOEXEC;
+	if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != SNAPSHOT_VERSION ||
+	    hdr->file_size != snap->size ||
+	    hdr->index_offset != sizeof(*hdr) ||
+	    hdr->count > (snap->size - sizeof(*hdr)) / sizeof(snapshot_entry))
+		goto error;
+	snap->entries = (const snapshot_entry *)(snap->map + hdr->index_offset);
+	for (i = 0; i < hdr->count; i++) {
+		const snapshot_entry *e = &snap->entries[i];
+
+		if (e->name_size < 2 * sizeof(uint16_t) ||
+		    e->name_size % sizeof(uint16_t) ||
+		    e->name_offset % sizeof(uint16_t) ||
+		    e->name_offset > snap->size ||
+		    e->name_size > snap->size - e->name_offset ||
+		    e->data_offset > snap->size ||
+		    e->data_size > snap->size - e->data_offset ||
+		    snap->map[e->name_offset + e->name_size - 1] ||
+		    snap->map[e->name_offset + e->name_size - 2])
+			goto error;
+	}
+
+	return snap;
+
+error:
+	err = errno;
+	snapshot_close(snap);
+	errno = err;
+	return NULL;
+}
+
+void snapshot_close(snapshot *snap)
+{
+	if (!snap)
+		return;
+
+	if (snap->map)
+		munmap(snap->map, snap->size);
+	free(snap);
+}
+
+size_t snapshot_count(snapshot *snap)
+{
+	return snap->hdr->count;
+}
+
+const snapshot_entry *snapshot_entries(snapshot *snap)
+{
+	return snap->entries;
+}
+
+const snapshot_entry *snapshot_find(snapshot *snap, const uint16_t *name,
+	const EFI_GUID *guid)
+{
+	size_t lo = 0, hi = snap->hdr->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const snapshot_entry *e = &snap->entries[mid];
+		int rc;
+
+		rc = snapshot_compare(guid, name, &e->guid,
+			snapshot_name(snap, e));
+		if (rc == 0)
+			return e;
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+const uint16_t *snapshot_name(snapshot *snap, const snapshot_entry *e)
+{
+	return (const uint16_t *)(snap->map + e->name_offset);
+}
+
+const uint8_t *snapshot_data(snapshot *snap, const snapshot_entry *e)
+{
+	return snap->map + e->data_offset;
+}
+
+int snapshot_diff(snapshot *old_snap, snapshot *new_snap,
+	snapshot_diff_cb cb, void *arg)
+{
+	const snapshot_entry *a = old_snap->entries;
+	const snapshot_entry *b = new_snap->entries;
+	const snapshot_entry *a_end = a + old_snap->hdr->count;
+	const snapshot_entry *b_end = b + new_snap->hdr->count;
+	int rc;
+
+	while (a < a_end || b < b_end) {
+		unsigned int changes = 0;
+		int order;
+
+		if (a == a_end)
+			order = 1;
+		else if (b == b_end)
+			order = -1;
+		else
+			order = snapshot_compare(&a->guid,
+				snapshot_name(old_snap, a), &b->guid,
+				snapshot_name(new_snap, b));
+
+		if (order < 0) {
+			rc = cb(old_snap, a++, new_snap, NULL, 0, arg);
+		} else if (order > 0) {
+			rc = cb(old_snap, NULL, new_snap, b++, 0, arg);
+		} else {
+			if (a->attr != b->attr)
+				changes |= SNAPSHOT_ATTR_CHANGED;
+			if (a->data_size != b->data_size || a->hash != b->hash ||
+			    memcmp(snapshot_data(old_snap, a),
+				   snapshot_data(new_snap, b), a->data_size))
+				changes |= SNAPSHOT_DATA_CHANGED;
+			rc = changes ? cb(old_snap, a, new_snap, b, changes, arg) : 0;
+			a++;
+			b++;
+		}
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
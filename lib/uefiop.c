@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "libuefiop.h"
+#include "backend.h"
+#include "utils.h"
+
+struct uefiop_ctx {
+	pthread_mutex_t lock;
+	const uefiop_backend_ops *ops;
+	void *priv;
+};
+
+static const uefiop_backend_ops *backends[] = {
+	&uefiop_ioctl_backend,
+	&uefiop_efivarfs_backend,
+	&uefiop_image_backend,
+	&uefiop_snapshot_backend,
+	NULL
+};
+
+static const uefiop_backend_ops *find_backend(const char *name, size_t len)
+{
+	const uefiop_backend_ops **ops;
+
+	for (ops = backends; *ops; ops++) {
+		if (strlen((*ops)->name) == len && !strncmp((*ops)->name, name, len))
+			return *ops;
+	}
+	return NULL;
+}
+
+uefiop_ctx *uefiop_open(const char *spec)
+{
+	uefiop_ctx *ctx;
+	const char *path = NULL;
+	const char *colon;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	if (!spec || !*spec)
+		spec = getenv("UEFIOP_BACKEND");
+
+	if (!spec || !*spec) {
+		/* the efi runtime driver, or efivarfs if there is none */
+		ctx->ops = &uefiop_ioctl_backend;
+		ctx->priv = ctx->ops->open(NULL);
+		if (!ctx->priv && (errno == ENODEV || errno == EBUSY)) {
+			int err = errno;
+
+			ctx->ops = &uefiop_efivarfs_backend;
+			ctx->priv = ctx->ops->open(NULL);
+			if (!ctx->priv)
+				errno = err;
+		}
+	} else if (spec[0] == '/') {
+		/* a device node of the efi runtime driver */
+		ctx->ops = &uefiop_ioctl_backend;
+		ctx->priv = ctx->ops->open(spec);
+	} else {
+		colon = strchr(spec, ':');
+		if (colon)
+			path = colon + 1;
+		ctx->ops = find_backend(spec, colon ? (size_t)(colon - spec) : strlen(spec));
+		if (!ctx->ops)
+			errno = EINVAL;
+		else
+			ctx->priv = ctx->ops->open(path && *path ? path : NULL);
+	}
+
+	if (!ctx->priv) {
+		int err = errno;
+
+		free(ctx);
+		errno = err;
+		return NULL;
+	}
+	pthread_mutex_init(&ctx->lock, NULL);
+
+	return ctx;
+}
+
+void uefiop_close(uefiop_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	ctx->ops->close(ctx->priv);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+}
+
+const char *uefiop_backend_name(uefiop_ctx *ctx)
+{
+	return ctx->ops->name;
+}
+
+#define BACKEND_CALL(ctx, op, ...)					\
+	do {								\
+		uint64_t status;					\
+									\
+		if (!(ctx)->ops->op)					\
+			return EFI_UNSUPPORTED;				\
+		pthread_mutex_lock(&(ctx)->lock);			\
+		status = (ctx)->ops->op((ctx)->priv, __VA_ARGS__);	\
+		pthread_mutex_unlock(&(ctx)->lock);			\
+		return status;						\
+	} while (0)
+
+uint64_t uefiop_get_variable(
+	uefiop_ctx *ctx,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t *attr,
+	uint64_t *size,
+	void *data)
+{
+	BACKEND_CALL(ctx, get_variable, name, guid, attr, size, data);
+}
+
+uint64_t uefiop_set_variable(
+	uefiop_ctx *ctx,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	uint64_t size,
+	const void *data)
+{
+	BACKEND_CALL(ctx, set_variable, name, guid, attr, size, data);
+}
+
+uint64_t uefiop_get_next_variable_name(
+	uefiop_ctx *ctx,
+	uint64_t *size,
+	uint16_t *name,
+	EFI_GUID *guid)
+{
+	BACKEND_CALL(ctx, get_next_variable_name, size, name, guid);
+}
+
+uint64_t uefiop_query_variable_info(
+	uefiop_ctx *ctx,
+	uint32_t attr,
+	uint64_t *max_storage,
+	uint64_t *remaining,
+	uint64_t *max_size)
+{
+	BACKEND_CALL(ctx, query_variable_info, attr, max_storage, remaining,
+		max_size);
+}
+
+uint64_t uefiop_get_time(
+	uefiop_ctx *ctx,
+	EFI_TIME *time,
+	EFI_TIME_CAPABILITIES *cap)
+{
+	BACKEND_CALL(ctx, get_time, time, cap);
+}
+
+uint64_t uefiop_set_time(
+	uefiop_ctx *ctx,
+	EFI_TIME *time)
+{
+	BACKEND_CALL(ctx, set_time, time);
+}
+
+uint64_t uefiop_get_wakeup_time(
+	uefiop_ctx *ctx,
+	uint8_t *enabled,
+	uint8_t *pending,
+	EFI_TIME *time)
+{
+	BACKEND_CALL(ctx, get_wakeup_time, enabled, pending, time);
+}
+
+uint64_t uefiop_set_wakeup_time(
+	uefiop_ctx *ctx,
+	uint8_t enabled,
+	EFI_TIME *time)
+{
+	BACKEND_CALL(ctx, set_wakeup_time, enabled, time);
+}
+
+void uefiop_reset_system(
+	uefiop_ctx *ctx,
+	int type,
+	uint64_t status,
+	uint64_t size,
+	void *data)
+{
+	if (!ctx->ops->reset_system)
+		return;
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->ops->reset_system(ctx->priv, type, status, size, data);
+	pthread_mutex_unlock(&ctx->lock);
+}
@@ -33,22 +33,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <fcntl.h>
 #include <string.h>
 #include <byteswap.h>
-#include <unistd.h>
 #include <stdbool.h> 
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
 #include <sys/stat.h>
-#include <paths.h>
-#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "uefiop.h"
 #include "utils.h"
 #include "uefiop_version.h"
 
-static char *efi_dev_name = NULL;
-static char *module_name = NULL;
-
 typedef struct {
 	const uint64_t statusvalue;
 	const char *mnemonic ;
@@ -93,17 +98,22 @@ static uefistatus_info uefistatus_info_table[] = {
 	{ ~0, NULL, NULL }
 };
 
-void print_status_info(const uint64_t status)
+void fprint_status_info(FILE *fp, const uint64_t status)
 {
 	uefistatus_info *info;
 
 	for (info = uefistatus_info_table; info->mnemonic != NULL; info++) {
 		if (status == info->statusvalue) {
-			printf("Return status: %s. %s\n", info->mnemonic, info->description);
+			fprintf(fp, "Return status: %s. %s\n", info->mnemonic, info->description);
 			return;
 		}
 	}
-	printf("Cannot find the return status information, value = 0x%lx\n.", status);
+	fprintf(fp, "Cannot find the return status information, value = 0x%lx\n.", status);
+}
+
+void print_status_info(const uint64_t status)
+{
+	fprint_status_info(stdout, status);
 }
 
 void version(void)
@@ -113,7 +123,7 @@ void version(void)
 
 int check_segment(const char *str, size_t len)
 {
-	int i;
+	size_t i;
 	for(i = 0; i < len; i++) {
 		if ((str[i] >= '0' && str[i] <= '9') || ((str[i] | 0x20) >= 'a' && (str[i] | 0x20) <= 'f'))
 			continue;
@@ -122,280 +132,883 @@ int check_segment(const char *str, size_t len)
 	return 0;
 }
 
-int string_to_guid(const char *str, efi_guid *guid)
+static const char hex_digits[16] = "0123456789abcdef";
+
+/* value of a hex digit plus one, 0 for anything else */
+static const uint8_t hex_table[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/*
+ *  Vendor GUIDs known by name, for "-g global" or "global:BootOrder". Both
+ *  lookups are a single probe of a 16 slot table: by name on the sum of
+ *  its first two characters, by GUID on the top bits of a * 19. The slots
+ *  were chosen so that no two entries collide, check them when adding one.
+ */
+static const struct {
+	const char *name;
+	efi_guid guid;
+} known_guids[] = {
+	{ "global",	{ 0x8be4df61, 0x93ca, 0x11d2, 0x0daa,
+			  { 0x00, 0xe0, 0x98, 0x03, 0x2b, 0x8c } } },
+	{ "security",	{ 0xd719b2cb, 0x3d3a, 0x4596, 0xbca3,
+			  { 0xda, 0xd0, 0x0e, 0x67, 0x65, 0x6f } } },
+	{ "shim",	{ 0x605dab50, 0xe046, 0x4300, 0xb6ab,
+			  { 0x3d, 0xd8, 0x10, 0xdd, 0x8b, 0x23 } } },
+	{ "hwerr",	{ 0x414e6bdd, 0xe47b, 0x47cc, 0x44b2,
+			  { 0xbb, 0x61, 0x02, 0x0c, 0xf5, 0x16 } } },
+	{ "microsoft",	{ 0x77fa9abd, 0x0359, 0x4d32, 0x60bd,
+			  { 0x28, 0xf4, 0xe7, 0x8f, 0x78, 0x4b } } },
+	{ "systemd",	{ 0x4a67b082, 0x0a4c, 0x41cf, 0xc7b6,
+			  { 0x44, 0x0b, 0x29, 0xbb, 0x8c, 0x4f } } },
+	{ "capsule",	{ 0x39b68c46, 0xf7fb, 0x441b, 0xecb6,
+			  { 0x16, 0xb0, 0xf6, 0x98, 0x21, 0xf3 } } },
+	{ "fwupd",	{ 0x0abba7dc, 0xe516, 0x4167, 0xf5bb,
+			  { 0x4d, 0x9d, 0x1c, 0x73, 0x94, 0x16 } } },
+};
+
+/* index + 1 into known_guids[], 0 for an empty slot */
+static const uint8_t known_by_name[16] = {
+	[3] = 1, [8] = 2, [11] = 3, [15] = 4, [6] = 5, [12] = 6, [4] = 7,
+	[13] = 8,
+};
+static const uint8_t known_by_guid[16] = {
+	[6] = 1, [15] = 2, [2] = 3, [13] = 4, [14] = 5, [8] = 6, [4] = 7,
+	[12] = 8,
+};
+
+static int known_guid(const char *name, size_t len, efi_guid *guid)
+{
+	unsigned int i;
+
+	if (len < 2)
+		return -1;
+	i = known_by_name[((uint8_t)name[0] + (uint8_t)name[1]) & 15];
+	if (!i || strncmp(known_guids[i - 1].name, name, len) ||
+	    known_guids[i - 1].name[len])
+		return -1;
+	*guid = known_guids[i - 1].guid;
+
+	return 0;
+}
+
+const char *guid_name(const efi_guid *guid)
+{
+	unsigned int i = known_by_guid[(guid->a * 19) >> 28];
+
+	if (!i || memcmp(&known_guids[i - 1].guid, guid, sizeof(*guid)))
+		return NULL;
+
+	return known_guids[i - 1].name;
+}
+
+/* digits hex digits, or -1 in the top bits if one is not */
+static inline int64_t read_hex(const char *s, int digits)
 {
+	int64_t v = 0, bad = 0;
 	int i;
-	char bytes_8[9] = "";
-	char bytes_4[5] = "";
-	char bytes_2[3] = "";
-	size_t slen = strlen(str);
-	size_t guidlen = strlen("12345678-1234-1234-1234-112233445566");
-
-	if (slen == guidlen + 2) {
-		if (str[0] != '{' || str[slen - 1] != '}') {
-			return -1;
-		}
-		str++;
-		slen -= 2;
+
+	for (i = 0; i < digits; i++) {
+		uint8_t x = hex_table[(uint8_t)s[i]];
+
+		bad |= x == 0;
+		v = v << 4 | ((x - 1) & 0x0f);
 	}
 
-	if (slen != guidlen)
-		return -1;
+	return bad ? -1 : v;
+}
+
+static int parse_guid(const char *str, size_t len, efi_guid *guid)
+{
+	int64_t a, b, c, d, e1, e2;
+
+	if (len == 38 && str[0] == '{' && str[37] == '}') {
+		str++;
+		len -= 2;
+	}
+	if (len != 36)
+		return known_guid(str, len, guid);
 
 	if (str[8] != '-' || str[13] != '-' || str[18] != '-' ||
-			str[23] != '-')
+	    str[23] != '-')
 		return -1;
-
-	strncpy(bytes_8, str, 8);
-	if (check_segment(bytes_8, 8) < 0)
+	a = read_hex(str, 8);
+	b = read_hex(str + 9, 4);
+	c = read_hex(str + 14, 4);
+	d = read_hex(str + 19, 4);
+	e1 = read_hex(str + 24, 4);
+	e2 = read_hex(str + 28, 8);
+	if ((a | b | c | d | e1 | e2) < 0)
 		return -1;
-	guid->a = (uint32_t)strtoul(bytes_8, NULL, 16);
 
-	strncpy(bytes_4, str + 9, 4);
-	if (check_segment(bytes_4, 4) < 0)
-		return -1;
-	guid->b = (uint16_t)strtoul(bytes_4, NULL, 16);
+	guid->a = a;
+	guid->b = b;
+	guid->c = c;
+	guid->d = bswap_16(d);
+	guid->e[0] = e1 >> 8;
+	guid->e[1] = e1;
+	guid->e[2] = e2 >> 24;
+	guid->e[3] = e2 >> 16;
+	guid->e[4] = e2 >> 8;
+	guid->e[5] = e2;
 
-	strncpy(bytes_4, str + 14, 4);
-	if (check_segment(bytes_4, 4) < 0)
-		return -1;
-	guid->c = (uint16_t)strtoul(bytes_4, NULL, 16);
+	return 0;
+}
 
-	strncpy(bytes_4, str + 19, 4);
-	if (check_segment(bytes_4, 4) < 0)
+int string_to_guid(const char *str, efi_guid *guid)
+{
+	return parse_guid(str, strlen(str), guid);
+}
+
+int parse_var_spec(const char *spec, efi_guid *guid, const char **name)
+{
+	const char *colon = strchr(spec, ':');
+
+	if (!colon || !colon[1] || parse_guid(spec, colon - spec, guid))
 		return -1;
-	guid->d = bswap_16((uint16_t)strtoul(bytes_4, NULL, 16));
+	*name = colon + 1;
 
-	for (i = 0 ; i < 6 ; i++) {
-		strncpy(bytes_2, str + 24 + (2 * i), 2);
-		if (check_segment(bytes_2, 2) < 0)
-			return -1;
-		guid->e[i] = (uint8_t)strtoul(bytes_2, NULL, 16);
+	return 0;
+}
+
+int parse_size(const char *str, uint64_t *size)
+{
+	unsigned long long n;
+	char *end;
+	int shift = 0;
+
+	errno = 0;
+	n = strtoull(str, &end, 0);
+	if (errno || end == str || *str == '-')
+		return -1;
+	switch (*end) {
+	case 'K': case 'k':
+		shift = 10;
+		break;
+	case 'M': case 'm':
+		shift = 20;
+		break;
+	case 'G': case 'g':
+		shift = 30;
+		break;
+	case '\0':
+		break;
+	default:
+		return -1;
 	}
+	if (shift && (*++end || n > UINT64_MAX >> shift))
+		return -1;
+	*size = (uint64_t)n << shift;
+
 	return 0;
 }
 
-void str_to_ucs(uint16_t *des, const char *str, size_t len)
+static inline void put_hex(char *s, uint32_t v, int digits)
+{
+	while (digits--) {
+		s[digits] = hex_digits[v & 0x0f];
+		v >>= 4;
+	}
+}
+
+void guid_to_string(const efi_guid *guid, char *str)
+{
+	const uint8_t *d = (const uint8_t *)&guid->d;
+	const uint8_t *e = guid->e;
+
+	put_hex(str, guid->a, 8);
+	str[8] = '-';
+	put_hex(str + 9, guid->b, 4);
+	str[13] = '-';
+	put_hex(str + 14, guid->c, 4);
+	str[18] = '-';
+	put_hex(str + 19, d[0] << 8 | d[1], 4);
+	str[23] = '-';
+	put_hex(str + 24, e[0] << 8 | e[1], 4);
+	put_hex(str + 28, (uint32_t)e[2] << 24 | e[3] << 16 | e[4] << 8 | e[5],
+		8);
+	str[36] = '\0';
+}
+
+/* 64 bit FNV-1a, chain calls by passing the previous hash as the seed */
+uint64_t hash64(const void *data, size_t len, uint64_t seed)
 {
+	const uint8_t *p = data;
+	uint64_t hash = seed;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ *  Hex codec for variable payloads. The SIMD paths convert whole blocks
+ *  of bytes at a time and leave the tail, and anything that is not a
+ *  plain run of hex digits, to the table driven scalar code.
+ */
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+
+static inline __m128i sse2_hex_chars(__m128i n)
+{
+	__m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+	n = _mm_add_epi8(n, _mm_set1_epi8('0'));
+	return _mm_add_epi8(n, _mm_and_si128(letter,
+		_mm_set1_epi8('a' - '0' - 10)));
+}
+
+static size_t sse2_hex_encode(char *dst, const uint8_t *src, size_t len)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
 	size_t i;
-	for (i = 0; i < len; i++)
-		des[i] = (uint16_t)str[i];
-	des[i] = 0;
 
-	return;
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+
+		hi = sse2_hex_chars(hi);
+		lo = sse2_hex_chars(lo);
+		_mm_storeu_si128((__m128i *)(dst + 2 * i),
+			_mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 16),
+			_mm_unpackhi_epi8(hi, lo));
+	}
+
+	return i;
 }
 
-void ucs_to_str(char *des, const uint16_t *str, size_t len)
+/* nibble values of 16 hex digits, false if any is not a hex digit */
+static inline bool sse2_hex_values(__m128i c, __m128i *val)
+{
+	__m128i lc = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(
+		_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+		_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(
+		_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+		_mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+
+	*val = _mm_or_si128(
+		_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+		_mm_and_si128(alpha, _mm_sub_epi8(lc, _mm_set1_epi8('a' - 10))));
+
+	return _mm_movemask_epi8(_mm_or_si128(digit, alpha)) == 0xffff;
+}
+
+/* pairs of nibbles, the first one in the low byte of each word, to bytes */
+static inline __m128i sse2_hex_pairs(__m128i v)
+{
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), 4),
+		_mm_srli_epi16(v, 8));
+}
+
+static size_t sse2_hex_decode(uint8_t *dst, const char *src, size_t len)
 {
 	size_t i;
-	for (i = 0; i < (len/2 - 1); i++)
-		des[i] = (char)str[i];
-	des[i] = 0;
 
-	return;
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m128i a, b;
+
+		if (!sse2_hex_values(_mm_loadu_si128((const __m128i *)(src + i)),
+				&a) ||
+		    !sse2_hex_values(_mm_loadu_si128((const __m128i *)(src + i + 16)),
+				&b))
+			break;
+		_mm_storeu_si128((__m128i *)(dst + i / 2),
+			_mm_packus_epi16(sse2_hex_pairs(a), sse2_hex_pairs(b)));
+	}
+
+	return i;
 }
 
-static int check_device(char *devname)
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HEX_AVX2
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_hex_chars(__m256i n)
 {
-	struct stat statbuf;
+	__m256i letter = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
 
-	if (stat(devname, &statbuf))
-		return UEFIOP_ERROR;
+	n = _mm256_add_epi8(n, _mm256_set1_epi8('0'));
+	return _mm256_add_epi8(n, _mm256_and_si256(letter,
+		_mm256_set1_epi8('a' - '0' - 10)));
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_hex_encode(char *dst, const uint8_t *src, size_t len)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i;
 
-	if (S_ISCHR(statbuf.st_mode)) {
-		efi_dev_name = devname;
-		return UEFIOP_OK;
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i hi = avx2_hex_chars(
+			_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		__m256i lo = avx2_hex_chars(_mm256_and_si256(v, mask));
+		/* the unpacks work within each 128 bit lane */
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i),
+			_mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i + 32),
+			_mm256_permute2x128_si256(a, b, 0x31));
 	}
-	return UEFIOP_ERROR;
+
+	return i;
 }
 
-static int check_module_loaded(
-	char *module,
-	bool *loaded)
+__attribute__((target("avx2")))
+static inline bool avx2_hex_values(__m256i c, __m256i *val)
 {
-	FILE *fp;
+	__m256i lc = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+	__m256i digit = _mm256_and_si256(
+		_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+	__m256i alpha = _mm256_and_si256(
+		_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lc));
+
+	*val = _mm256_or_si256(
+		_mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+		_mm256_and_si256(alpha,
+			_mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10))));
+
+	return _mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) == -1;
+}
 
-	*loaded = false;
+__attribute__((target("avx2")))
+static inline __m256i avx2_hex_pairs(__m256i v)
+{
+	return _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_and_si256(v,
+			_mm256_set1_epi16(0x00ff)), 4),
+		_mm256_srli_epi16(v, 8));
+}
 
-	if ((fp = fopen("/proc/modules", "r")) != NULL) {
-		char buffer[1024];
+__attribute__((target("avx2")))
+static size_t avx2_hex_decode(uint8_t *dst, const char *src, size_t len)
+{
+	size_t i;
 
-		while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-			if (strstr(buffer, module)) {
-				*loaded = true;
-				break;
-			}
-		}
-		(void)fclose(fp);
-		return UEFIOP_OK;
+	for (i = 0; i + 64 <= len; i += 64) {
+		__m256i a, b;
+
+		if (!avx2_hex_values(_mm256_loadu_si256((const __m256i *)(src + i)),
+				&a) ||
+		    !avx2_hex_values(_mm256_loadu_si256((const __m256i *)(src + i + 32)),
+				&b))
+			break;
+		/* the pack works within each 128 bit lane too */
+		_mm256_storeu_si256((__m256i *)(dst + i / 2),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(avx2_hex_pairs(a),
+					avx2_hex_pairs(b)),
+				_MM_SHUFFLE(3, 1, 2, 0)));
 	}
-	printf("Could not open /proc/modules to check if efi module '%s' is loaded.\n", module);
 
-	return UEFIOP_ERROR;
+	return i;
 }
+#endif
 
+static size_t simd_hex_encode(char *dst, const uint8_t *src, size_t len)
+{
+	size_t done = 0;
 
-static int check_module_loaded_no_dev(char *module)
+#ifdef HEX_AVX2
+	if (len >= 32 && __builtin_cpu_supports("avx2"))
+		done = avx2_hex_encode(dst, src, len);
+#endif
+	return done + sse2_hex_encode(dst + 2 * done, src + done, len - done);
+}
+
+/* returns the number of characters decoded, a multiple of 32 */
+static size_t simd_hex_decode(uint8_t *dst, const char *src, size_t len)
 {
-	bool loaded;
+	size_t done = 0;
 
-	if (check_module_loaded(module, &loaded) != UEFIOP_OK)
-		return UEFIOP_OK;
-	if (loaded) {
-		printf("Module '%s' is already loaded, but device not available.\n", module);
-		return UEFIOP_ERROR;
+#ifdef HEX_AVX2
+	if (len >= 64 && __builtin_cpu_supports("avx2")) {
+		done = avx2_hex_decode(dst, src, len);
+		if (done + 64 <= len)
+			return done;	/* stopped at a non hex digit */
 	}
-	return UEFIOP_OK;
+#endif
+	return done + sse2_hex_decode(dst + done / 2, src + done, len - done);
 }
 
-static int uefiop_exec(const char *command)
+#elif defined(__aarch64__)
+
+static size_t simd_hex_encode(char *dst, const uint8_t *src, size_t len)
 {
-	pid_t pid;
+	const uint8x16_t digits = vld1q_u8((const uint8_t *)hex_digits);
+	const uint8x16_t mask = vdupq_n_u8(0x0f);
+	size_t i;
 
-	pid = fork();
-	switch (pid) {
-	case -1:
-		/* Ooops */
-		return UEFIOP_ERROR;
-	case 0:
-		/* Child */
-		execl(_PATH_BSHELL, "sh", "-c", command, NULL);
-		_exit(UEFIOP_ERROR);
-	default:
-		/* Parent */
-		wait(NULL);
-		return UEFIOP_OK;
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+		uint8x16x2_t out;
+
+		out.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+		out.val[1] = vqtbl1q_u8(digits, vandq_u8(v, mask));
+		vst2q_u8((uint8_t *)dst + 2 * i, out);
 	}
+
+	return i;
 }
 
-static int load_module(
-	char *module,
-	char *devname)
+/* nibble values of 16 hex digits, ok cleared where there is none */
+static inline uint8x16_t neon_hex_values(uint8x16_t c, uint8x16_t *ok)
 {
-	char cmd[80];
-	bool loaded;
+	uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+	uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)),
+		vdupq_n_u8('a'));
+	uint8x16_t isdigit = vcltq_u8(digit, vdupq_n_u8(10));
+	uint8x16_t isalpha = vcltq_u8(alpha, vdupq_n_u8(6));
+
+	*ok = vandq_u8(*ok, vorrq_u8(isdigit, isalpha));
+	return vbslq_u8(isdigit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
 
-	snprintf(cmd, sizeof(cmd), "modprobe %s", module);
+static size_t simd_hex_decode(uint8_t *dst, const char *src, size_t len)
+{
+	size_t i;
 
-	if (uefiop_exec(cmd) != UEFIOP_OK)
-		return UEFIOP_ERROR;
+	for (i = 0; i + 32 <= len; i += 32) {
+		uint8x16x2_t c = vld2q_u8((const uint8_t *)src + i);
+		uint8x16_t ok = vdupq_n_u8(0xff);
+		uint8x16_t hi = neon_hex_values(c.val[0], &ok);
+		uint8x16_t lo = neon_hex_values(c.val[1], &ok);
 
-	if (check_module_loaded(module, &loaded) != UEFIOP_OK)
-		return UEFIOP_ERROR;
+		if (vminvq_u8(ok) != 0xff)
+			break;
+		vst1q_u8(dst + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
 
-	if (!loaded)
-		return UEFIOP_ERROR;
+	return i;
+}
 
-	if (check_device(devname) != UEFIOP_OK)
-		return UEFIOP_ERROR;
+#else
 
-	module_name = module;
+static size_t simd_hex_encode(char *dst, const uint8_t *src, size_t len)
+{
+	return 0;
+}
 
-	return UEFIOP_OK;
+static size_t simd_hex_decode(uint8_t *dst, const char *src, size_t len)
+{
+	return 0;
 }
 
+#endif
 
-static int lib_load_module()
+size_t hex_encode(char *dst, const void *src, size_t len)
 {
-	efi_dev_name = NULL;
-	module_name = NULL;
+	const uint8_t *p = src;
+	size_t i;
 
-	/* Check if dev is already available */
-	if (check_device("/dev/efi_runtime") == UEFIOP_OK)
-		return UEFIOP_OK;
-	if (check_device("/dev/efi_test") == UEFIOP_OK)
-		return UEFIOP_OK;
+	for (i = simd_hex_encode(dst, p, len); i < len; i++) {
+		dst[2 * i] = hex_digits[p[i] >> 4];
+		dst[2 * i + 1] = hex_digits[p[i] & 0x0f];
+	}
+	dst[2 * len] = '\0';
 
-	/* Since the devices can't be found, the module should be not loaded */
-	if (check_module_loaded_no_dev("efi_runtime") != UEFIOP_OK)
-		return UEFIOP_ERROR;
-	if (check_module_loaded_no_dev("efi_test") != UEFIOP_OK)
-		return UEFIOP_ERROR;
+	return 2 * len;
+}
 
-	/* Now try to load the module */
+ssize_t hex_decode(uint8_t *dst, const char *src, size_t len)
+{
+	size_t i = 0, n = 0, next_simd = 0;
+	int hi = -1;
+
+	while (i < len) {
+		uint8_t c, v;
+
+		/*
+		 *  Try the vector path on each byte boundary, backing off
+		 *  for a block when it finds a separator there, so that
+		 *  "11 22 33" style data does not pay for it on every byte.
+		 */
+		if (hi < 0 && i >= next_simd) {
+			size_t done = simd_hex_decode(dst + n, src + i, len - i);
+
+			i += done;
+			n += done / 2;
+			next_simd = i + 32;
+			if (i == len)
+				break;
+		}
 
-	if (load_module("efi_runtime", "/dev/efi_runtime") == UEFIOP_OK)
-		return UEFIOP_OK;
-	if (load_module("efi_test", "/dev/efi_test") == UEFIOP_OK)
-		return UEFIOP_OK;
+		/* separators only go between bytes, never inside one */
+		c = src[i++];
+		if (c == ' ' || c == '\t' || c == ',') {
+			if (hi >= 0)
+				return -1;
+			continue;
+		}
+		v = hex_table[c];
+		if (!v)
+			return -1;
+		if (hi < 0) {
+			hi = v - 1;
+		} else {
+			dst[n++] = hi << 4 | (v - 1);
+			hi = -1;
+		}
+	}
+	if (hi >= 0)
+		return -1;
 
-	printf("Failed to load efi runtime module.\n");
-	return UEFIOP_ERROR;
+	return n;
 }
 
-static int lib_unload_module()
+/* 16 bytes a line, in the layout of hexdump -C */
+#define HEXDUMP_LINE	86
+
+static size_t hexdump_line(char *buf, const uint8_t *p, size_t n,
+	size_t offset)
 {
-	bool loaded;
-	int status;
-	char cmd[80], *tmp_name = module_name;
+	char *s = buf;
+	int shift;
+	size_t i;
 
-	efi_dev_name = NULL;
+	for (shift = (uint64_t)offset >> 32 ? 60 : 28; shift >= 0; shift -= 4)
+		*s++ = hex_digits[((uint64_t)offset >> shift) & 0x0f];
+	*s++ = ' ';
+	for (i = 0; i < 16; i++) {
+		if (i == 8)
+			*s++ = ' ';
+		*s++ = ' ';
+		if (i < n) {
+			*s++ = hex_digits[p[i] >> 4];
+			*s++ = hex_digits[p[i] & 0x0f];
+		} else {
+			*s++ = ' ';
+			*s++ = ' ';
+		}
+	}
+	*s++ = ' ';
+	*s++ = ' ';
+	*s++ = '|';
+	for (i = 0; i < n; i++)
+		*s++ = p[i] >= 0x20 && p[i] < 0x7f ? p[i] : '.';
+	*s++ = '|';
+	*s++ = '\n';
+
+	return s - buf;
+}
 
-	/* No module, not much to do */
-	if (!module_name)
-		return UEFIOP_OK;
+int hexdump(FILE *fp, const void *data, size_t len)
+{
+	char buf[HEXDUMP_LINE * 64];
+	const uint8_t *p = data;
+	size_t off = 0, used = 0;
+
+	while (off < len) {
+		size_t n = len - off < 16 ? len - off : 16;
+
+		used += hexdump_line(buf + used, p + off, n, off);
+		off += n;
+		if (used + HEXDUMP_LINE > sizeof(buf) || off == len) {
+			if (fwrite(buf, 1, used, fp) != used)
+				return UEFIOP_ERROR;
+			used = 0;
+		}
+	}
 
-	module_name = NULL;
+	return UEFIOP_OK;
+}
 
-	/* If it is not loaded, no need to unload it */
-	if (check_module_loaded(tmp_name, &loaded) != UEFIOP_OK)
+/*
+ *  Regular files are mapped, so a payload goes from the page cache to the
+ *  driver without a copy. Pipes, stdin and files that do not know their
+ *  size, such as those in sysfs, are read until EOF.
+ */
+int payload_load(const char *path, payload *p)
+{
+	struct stat statbuf;
+	size_t alloc = 0;
+	uint8_t *buf;
+	int fd, err;
+
+	memset(p, 0, sizeof(*p));
+	if (!strcmp(path, "-"))
+		fd = STDIN_FILENO;
+	else
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
 		return UEFIOP_ERROR;
-	if (!loaded)
-		return UEFIOP_OK;
+	if (fstat(fd, &statbuf))
+		goto error;
+
+	if (S_ISREG(statbuf.st_mode) && statbuf.st_size > 0) {
+		buf = mmap(NULL, statbuf.st_size, PROT_READ,
+			MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (buf != MAP_FAILED) {
+			p->data = buf;
+			p->size = statbuf.st_size;
+			p->mapped = true;
+			goto out;
+		}
+	}
 
-	snprintf(cmd, sizeof(cmd), "modprobe -r %s", tmp_name);
-	if (uefiop_exec(cmd) != UEFIOP_OK) {
-		printf("Failed to unload module '%s'.\n", tmp_name);
-		return UEFIOP_ERROR;
+	for (;;) {
+		ssize_t n;
+
+		if (p->size == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			buf = realloc(p->data, alloc);
+			if (!buf)
+				goto error;
+			p->data = buf;
+		}
+		n = read(fd, p->data + p->size, alloc - p->size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+		if (n == 0)
+			break;
+		p->size += n;
 	}
 
-	/* Module should not be loaded at this point */
-	if (check_module_loaded(tmp_name, &loaded) != UEFIOP_OK)
-		return UEFIOP_ERROR;
-	if (loaded) {
-		printf("Failed to unload module '%s'.\n", tmp_name);
-		return UEFIOP_ERROR;
+out:
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return UEFIOP_OK;
+
+error:
+	err = errno;
+	if (fd != STDIN_FILENO)
+		close(fd);
+	payload_free(p);
+	errno = err;
+	return UEFIOP_ERROR;
+}
+
+void payload_free(payload *p)
+{
+	if (p->mapped)
+		munmap(p->data, p->size);
+	else
+		free(p->data);
+	memset(p, 0, sizeof(*p));
+}
+
+int write_iov(int fd, struct iovec *iov, int cnt)
+{
+	while (cnt) {
+		ssize_t n = writev(fd, iov, cnt);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (n == 0)
+				errno = EIO;
+			return UEFIOP_ERROR;
+		}
+		/* skip what was written, in case of a short write */
+		while (cnt && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (uint8_t *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
 	}
 
 	return UEFIOP_OK;
 }
 
-static int lib_efi_runtime_open(void)
+/*
+ *  Variable names are UCS-2 and the tools talk UTF-8. Runs of ASCII, all
+ *  of most names, are widened or narrowed a block at a time. Surrogates,
+ *  which UCS-2 does not have but a firmware may still hold in a name, are
+ *  encoded as 3 byte sequences of their own, so every name round trips.
+ */
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+
+static size_t simd_ascii_widen(uint16_t *dst, const uint8_t *src, size_t len)
 {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
 
-	if (!efi_dev_name)
-		return -1;
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
 
-	return open(efi_dev_name, O_WRONLY | O_RDWR);
+		if (_mm_movemask_epi8(v))
+			break;
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(dst + i + 8),
+			_mm_unpackhi_epi8(v, zero));
+	}
+
+	return i;
 }
 
-static int lib_efi_runtime_close(int fd)
+static size_t simd_ascii_narrow(uint8_t *dst, const uint16_t *src, size_t len)
 {
-	return close(fd);
+	const __m128i high = _mm_set1_epi16((short)0xff80);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+		__m128i h = _mm_and_si128(_mm_or_si128(a, b), high);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(h,
+				_mm_setzero_si128())) != 0xffff)
+			break;
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+	}
+
+	return i;
 }
 
-int init_driver(void)
+#elif defined(__aarch64__)
+
+static size_t simd_ascii_widen(uint16_t *dst, const uint8_t *src, size_t len)
 {
+	size_t i;
 
-	int fd;
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
 
-	if (lib_load_module() != UEFIOP_OK) {
-		printf("Cannot load efi runtime module. Aborted.\n");
-		return UEFIOP_ERROR;
+		if (vmaxvq_u8(v) & 0x80)
+			break;
+		vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+		vst1q_u16(dst + i + 8, vmovl_high_u8(v));
 	}
 
-	fd = lib_efi_runtime_open();
-	if (fd == -1) {
-		printf("Cannot open efi runtime driver. Aborted.\n");
-		return UEFIOP_ERROR;
+	return i;
+}
+
+static size_t simd_ascii_narrow(uint8_t *dst, const uint16_t *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint16x8_t a = vld1q_u16(src + i);
+		uint16x8_t b = vld1q_u16(src + i + 8);
+
+		if (vmaxvq_u16(vorrq_u16(a, b)) >= 0x80)
+			break;
+		vst1q_u8(dst + i, vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
 	}
 
-	return fd;
+	return i;
+}
+
+#else
+
+static size_t simd_ascii_widen(uint16_t *dst, const uint8_t *src, size_t len)
+{
+	return 0;
+}
+
+static size_t simd_ascii_narrow(uint8_t *dst, const uint16_t *src, size_t len)
+{
+	return 0;
 }
 
-void deinit_driver(int fd)
+#endif
+
+size_t ucs2_len(const uint16_t *str)
 {
-	if (fd != -1)
-		lib_efi_runtime_close(fd);
-	lib_unload_module();
+	size_t len = 0;
+
+	while (str[len])
+		len++;
+
+	return len;
+}
+
+ssize_t utf8_to_ucs2(uint16_t *dst, const char *src, size_t len)
+{
+	const uint8_t *s = (const uint8_t *)src;
+	size_t i = 0, n = 0;
+
+	while (i < len) {
+		uint32_t c = s[i];
+
+		if (c < 0x80) {
+			size_t done = 0;
+
+			if (len - i >= 16)
+				done = simd_ascii_widen(dst + n, s + i, len - i);
+			if (!done) {
+				dst[n++] = c;
+				i++;
+			} else {
+				n += done;
+				i += done;
+			}
+		} else if (c >= 0xc2 && c <= 0xdf && i + 1 < len &&
+			   (s[i + 1] & 0xc0) == 0x80) {
+			dst[n++] = (c & 0x1f) << 6 | (s[i + 1] & 0x3f);
+			i += 2;
+		} else if ((c & 0xf0) == 0xe0 && i + 2 < len &&
+			   (s[i + 1] & 0xc0) == 0x80 &&
+			   (s[i + 2] & 0xc0) == 0x80) {
+			c = (c & 0x0f) << 12 | (s[i + 1] & 0x3f) << 6 |
+				(s[i + 2] & 0x3f);
+			if (c < 0x800)
+				return -1;	/* overlong */
+			dst[n++] = c;
+			i += 3;
+		} else {
+			/* not UTF-8, or beyond what UCS-2 holds */
+			return -1;
+		}
+	}
+	dst[n] = 0;
+
+	return n;
+}
+
+size_t ucs2_to_utf8(char *dst, const uint16_t *src, size_t len)
+{
+	uint8_t *d = (uint8_t *)dst;
+	size_t i = 0, n = 0;
+
+	while (i < len) {
+		uint16_t c = src[i];
+
+		if (c < 0x80) {
+			size_t done = 0;
+
+			if (len - i >= 16)
+				done = simd_ascii_narrow(d + n, src + i, len - i);
+			if (!done) {
+				d[n++] = c;
+				i++;
+			} else {
+				n += done;
+				i += done;
+			}
+			continue;
+		}
+		if (c < 0x800) {
+			d[n++] = 0xc0 | c >> 6;
+		} else {
+			d[n++] = 0xe0 | c >> 12;
+			d[n++] = 0x80 | ((c >> 6) & 0x3f);
+		}
+		d[n++] = 0x80 | (c & 0x3f);
+		i++;
+	}
+	d[n] = '\0';
+
+	return n;
 }
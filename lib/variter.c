@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "uefiop.h"
+#include "variter.h"
+#include "utils.h"
+
+#define NAME_SIZE	1024
+
+struct variter {
+	uefiop_ctx *ctx;
+	unsigned int flags;
+	variter_filter filter;
+	void *filter_arg;
+	variter_match match;
+	EFI_GUID match_guid;
+	bool has_match;
+	char *utf8;		/* the name, for the glob */
+	size_t utf8_cap;
+	uint16_t *name;
+	uint64_t name_cap;	/* in bytes, of name and last */
+	EFI_GUID guid;
+	uint16_t *last;		/* the name the step started from */
+	EFI_GUID last_guid;
+	variter_var var;
+};
+
+variter *variter_new(uefiop_ctx *ctx, unsigned int flags)
+{
+	return variter_new_size(ctx, flags, NAME_SIZE);
+}
+
+variter *variter_new_size(uefiop_ctx *ctx, unsigned int flags,
+	uint64_t name_size)
+{
+	variter *it;
+
+	if (name_size < sizeof(uint16_t)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	it = calloc(1, sizeof(*it));
+	if (!it)
+		return NULL;
+	it->name = calloc(1, name_size);
+	it->last = calloc(1, name_size);
+	if (!it->name || !it->last) {
+		free(it->name);
+		free(it->last);
+		free(it);
+		return NULL;
+	}
+	it->name_cap = name_size;
+	it->ctx = ctx;
+	it->flags = flags;
+	it->var.name = it->name;
+	it->var.guid = &it->guid;
+
+	return it;
+}
+
+void variter_free(variter *it)
+{
+	if (!it)
+		return;
+	free(it->name);
+	free(it->last);
+	free(it->utf8);
+	free(it);
+}
+
+void variter_set_filter(variter *it, variter_filter filter, void *arg)
+{
+	it->filter = filter;
+	it->filter_arg = arg;
+}
+
+void variter_set_match(variter *it, const variter_match *match)
+{
+	it->has_match = match != NULL;
+	if (!match)
+		return;
+	it->match = *match;
+	if (match->guid) {
+		memcpy(&it->match_guid, match->guid, sizeof(EFI_GUID));
+		it->match.guid = &it->match_guid;
+	}
+}
+
+bool variter_match_probes(const variter_match *match)
+{
+	return match && (match->attr || match->min_size || match->max_size);
+}
+
+/* the first stage, nothing but the name and GUID to go by */
+static int match_name(variter *it, bool *matched)
+{
+	const variter_match *m = &it->match;
+	size_t len;
+
+	*matched = false;
+	if (m->guid && memcmp(m->guid, &it->guid, sizeof(EFI_GUID)))
+		return UEFIOP_OK;
+	if (m->name) {
+		len = ucs2_len(it->name);
+		if (len * 3 + 1 > it->utf8_cap) {
+			char *p = realloc(it->utf8, len * 3 + 1);
+
+			if (!p)
+				return UEFIOP_ERROR;
+			it->utf8 = p;
+			it->utf8_cap = len * 3 + 1;
+		}
+		ucs2_to_utf8(it->utf8, it->name, len);
+		if (fnmatch(m->name, it->utf8, 0))
+			return UEFIOP_OK;
+	}
+	*matched = true;
+
+	return UEFIOP_OK;
+}
+
+static bool match_size(variter *it)
+{
+	const variter_match *m = &it->match;
+
+	return (it->var.attr & m->attr) == m->attr &&
+		it->var.size >= m->min_size &&
+		(!m->max_size || it->var.size <= m->max_size);
+}
+
+static int grow_name(variter *it, uint64_t size)
+{
+	uint16_t *p;
+
+	if (size <= it->name_cap)
+		return UEFIOP_OK;
+	p = realloc(it->last, size);
+	if (!p)
+		return UEFIOP_ERROR;
+	it->last = p;
+	p = realloc(it->name, size);
+	if (!p)
+		return UEFIOP_ERROR;
+	it->name = p;
+	it->name_cap = size;
+	it->var.name = p;
+
+	return UEFIOP_OK;
+}
+
+int variter_seek(variter *it, const uint16_t *name, const EFI_GUID *guid)
+{
+	uint64_t size = (ucs2_len(name) + 1) * sizeof(uint16_t);
+
+	if (grow_name(it, size))
+		return UEFIOP_ERROR;
+	memcpy(it->name, name, size);
+	memcpy(&it->guid, guid, sizeof(*guid));
+
+	return UEFIOP_OK;
+}
+
+void variter_drop(variter *it)
+{
+	memcpy(it->name, it->last, (ucs2_len(it->last) + 1) * sizeof(uint16_t));
+	memcpy(&it->guid, &it->last_guid, sizeof(EFI_GUID));
+}
+
+uint64_t variter_next(variter *it, const variter_var **var)
+{
+	uint64_t status, size;
+	bool matched;
+
+	for (;;) {
+		/* a deleted name cannot be stepped from, keep the one before */
+		memcpy(it->last, it->name,
+			(ucs2_len(it->name) + 1) * sizeof(uint16_t));
+		memcpy(&it->last_guid, &it->guid, sizeof(EFI_GUID));
+		size = it->name_cap;
+		status = uefiop_get_next_variable_name(it->ctx, &size,
+			it->name, &it->guid);
+		/* the buffer still holds the previous name, ask again */
+		if (status == EFI_BUFFER_TOO_SMALL && size > it->name_cap) {
+			if (grow_name(it, size))
+				return EFI_OUT_OF_RESOURCES;
+			continue;
+		}
+		if (status != EFI_SUCCESS)
+			return status;
+
+		it->var.attr = 0;
+		it->var.size = 0;
+		if (it->has_match) {
+			if (match_name(it, &matched))
+				return EFI_OUT_OF_RESOURCES;
+			if (!matched)
+				continue;
+		}
+		if (it->filter && !it->filter(&it->var, it->filter_arg))
+			continue;
+
+		if ((it->flags & VARITER_PROBE) ||
+		    (it->has_match && variter_match_probes(&it->match))) {
+			size = 0;
+			status = uefiop_get_variable(it->ctx, it->name,
+				&it->guid, &it->var.attr, &size, NULL);
+			if (status == EFI_NOT_FOUND) {
+				variter_drop(it);	/* deleted in the meantime */
+				continue;
+			}
+			if (status != EFI_SUCCESS &&
+			    status != EFI_BUFFER_TOO_SMALL)
+				return status;
+			it->var.size = size;
+			if (it->has_match && !match_size(it))
+				continue;
+		}
+		*var = &it->var;
+
+		return EFI_SUCCESS;
+	}
+}
+
+int variter_walk(uefiop_ctx *ctx, unsigned int flags,
+	const variter_match *match, variter_filter filter, variter_cb cb,
+	void *arg, uint64_t *status)
+{
+	const variter_var *var;
+	variter *it;
+	int rc = 0;
+
+	*status = EFI_SUCCESS;
+	it = variter_new(ctx, flags);
+	if (!it) {
+		*status = EFI_OUT_OF_RESOURCES;
+		return UEFIOP_ERROR;
+	}
+	variter_set_match(it, match);
+	variter_set_filter(it, filter, arg);
+
+	while (!rc) {
+		*status = variter_next(it, &var);
+		if (*status == EFI_NOT_FOUND) {
+			*status = EFI_SUCCESS;
+			break;
+		}
+		if (*status != EFI_SUCCESS) {
+			rc = UEFIOP_ERROR;
+			break;
+		}
+		rc = cb(var, arg);
+	}
+	variter_free(it);
+
+	return rc;
+}
@@ -0,0 +1,833 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "uefiop.h"
+#include "varstore.h"
+#include "utils.h"
+
+/*
+ *  Layout of an NV variable store, as written by the EDK2 variable driver:
+ *
+ *    firmware volume header ("_FVH", file system guid EFI_SYSTEM_NV_DATA_FV)
+ *    variable store header (authenticated or plain variable guid)
+ *    variable records, each header 4 byte aligned:
+ *      header, UCS-2 name, data
+ *    erased space (0xff) up to the end of the store
+ *
+ *  Flash bits can only be cleared, so a record's state byte goes from
+ *  0xff to HEADER_VALID_ONLY, ADDED, then IN_DELETED_TRANSITION and
+ *  DELETED by clearing one more bit each time.
+ */
+
+#define FVH_SIGNATURE			0x4856465f	/* "_FVH" */
+#define FV_SCAN_STEP			0x1000
+#define FV_ATTRIBUTES			0x0004feff
+#define FV_REVISION			2
+#define VARSTORE_FORMATTED		0x5a
+#define VARSTORE_HEALTHY		0xfe
+#define VAR_START_ID			0x55aa
+#define VAR_HEADER_VALID_ONLY		0x7f
+#define VAR_ADDED			0x3f
+#define VAR_IN_DELETED_TRANSITION	0xfe
+#define VAR_DELETED			0xfd
+#define VAR_STATE_OFFSET		2
+#define HEADER_ALIGN(x)			(((x) + 3) & ~(size_t)3)
+
+static const EFI_GUID nv_fv_guid = { 0xfff12b8d, 0x7696, 0x4c8b,
+	{ 0xa9, 0x85, 0x27, 0x47, 0x07, 0x5b, 0x4f, 0x50 } };
+static const EFI_GUID auth_var_guid = { 0xaaf32c78, 0x947b, 0x439a,
+	{ 0xa1, 0x80, 0x2e, 0x14, 0x4e, 0xc3, 0x77, 0x92 } };
+static const EFI_GUID var_guid = { 0xddcf3616, 0x3275, 0x4164,
+	{ 0x98, 0xb6, 0xfe, 0x85, 0x70, 0x7f, 0xfe, 0x7d } };
+
+typedef struct {
+	uint8_t		zero_vector[16];
+	EFI_GUID	fs_guid;
+	uint64_t	length;
+	uint32_t	signature;
+	uint32_t	attributes;
+	uint16_t	header_length;
+	uint16_t	checksum;
+	uint16_t	ext_header_offset;
+	uint8_t		reserved;
+	uint8_t		revision;
+} __attribute__ ((packed)) fv_header;
+
+typedef struct {
+	EFI_GUID	signature;
+	uint32_t	size;
+	uint8_t		format;
+	uint8_t		state;
+	uint16_t	reserved;
+	uint32_t	reserved1;
+} __attribute__ ((packed)) store_header;
+
+typedef struct {
+	uint16_t	start_id;
+	uint8_t		state;
+	uint8_t		reserved;
+	uint32_t	attr;
+	uint32_t	name_size;
+	uint32_t	data_size;
+	EFI_GUID	guid;
+} __attribute__ ((packed)) var_header;
+
+typedef struct {
+	uint16_t	start_id;
+	uint8_t		state;
+	uint8_t		reserved;
+	uint32_t	attr;
+	uint64_t	monotonic_count;
+	EFI_TIME	timestamp;
+	uint32_t	pubkey_index;
+	uint32_t	name_size;
+	uint32_t	data_size;
+	EFI_GUID	guid;
+} __attribute__ ((packed)) auth_var_header;
+
+/* EFI_VARIABLE_AUTHENTICATION_2, up to the certificate data */
+typedef struct {
+	EFI_TIME	timestamp;
+	uint32_t	cert_length;	/* WIN_CERTIFICATE_UEFI_GUID, data included */
+	uint16_t	cert_revision;
+	uint16_t	cert_type;
+	EFI_GUID	cert_guid;
+} __attribute__ ((packed)) auth2_header;
+
+struct varstore {
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+	bool writable;
+	bool auth;		/* authenticated variable headers */
+	size_t hdr_size;	/* of a variable header */
+	size_t start;		/* of the first variable */
+	size_t end;		/* of the variable store */
+	size_t free;		/* first byte after the last variable */
+	size_t used;		/* bytes held by live variables */
+	varstore_var *vars;	/* every record, in image order */
+	size_t count;
+	size_t cap;
+	uint32_t *slots;	/* hash index, vars index + 1, 0 is empty */
+	size_t nslots;		/* a power of two */
+	size_t nused;
+};
+
+static size_t ucs_size(const uint16_t *name)
+{
+	size_t i;
+
+	for (i = 0; name[i]; i++)
+		;
+	return (i + 1) * sizeof(uint16_t);
+}
+
+static size_t record_size(varstore *vs, const varstore_var *var)
+{
+	return HEADER_ALIGN(vs->hdr_size + var->name_size + var->data_size);
+}
+
+static uint8_t var_state(varstore *vs, const varstore_var *var)
+{
+	return vs->map[var->offset + VAR_STATE_OFFSET];
+}
+
+static void clear_state(varstore *vs, const varstore_var *var, uint8_t mask)
+{
+	vs->map[var->offset + VAR_STATE_OFFSET] &= mask;
+}
+
+static uint32_t *index_slot(
+	varstore *vs,
+	const uint16_t *name,
+	size_t name_size,
+	const EFI_GUID *guid)
+{
+	size_t mask = vs->nslots - 1;
+	uint64_t hash;
+	size_t i;
+
+	hash = hash64(name, name_size, hash64(guid, sizeof(*guid), HASH64_SEED));
+	for (i = (hash ^ (hash >> 32)) & mask; ; i = (i + 1) & mask) {
+		varstore_var *var;
+
+		if (!vs->slots[i])
+			return &vs->slots[i];
+		var = &vs->vars[vs->slots[i] - 1];
+		if (var->name_size == name_size &&
+		    !memcmp(&var->guid, guid, sizeof(*guid)) &&
+		    !memcmp(var->name, name, name_size))
+			return &vs->slots[i];
+	}
+}
+
+/* index the live variables from scratch */
+static void index_fill(varstore *vs)
+{
+	size_t i;
+
+	memset(vs->slots, 0, vs->nslots * sizeof(*vs->slots));
+	vs->nused = 0;
+	for (i = 0; i < vs->count; i++) {
+		varstore_var *var = &vs->vars[i];
+
+		if (var->live) {
+			*index_slot(vs, var->name, var->name_size,
+				&var->guid) = i + 1;
+			vs->nused++;
+		}
+	}
+}
+
+/* rebuild the index with room for one more variable than is live */
+static int index_reserve(varstore *vs)
+{
+	uint32_t *old = vs->slots;
+	size_t nslots = vs->nslots ? vs->nslots : 64;
+	size_t live = 0, i;
+
+	if ((vs->nused + 1) * 2 <= vs->nslots)
+		return UEFIOP_OK;
+
+	for (i = 0; i < vs->count; i++)
+		live += vs->vars[i].live;
+	while ((live + 1) * 2 > nslots)
+		nslots *= 2;
+
+	vs->slots = calloc(nslots, sizeof(*vs->slots));
+	if (!vs->slots) {
+		vs->slots = old;
+		return UEFIOP_ERROR;
+	}
+	free(old);
+	vs->nslots = nslots;
+	index_fill(vs);
+
+	return UEFIOP_OK;
+}
+
+static int vars_reserve(varstore *vs)
+{
+	varstore_var *vars;
+	size_t cap;
+
+	if (vs->count < vs->cap)
+		return UEFIOP_OK;
+	cap = vs->cap ? vs->cap * 2 : 256;
+	vars = realloc(vs->vars, cap * sizeof(*vars));
+	if (!vars)
+		return UEFIOP_ERROR;
+	vs->vars = vars;
+	vs->cap = cap;
+
+	return UEFIOP_OK;
+}
+
+static int fv_checksum(const uint8_t *p, size_t len)
+{
+	uint16_t sum = 0, word;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		memcpy(&word, p + i, sizeof(word));
+		sum += word;
+	}
+	return sum;
+}
+
+/* find the variable store, in the first NV firmware volume of the image */
+static int find_store(varstore *vs)
+{
+	size_t off;
+
+	for (off = 0; off + sizeof(fv_header) <= vs->map_size;
+	     off += FV_SCAN_STEP) {
+		fv_header fv;
+		store_header sh;
+		size_t store;
+
+		memcpy(&fv, vs->map + off, sizeof(fv));
+		if (fv.signature != FVH_SIGNATURE ||
+		    memcmp(&fv.fs_guid, &nv_fv_guid, sizeof(nv_fv_guid)))
+			continue;
+		if (fv.length > vs->map_size - off ||
+		    fv.header_length < sizeof(fv) ||
+		    fv.header_length + sizeof(sh) > fv.length ||
+		    fv_checksum(vs->map + off, fv.header_length))
+			continue;
+
+		store = off + fv.header_length;
+		memcpy(&sh, vs->map + store, sizeof(sh));
+		if (!memcmp(&sh.signature, &auth_var_guid, sizeof(sh.signature)))
+			vs->auth = true;
+		else if (!memcmp(&sh.signature, &var_guid, sizeof(sh.signature)))
+			vs->auth = false;
+		else
+			continue;
+		if (sh.format != VARSTORE_FORMATTED ||
+		    sh.state != VARSTORE_HEALTHY ||
+		    sh.size < sizeof(sh) ||
+		    sh.size > fv.length - fv.header_length)
+			continue;
+
+		vs->hdr_size = vs->auth ? sizeof(auth_var_header) :
+			sizeof(var_header);
+		vs->start = HEADER_ALIGN(store + sizeof(sh));
+		vs->end = store + sh.size;
+		return UEFIOP_OK;
+	}
+
+	return UEFIOP_ERROR;
+}
+
+/* parse the record at off, returns false at the end of the records */
+static bool parse_record(varstore *vs, size_t off, varstore_var *var)
+{
+	uint32_t name_size, data_size;
+	size_t room;
+
+	if (off >= vs->end || vs->end - off < vs->hdr_size)
+		return false;
+
+	if (vs->auth) {
+		auth_var_header h;
+
+		memcpy(&h, vs->map + off, sizeof(h));
+		if (h.start_id != VAR_START_ID)
+			return false;
+		var->attr = h.attr;
+		var->guid = h.guid;
+		name_size = h.name_size;
+		data_size = h.data_size;
+	} else {
+		var_header h;
+
+		memcpy(&h, vs->map + off, sizeof(h));
+		if (h.start_id != VAR_START_ID)
+			return false;
+		var->attr = h.attr;
+		var->guid = h.guid;
+		name_size = h.name_size;
+		data_size = h.data_size;
+	}
+
+	room = vs->end - off - vs->hdr_size;
+	if (name_size > room || data_size > room - name_size)
+		return false;
+
+	var->offset = off;
+	var->name = (const uint16_t *)(vs->map + off + vs->hdr_size);
+	var->name_size = name_size;
+	var->data = vs->map + off + vs->hdr_size + name_size;
+	var->data_size = data_size;
+	var->live = false;
+
+	return true;
+}
+
+/*
+ *  Index the records of the store. A variable interrupted while being
+ *  updated has its old record IN_DELETED_TRANSITION, that record holds
+ *  until the new one is ADDED. Opening a store never writes to it, the
+ *  firmware finishes such updates itself on the next boot.
+ */
+static int load_records(varstore *vs)
+{
+	size_t off = vs->start;
+
+	for (;;) {
+		varstore_var *var, *old;
+		uint32_t *slot;
+		uint8_t state;
+
+		if (vars_reserve(vs) || index_reserve(vs))
+			return UEFIOP_ERROR;
+		var = &vs->vars[vs->count];
+		if (!parse_record(vs, off, var))
+			break;
+		vs->count++;
+		off = HEADER_ALIGN(off + vs->hdr_size + var->name_size +
+			var->data_size);
+
+		state = var_state(vs, var);
+		if (state != VAR_ADDED &&
+		    state != (VAR_ADDED & VAR_IN_DELETED_TRANSITION))
+			continue;
+		if (var->name_size < 2 * sizeof(uint16_t) ||
+		    var->name_size % sizeof(uint16_t) ||
+		    var->name[var->name_size / sizeof(uint16_t) - 1])
+			continue;
+
+		slot = index_slot(vs, var->name, var->name_size, &var->guid);
+		if (*slot) {
+			old = &vs->vars[*slot - 1];
+			if (old->live) {
+				if (state != VAR_ADDED &&
+				    var_state(vs, old) == VAR_ADDED)
+					continue;
+				old->live = false;
+				vs->used -= record_size(vs, old);
+			}
+		} else {
+			vs->nused++;
+		}
+		*slot = vs->count;
+		var->live = true;
+		vs->used += record_size(vs, var);
+	}
+	vs->free = off;
+
+	return UEFIOP_OK;
+}
+
+static int index_store(varstore *vs)
+{
+	if (vs->map_size < sizeof(fv_header) || find_store(vs)) {
+		errno = ENOEXEC;
+		return UEFIOP_ERROR;
+	}
+	if (load_records(vs)) {
+		errno = ENOMEM;
+		return UEFIOP_ERROR;
+	}
+
+	return UEFIOP_OK;
+}
+
+varstore *varstore_open(const char *path, bool writable)
+{
+	varstore *vs;
+	struct stat statbuf;
+	int err;
+
+	vs = calloc(1, sizeof(*vs));
+	if (!vs)
+		return NULL;
+	vs->writable = writable;
+
+	vs->fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (vs->fd == -1) {
+		err = errno;
+		free(vs);
+		errno = err;
+		return NULL;
+	}
+	if (fstat(vs->fd, &statbuf))
+		goto error;
+	if (statbuf.st_size == 0) {
+		errno = ENOEXEC;
+		goto error;
+	}
+
+	vs->map_size = statbuf.st_size;
+	vs->map = mmap(NULL, vs->map_size,
+		PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, vs->fd, 0);
+	if (vs->map == MAP_FAILED) {
+		vs->map = NULL;
+		goto error;
+	}
+
+	if (index_store(vs))
+		goto error;
+
+	return vs;
+
+error:
+	err = errno;
+	varstore_close(vs);
+	errno = err;
+	return NULL;
+}
+
+varstore *varstore_attach(void *buf, size_t size)
+{
+	varstore *vs;
+	int err;
+
+	vs = calloc(1, sizeof(*vs));
+	if (!vs)
+		return NULL;
+	vs->fd = -1;
+	vs->map = buf;
+	vs->map_size = size;
+	vs->writable = true;
+
+	if (index_store(vs)) {
+		err = errno;
+		varstore_close(vs);
+		errno = err;
+		return NULL;
+	}
+
+	return vs;
+}
+
+void varstore_close(varstore *vs)
+{
+	if (!vs)
+		return;
+
+	if (vs->fd != -1) {
+		if (vs->map) {
+			if (vs->writable)
+				msync(vs->map, vs->map_size, MS_SYNC);
+			munmap(vs->map, vs->map_size);
+		}
+		close(vs->fd);
+	}
+	free(vs->slots);
+	free(vs->vars);
+	free(vs);
+}
+
+bool varstore_authenticated(varstore *vs)
+{
+	return vs->auth;
+}
+
+const varstore_var *varstore_find(
+	varstore *vs,
+	const uint16_t *name,
+	const EFI_GUID *guid)
+{
+	uint32_t *slot;
+
+	if (!vs->nslots || !name[0])
+		return NULL;
+
+	slot = index_slot(vs, name, ucs_size(name), guid);
+	if (!*slot || !vs->vars[*slot - 1].live)
+		return NULL;
+
+	return &vs->vars[*slot - 1];
+}
+
+const varstore_var *varstore_next(varstore *vs, const varstore_var *var)
+{
+	size_t i = var ? (size_t)(var - vs->vars) + 1 : 0;
+
+	for (; i < vs->count; i++) {
+		if (vs->vars[i].live)
+			return &vs->vars[i];
+	}
+
+	return NULL;
+}
+
+static bool time_after(const EFI_TIME *a, const EFI_TIME *b)
+{
+	if (a->Year != b->Year)
+		return a->Year > b->Year;
+	if (a->Month != b->Month)
+		return a->Month > b->Month;
+	if (a->Day != b->Day)
+		return a->Day > b->Day;
+	if (a->Hour != b->Hour)
+		return a->Hour > b->Hour;
+	if (a->Minute != b->Minute)
+		return a->Minute > b->Minute;
+	if (a->Second != b->Second)
+		return a->Second > b->Second;
+	return a->Nanosecond > b->Nanosecond;
+}
+
+/* write a new record at the free offset, its state still HEADER_VALID_ONLY */
+static void write_record(
+	varstore *vs,
+	const uint16_t *name,
+	size_t name_size,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	const EFI_TIME *timestamp,
+	const varstore_var *old,
+	const uint8_t *data,
+	size_t size)
+{
+	uint8_t *p = vs->map + vs->free;
+	size_t data_size = size + (old ? old->data_size : 0);
+
+	if (vs->auth) {
+		auth_var_header h;
+
+		memset(&h, 0, sizeof(h));
+		h.start_id = VAR_START_ID;
+		h.state = VAR_HEADER_VALID_ONLY;
+		h.attr = attr;
+		h.timestamp = *timestamp;
+		h.name_size = name_size;
+		h.data_size = data_size;
+		h.guid = *guid;
+		memcpy(p, &h, sizeof(h));
+	} else {
+		var_header h;
+
+		memset(&h, 0, sizeof(h));
+		h.start_id = VAR_START_ID;
+		h.state = VAR_HEADER_VALID_ONLY;
+		h.attr = attr;
+		h.name_size = name_size;
+		h.data_size = data_size;
+		h.guid = *guid;
+		memcpy(p, &h, sizeof(h));
+	}
+	p += vs->hdr_size;
+	memcpy(p, name, name_size);
+	p += name_size;
+	if (old) {
+		memcpy(p, old->data, old->data_size);
+		p += old->data_size;
+	}
+	memcpy(p, data, size);
+}
+
+/*
+ *  SetVariable() on the image. Time based authenticated writes carry an
+ *  EFI_VARIABLE_AUTHENTICATION_2 descriptor; it is stripped and its time
+ *  stamp kept, the signature is not verified as the firmware would.
+ */
+uint64_t varstore_set(
+	varstore *vs,
+	const uint16_t *name,
+	const EFI_GUID *guid,
+	uint32_t attr,
+	size_t size,
+	const void *data)
+{
+	const uint8_t *payload = data;
+	bool append = attr & EFI_VARIABLE_APPEND_WRITE;
+	varstore_var *old = NULL, *var;
+	size_t name_size, rec_size;
+	EFI_TIME timestamp;
+	uint32_t *slot;
+
+	if (!vs->writable)
+		return EFI_WRITE_PROTECTED;
+
+	name_size = ucs_size(name);
+	attr &= ~EFI_VARIABLE_APPEND_WRITE;
+	if (name_size <= sizeof(uint16_t) || (size && !data))
+		return EFI_INVALID_PARAMETER;
+	if ((attr & EFI_VARIABLE_RUNTIME_ACCESS) &&
+	    !(attr & EFI_VARIABLE_BOOTSERVICE_ACCESS))
+		return EFI_INVALID_PARAMETER;
+	if (attr & EFI_VARIABLE_AUTHENTICATED_WRITE_ACCESS)
+		return EFI_UNSUPPORTED;
+
+	memset(&timestamp, 0, sizeof(timestamp));
+	if (attr & EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS) {
+		auth2_header a;
+
+		if (!vs->auth)
+			return EFI_INVALID_PARAMETER;
+		if (size < sizeof(a))
+			return EFI_SECURITY_VIOLATION;
+		memcpy(&a, data, sizeof(a));
+		if (a.cert_length < sizeof(a) - sizeof(EFI_TIME) ||
+		    a.cert_length > size - sizeof(EFI_TIME))
+			return EFI_SECURITY_VIOLATION;
+		timestamp = a.timestamp;
+		payload += sizeof(EFI_TIME) + a.cert_length;
+		size -= sizeof(EFI_TIME) + a.cert_length;
+	}
+
+	if (vars_reserve(vs) || index_reserve(vs))
+		return EFI_OUT_OF_RESOURCES;
+	slot = index_slot(vs, name, name_size, guid);
+	if (*slot && vs->vars[*slot - 1].live)
+		old = &vs->vars[*slot - 1];
+
+	if (append && size == 0)
+		return EFI_SUCCESS;
+
+	/* no data or no access attributes delete the variable */
+	if (!append && (size == 0 || !(attr & (EFI_VARIABLE_BOOTSERVICE_ACCESS |
+					      EFI_VARIABLE_RUNTIME_ACCESS)))) {
+		if (!old)
+			return EFI_NOT_FOUND;
+		clear_state(vs, old, VAR_DELETED);
+		old->live = false;
+		vs->used -= record_size(vs, old);
+		return EFI_SUCCESS;
+	}
+
+	if (old && old->attr != attr)
+		return EFI_INVALID_PARAMETER;
+	if (old && !append && old->data_size == size &&
+	    !memcmp(old->data, payload, size))
+		return EFI_SUCCESS;
+
+	if (old && append && vs->auth) {
+		auth_var_header h;
+
+		memcpy(&h, vs->map + old->offset, sizeof(h));
+		if (!time_after(&timestamp, &h.timestamp))
+			timestamp = h.timestamp;
+	}
+
+	if (size + (append && old ? old->data_size : 0) > UINT32_MAX)
+		return EFI_OUT_OF_RESOURCES;
+	rec_size = HEADER_ALIGN(vs->hdr_size + name_size + size +
+		(append && old ? old->data_size : 0));
+	if (rec_size > vs->end - vs->free) {
+		/* reclaim the space of dead records, as the firmware would */
+		if (rec_size > vs->end - vs->start - vs->used)
+			return EFI_OUT_OF_RESOURCES;
+		varstore_compact(vs);
+		slot = index_slot(vs, name, name_size, guid);
+		old = *slot ? &vs->vars[*slot - 1] : NULL;
+	}
+
+	if (old)
+		clear_state(vs, old, VAR_IN_DELETED_TRANSITION);
+	write_record(vs, name, name_size, guid, attr, &timestamp,
+		append ? old : NULL, payload, size);
+	vs->map[vs->free + VAR_STATE_OFFSET] &= VAR_ADDED;
+	if (old) {
+		clear_state(vs, old, VAR_DELETED);
+		old->live = false;
+		vs->used -= record_size(vs, old);
+	} else if (!*slot) {
+		vs->nused++;
+	}
+
+	var = &vs->vars[vs->count];
+	parse_record(vs, vs->free, var);
+	var->live = true;
+	*slot = ++vs->count;
+	vs->free += rec_size;
+	vs->used += rec_size;
+
+	return EFI_SUCCESS;
+}
+
+void varstore_usage(varstore *vs, size_t *total, size_t *used,
+	size_t *remaining)
+{
+	*total = vs->end - vs->start;
+	*used = vs->used;
+	*remaining = vs->end - vs->free;
+}
+
+/*
+ *  Lay out an empty variable store filling the whole of buf: one NV
+ *  firmware volume of 4K blocks holding a single variable store.
+ */
+int varstore_format(void *buf, size_t size, bool auth)
+{
+	uint8_t *p = buf;
+	fv_header fv;
+	store_header sh;
+	uint32_t blockmap[4] = { size / FV_SCAN_STEP, FV_SCAN_STEP, 0, 0 };
+	size_t hdr_len = sizeof(fv) + sizeof(blockmap);
+
+	if (size % FV_SCAN_STEP || size < FV_SCAN_STEP ||
+	    size - hdr_len > UINT32_MAX)
+		return UEFIOP_ERROR;
+
+	memset(p, 0xff, size);
+
+	memset(&fv, 0, sizeof(fv));
+	fv.fs_guid = nv_fv_guid;
+	fv.length = size;
+	fv.signature = FVH_SIGNATURE;
+	fv.attributes = FV_ATTRIBUTES;
+	fv.header_length = hdr_len;
+	fv.revision = FV_REVISION;
+	memcpy(p, &fv, sizeof(fv));
+	memcpy(p + sizeof(fv), blockmap, sizeof(blockmap));
+	fv.checksum = -fv_checksum(p, hdr_len);
+	memcpy(p, &fv, sizeof(fv));
+
+	memset(&sh, 0, sizeof(sh));
+	sh.signature = auth ? auth_var_guid : var_guid;
+	sh.size = size - hdr_len;
+	sh.format = VARSTORE_FORMATTED;
+	sh.state = VARSTORE_HEALTHY;
+	memcpy(p + hdr_len, &sh, sizeof(sh));
+
+	return UEFIOP_OK;
+}
+
+/*
+ *  Drop the records that are not live and move the live ones down over
+ *  them, in one pass from the start of the store, then erase the space
+ *  freed at the end. Live records still IN_DELETED_TRANSITION become
+ *  plain ADDED ones. Unlike the firmware's reclaim this is not power fail
+ *  safe, so it is meant for images that are not in use.
+ */
+size_t varstore_compact(varstore *vs)
+{
+	size_t to = vs->start, old_free = vs->free, i, n = 0;
+
+	if (!vs->writable)
+		return 0;
+
+	for (i = 0; i < vs->count; i++) {
+		varstore_var var = vs->vars[i];
+		size_t len, rec;
+
+		if (!var.live)
+			continue;
+		len = vs->hdr_size + var.name_size + var.data_size;
+		rec = record_size(vs, &var);
+		if (rec > vs->end - to)
+			rec = vs->end - to;
+		if (var.offset != to) {
+			memmove(vs->map + to, vs->map + var.offset, len);
+			memset(vs->map + to + len, 0xff, rec - len);
+		}
+		vs->map[to + VAR_STATE_OFFSET] = VAR_ADDED;
+		parse_record(vs, to, &vs->vars[n]);
+		vs->vars[n++].live = true;
+		to += rec;
+	}
+	if (old_free > to)
+		memset(vs->map + to, 0xff, old_free - to);
+
+	vs->count = n;
+	vs->free = to;
+	vs->used = to - vs->start;
+	index_fill(vs);
+
+	return old_free - to;
+}
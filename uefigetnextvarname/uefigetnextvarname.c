@@ -36,18 +36,23 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <getopt.h>
 
 #include <efi_runtime.h>
 
 #include "uefiop.h"
 #include "utils.h"
-
-static int fd = -1;
+#include "variter.h"
 
 static struct option options[] = {
 	{ "size", required_argument, NULL, 's' },
+	{ "resume", required_argument, NULL, 'r' },
+	{ "guid", required_argument, NULL, 'g' },
+	{ "name", required_argument, NULL, 'n' },
+	{ "attr", required_argument, NULL, 'a' },
+	{ "min-size", required_argument, NULL, 'z' },
+	{ "max-size", required_argument, NULL, 'Z' },
+	{ "backend", required_argument, NULL, 'b' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
@@ -55,59 +60,91 @@ static struct option options[] = {
 
 static void usage(void)
 {
-	printf("Usage: %s [options] --size <size> --guid <guid> --name <varname> "
-			"--file <varfile>\n"
+	printf("Usage: %s [options] --size <size> --resume <guid>:<varname>\n"
 		"This application helps to enumerates the current variable names with runtime services.\n\n"
 		"Options:\n"
-		"\t--size -s <size>	The size of the VariableName buffer\n"
+		"\t--size -s <size>	The initial size of the VariableName buffer (default 1024),\n"
+		"\t			it grows as longer names are found\n"
 		"\t	ex. uefigetnextvarname -s 512\n"
+		"\t--resume -r <guid>:<varname>	start after this variable, to continue an\n"
+		"\t			interrupted enumeration, for which the exit status\n"
+		"\t			is 2 and the resume token is printed\n"
+		"\t	ex. uefigetnextvarname -r 8be4df61-93ca-11d2-aa0d-00e098032b8c:Boot0001\n"
+		"\t	ex. uefigetnextvarname -r global:Boot0001\n"
+		"\t--guid -g <guid>	only the variables of this guid\n"
+		"\t	ex. uefigetnextvarname -g global\n"
+		"\t--name -n <glob>	only the variables whose name matches the glob\n"
+		"\t	ex. uefigetnextvarname -n 'Boot[0-9]*'\n"
+		"\t--attr -a <attr>	only the variables with all these attributes set\n"
+		"\t--min-size -z <size>	only the variables of at least this size\n"
+		"\t--max-size -Z <size>	only the variables of at most this size\n"
+		"\t	the size can have a K, M or G suffix, ex. uefigetnextvarname -a 1 -z 4K\n"
+		"\t	attributes and sizes are checked with a zero length GetVariable\n"
+		"\t	and printed, no data is read\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
 		"\t--version -V		show version\n"
 		"\t--help -h		show this menu\n",
 		"uefigetnextvarname");
 }
 
-static int uefigetnextvarname(
-	int fd,
-	uint64_t *size,
-	uint16_t *varname,
-	efi_guid *guid,
-	uint64_t *status)
-{
-	int ioret;
-	struct efi_getnextvariablename getnextvariablename;
-
-	getnextvariablename.VariableNameSize = size;
-	getnextvariablename.VariableName = varname;
-	getnextvariablename.VendorGuid = (EFI_GUID *)guid;
-	getnextvariablename.status = status;
-	ioret = ioctl(fd, EFI_RUNTIME_GET_NEXTVARIABLENAME, &getnextvariablename);
-
-	return ioret;
-
-}
-
-int main(int argc, char **argv)
+int UEFIOP_MAIN(uefigetnextvarname)(int argc, char **argv)
 {
 
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
 	int c;
 	efi_guid guid;
-	uint16_t *varnamebuffer = NULL;
-	uint64_t varnamesize = 0;
-	uint64_t bufffersize = 0;
+	efi_guid matchguid;
+	variter_match match = { 0 };
+	variter *it = NULL;
+	const variter_var *var;
+	uint16_t *resumename = NULL;
+	uint64_t bufffersize = 1024;
 	uint64_t status;
-	bool got_size = false;
+	const char *resume = NULL;
+	size_t resumelen = 0;
+	size_t strsize = 0;
+	bool found = false;
 	char *str = NULL;
+	int rc = EXIT_SUCCESS;
+	char guidstr[37];
 
 	for (;;) {
 		int idx;
-		c = getopt_long(argc, argv, "s:Vh", options, &idx);
+		c = getopt_long(argc, argv, "s:r:g:n:a:z:Z:Vhb:", options, &idx);
 		if (c == -1)
 			break;
 
 		switch (c) {
 		case 's':
 			bufffersize = strtoul(optarg, NULL, 10);
-			got_size = true;
+			break;
+		case 'r':
+			resume = optarg;
+			break;
+		case 'g':
+			if (string_to_guid(optarg, &matchguid)) {
+				printf ("Invalid guid:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			match.guid = (EFI_GUID *)&matchguid;
+			break;
+		case 'n':
+			match.name = optarg;
+			break;
+		case 'a':
+			match.attr = strtoul(optarg, NULL, 16);
+			break;
+		case 'z':
+		case 'Z':
+			if (parse_size(optarg, c == 'z' ? &match.min_size :
+				       &match.max_size)) {
+				printf ("Invalid size:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			backend = optarg;
 			break;
 		case 'V':
 			version();
@@ -118,42 +155,53 @@ int main(int argc, char **argv)
 		}
 	}
 
-	fd = init_driver();
-	if (fd == -1) {
+	ctx = init_driver(backend);
+	if (!ctx) {
 		printf ("Cannot open efi_runtime driver. Aborted.\n");
 		goto error;
 	}
 
-	if (!got_size) {
-		printf ("Need to input the variable name buffer szie\n");
-		goto error;
-	}
-
 	if (bufffersize < 2) {
 		printf ("Variable name buffer size should lager or equal to 2 "
 			"bytes for Null-terminated string of UCS\n");
 		goto error;
 	}
 
-	varnamebuffer = malloc(bufffersize);
-	if (!varnamebuffer) {
+	it = variter_new_size(ctx, 0, bufffersize);
+	if (!it) {
 		printf ("error: cannot alloc memory for variable name buffer\n");
 		goto error;
 	}
-
-	str = malloc(bufffersize/2);
-	if (!str) {
-		printf ("error: cannot alloc memory\n");
-		goto error;
+	variter_set_match(it, &match);
+
+	/* the resume token is "<guid>:<name>", carry on after it */
+	if (resume) {
+		if (parse_var_spec(resume, &guid, &resume)) {
+			printf ("Invalid resume token \"%s\", expected "
+				"<guid>:<name>\n", resume);
+			goto error;
+		}
+		resumelen = strlen(resume);
+		resumename = malloc((resumelen + 1) * 2);
+		if (!resumename) {
+			printf ("error: cannot alloc memory\n");
+			goto error;
+		}
+		if (utf8_to_ucs2(resumename, resume, resumelen) < 0) {
+			printf ("Invalid variable name:  \"%s\"\n", resume);
+			goto error;
+		}
+		if (variter_seek(it, resumename, (EFI_GUID *)&guid)) {
+			printf ("error: cannot alloc memory for variable name "
+				"buffer\n");
+			goto error;
+		}
 	}
 
-	/* stare search */
-	varnamebuffer[0] = '\0';
 	while (true) {
+		size_t len;
 
-		varnamesize = bufffersize;
-		uefigetnextvarname(fd, &varnamesize, varnamebuffer, &guid, &status);
-
+		status = variter_next(it, &var);
 		if (status != EFI_SUCCESS) {
 
 			/* no next variable was found*/
@@ -162,48 +210,63 @@ int main(int argc, char **argv)
 				break;
 			}
 
-			/*
-			 * The buffer we provided is too small for the name 
-			 */
-			if (status == EFI_BUFFER_TOO_SMALL) {
-				printf ("The buffer is too small, need %ld bytes. "
-					"Can specify more buffer and try again.\n",
-					varnamesize);
-				break;
-			}
+			if (status == EFI_INVALID_PARAMETER && resume && !found)
+				printf ("The resume variable does not exist.\n");
 
 			/* other errors */
 			print_status_info(status);
+			if (found)
+				printf ("Resume with: --resume %s:%s\n",
+					guidstr, str);
+			rc = found ? 2 : EXIT_FAILURE;
 			break;
 		}
 
-		ucs_to_str(str, varnamebuffer, varnamesize);
+		/* up to 3 bytes of UTF-8 for each UCS-2 character */
+		len = ucs2_len(var->name);
+		if (len * 3 + 1 > strsize) {
+			char *s = realloc(str, len * 3 + 1);
+
+			if (!s) {
+				printf ("error: cannot alloc memory\n");
+				goto error;
+			}
+			str = s;
+			strsize = len * 3 + 1;
+		}
+		ucs2_to_utf8(str, var->name, len);
 		printf ("VariableName: %s\n", str);
-		printf ("VendorGuid: %08x-%04x-%04x-%04x-%02x%02x%02x%02x%02x%02x\n",
-			guid.a, guid.b, guid.c, guid.d, guid.e[0], guid.e[1],
-			guid.e[2], guid.e[3], guid.e[4], guid.e[5]);
+		guid_to_string((const efi_guid *)var->guid, guidstr);
+		if (guid_name((const efi_guid *)var->guid))
+			printf ("VendorGuid: %s (%s)\n", guidstr,
+				guid_name((const efi_guid *)var->guid));
+		else
+			printf ("VendorGuid: %s\n", guidstr);
+		if (variter_match_probes(&match))
+			printf ("Attributes: 0x%08x DataSize: %llu\n",
+				var->attr, (unsigned long long)var->size);
+		found = true;
 	}
 
 	if (str)
 		free(str);	
 
-	if (varnamebuffer)
-		free(varnamebuffer);
+	free(resumename);
+	variter_free(it);
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
-	return EXIT_SUCCESS;
+	return rc;
 
 error:
 
-	if (varnamebuffer)
-		free(varnamebuffer);
+	free(resumename);
+	variter_free(it);
 
 	if (str)
 		free(str);
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_FAILURE;
 }
-
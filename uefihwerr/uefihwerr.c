@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include <efi_runtime.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "variter.h"
+
+#define BATCH_SIZE	256
+#define DATA_SIZE	65536
+
+static struct option options[] = {
+	{ "output", required_argument, NULL, 'o' },
+	{ "batch", required_argument, NULL, 'n' },
+	{ "keep", no_argument, NULL, 'k' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] --output <file>\n"
+		"This application exports the hardware error records, the HwErrRec#### variables,\n"
+		"to a file and then deletes them with runtime services.\n\n"
+		"Options:\n"
+		"\t--output -o <file>	append the records to this file, as manifest lines\n"
+		"\t			each after a comment with the time of the export\n"
+		"\t	ex. uefihwerr -o /var/log/hwerr.manifest\n"
+		"\t	the records can be written back with uefivarset --apply\n"
+		"\t--batch -n <count>	the records written and synced to the file before\n"
+		"\t			they are deleted (default 256)\n"
+		"\t--keep -k		export the records without deleting them\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefihwerr");
+}
+
+typedef struct {
+	uefiop_ctx *ctx;
+	int fd;
+	const char *path;
+	size_t batch_size;
+	bool keep;
+	uint8_t *data;		/* one record */
+	uint64_t data_cap;
+	char *text;		/* the lines of the batch */
+	size_t text_size;
+	size_t text_cap;
+	uint16_t **names;	/* the records of the batch, to delete */
+	EFI_GUID guid;
+	size_t count;
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t deleted;
+	uint64_t undeleted;	/* exported, but could not be deleted */
+	uint16_t **empty;	/* skipped, no data to export */
+	size_t empty_count;
+	unsigned int batches;
+} harvest;
+
+static int reserve_text(harvest *h, size_t need)
+{
+	size_t cap = h->text_cap ? h->text_cap : DATA_SIZE;
+	char *p;
+
+	if (h->text_size + need <= h->text_cap)
+		return UEFIOP_OK;
+	while (cap < h->text_size + need)
+		cap *= 2;
+	p = realloc(h->text, cap);
+	if (!p)
+		return UEFIOP_ERROR;
+	h->text = p;
+	h->text_cap = cap;
+
+	return UEFIOP_OK;
+}
+
+/* read the record into h->data, growing it as needed */
+static uint64_t read_record(harvest *h, const variter_var *var,
+	uint32_t *attr, uint64_t *size)
+{
+	uint64_t status;
+	uint8_t *p;
+
+	for (;;) {
+		*size = h->data_cap;
+		status = uefiop_get_variable(h->ctx, var->name, var->guid,
+			attr, size, h->data);
+		if (status != EFI_BUFFER_TOO_SMALL || *size <= h->data_cap)
+			return status;
+		p = realloc(h->data, *size);
+		if (!p)
+			return EFI_OUT_OF_RESOURCES;
+		h->data = p;
+		h->data_cap = *size;
+	}
+}
+
+/*
+ * The walk starts over after each batch, so a record without data is
+ * met again, it is only reported the first time.
+ */
+static uint64_t skip_empty(harvest *h, const uint16_t *name, size_t len)
+{
+	uint16_t **p;
+	char *str;
+	size_t i;
+
+	for (i = 0; i < h->empty_count; i++)
+		if (!memcmp(h->empty[i], name, (len + 1) * sizeof(uint16_t)))
+			return EFI_SUCCESS;
+
+	p = realloc(h->empty, (h->empty_count + 1) * sizeof(*p));
+	if (!p)
+		return EFI_OUT_OF_RESOURCES;
+	h->empty = p;
+	p[h->empty_count] = malloc((len + 1) * sizeof(uint16_t));
+	str = malloc(len * 3 + 1);
+	if (!p[h->empty_count] || !str) {
+		free(p[h->empty_count]);
+		free(str);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	memcpy(p[h->empty_count++], name, (len + 1) * sizeof(uint16_t));
+	ucs2_to_utf8(str, name, len);
+	printf ("Skipped %s, it has no data\n", str);
+	free(str);
+
+	return EFI_SUCCESS;
+}
+
+/* "# <time>" and "<guid> <name> <attr> <hex data>" */
+static uint64_t add_record(harvest *h, const variter_var *var)
+{
+	size_t len = ucs2_len(var->name), n;
+	uint64_t status, size;
+	uint32_t attr;
+	char guidstr[37];
+	struct tm tm;
+	time_t now;
+	char *p;
+
+	status = read_record(h, var, &attr, &size);
+	if (status != EFI_SUCCESS)
+		return status;
+
+	/* "-" would read back as a delete, and a record has data anyway */
+	if (size == 0)
+		return skip_empty(h, var->name, len);
+
+	/* the time, the GUID, the name, the attributes, the data, blanks */
+	if (reserve_text(h, 32 + 37 + len * 3 + 9 + size * 2 + 5))
+		return EFI_OUT_OF_RESOURCES;
+	h->names[h->count] = malloc((len + 1) * sizeof(uint16_t));
+	if (!h->names[h->count])
+		return EFI_OUT_OF_RESOURCES;
+	memcpy(h->names[h->count], var->name, (len + 1) * sizeof(uint16_t));
+	h->count++;
+
+	now = time(NULL);
+	gmtime_r(&now, &tm);
+	p = h->text + h->text_size;
+	p += strftime(p, 32, "# %Y-%m-%dT%H:%M:%SZ\n", &tm);
+	guid_to_string((const efi_guid *)var->guid, guidstr);
+	memcpy(p, guidstr, 36);
+	p += 36;
+	*p++ = ' ';
+	p += ucs2_to_utf8(p, var->name, len);
+	p += sprintf(p, " %x ", attr);
+	n = hex_encode(p, h->data, size);
+	p += n;
+	*p++ = '\n';
+	h->text_size = p - h->text;
+	h->bytes += size;
+
+	return EFI_SUCCESS;
+}
+
+/* make the batch durable, and only then delete its records */
+static int flush_batch(harvest *h, uint64_t *status)
+{
+	struct iovec iov;
+	size_t i;
+
+	*status = EFI_SUCCESS;
+	if (!h->count)
+		return UEFIOP_OK;
+
+	iov.iov_base = h->text;
+	iov.iov_len = h->text_size;
+	if (write_iov(h->fd, &iov, 1) || fsync(h->fd)) {
+		printf ("error: cannot write %s: %s, no record was deleted\n",
+			h->path, strerror(errno));
+		return UEFIOP_ERROR;
+	}
+	h->records += h->count;
+	h->batches++;
+
+	/* the first failure is reported, the other records still go */
+	for (i = 0; i < h->count; i++) {
+		if (!h->keep) {
+			uint64_t st = uefiop_set_variable(h->ctx, h->names[i],
+				&h->guid, 0, 0, NULL);
+
+			if (st == EFI_SUCCESS || st == EFI_NOT_FOUND) {
+				h->deleted++;
+			} else {
+				h->undeleted++;
+				if (*status == EFI_SUCCESS)
+					*status = st;
+			}
+		}
+		free(h->names[i]);
+		h->names[i] = NULL;
+	}
+	h->count = 0;
+	h->text_size = 0;
+
+	return *status == EFI_SUCCESS ? UEFIOP_OK : UEFIOP_ERROR;
+}
+
+/*
+ * Deleting the records of a batch invalidates the place of the walk, so
+ * it starts over after each batch, past the records already deleted.
+ * When the records are kept the walk goes on.
+ */
+static uint64_t harvest_records(harvest *h)
+{
+	variter_match match = { 0 };
+	const variter_var *var;
+	variter *it = NULL;
+	uint64_t status;
+	bool more = true;
+
+	match.guid = &h->guid;
+	match.name = "HwErrRec*";
+
+	while (more) {
+		if (!it) {
+			it = variter_new(h->ctx, 0);
+			if (!it)
+				return EFI_OUT_OF_RESOURCES;
+			variter_set_match(it, &match);
+		}
+		while (h->count < h->batch_size) {
+			status = variter_next(it, &var);
+			if (status == EFI_NOT_FOUND) {
+				more = false;
+				break;
+			}
+			if (status == EFI_SUCCESS)
+				status = add_record(h, var);
+			if (status == EFI_NOT_FOUND) {
+				variter_drop(it);	/* deleted in the meantime */
+				continue;
+			}
+			if (status != EFI_SUCCESS) {
+				uint64_t flushed;
+
+				/* what was read so far is still saved */
+				flush_batch(h, &flushed);
+				variter_free(it);
+				return status;
+			}
+		}
+		if (flush_batch(h, &status)) {
+			variter_free(it);
+			return status == EFI_SUCCESS ? EFI_ABORTED : status;
+		}
+		if (!h->keep) {
+			variter_free(it);
+			it = NULL;
+		}
+	}
+	variter_free(it);
+
+	return EFI_SUCCESS;
+}
+
+/* a new file is only durable once its directory entry is */
+static int sync_dir(const char *path)
+{
+	char *copy = strdup(path);
+	int fd, rc;
+
+	if (!copy)
+		return UEFIOP_ERROR;
+	fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+	free(copy);
+	if (fd == -1)
+		return UEFIOP_ERROR;
+	rc = fsync(fd);
+	close(fd);
+
+	return rc ? UEFIOP_ERROR : UEFIOP_OK;
+}
+
+int UEFIOP_MAIN(uefihwerr)(int argc, char **argv)
+{
+	harvest h;
+	char *backend = NULL;
+	efi_guid guid;
+	uint64_t status;
+	unsigned long n;
+	int c, rc = EXIT_FAILURE;
+	bool created;
+
+	memset(&h, 0, sizeof(h));
+	h.fd = -1;
+	h.batch_size = BATCH_SIZE;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "o:n:kVhb:", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'o':
+			h.path = optarg;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			if (n == 0) {
+				printf ("Invalid batch size:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			h.batch_size = n;
+			break;
+		case 'k':
+			h.keep = true;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (!h.path) {
+		printf ("need to input the output file\n");
+		return EXIT_FAILURE;
+	}
+	string_to_guid("hwerr", &guid);
+	memcpy(&h.guid, &guid, sizeof(h.guid));
+
+	h.names = calloc(h.batch_size, sizeof(*h.names));
+	h.data = malloc(DATA_SIZE);
+	if (!h.names || !h.data) {
+		printf ("error: cannot alloc memory\n");
+		goto out;
+	}
+	h.data_cap = DATA_SIZE;
+
+	created = access(h.path, F_OK) != 0;
+	h.fd = open(h.path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+	if (h.fd == -1 || (created && sync_dir(h.path))) {
+		printf ("error: cannot open %s: %s\n", h.path,
+			strerror(errno));
+		goto out;
+	}
+
+	h.ctx = init_driver(backend);
+	if (!h.ctx) {
+		printf ("Cannot open efi_runtime driver. Aborted.\n");
+		goto out;
+	}
+
+	status = harvest_records(&h);
+	printf ("Exported %llu record(s), %llu bytes, in %u batch(es) to %s, "
+		"deleted %llu\n", (unsigned long long)h.records,
+		(unsigned long long)h.bytes, h.batches, h.path,
+		(unsigned long long)h.deleted);
+	if (h.undeleted)
+		printf ("%llu exported record(s) could not be deleted\n",
+			(unsigned long long)h.undeleted);
+	if (h.empty_count)
+		printf ("%zu record(s) without data were skipped\n",
+			h.empty_count);
+	if (status == EFI_SUCCESS)
+		rc = EXIT_SUCCESS;
+	else if (status != EFI_ABORTED)
+		print_status_info(status);
+
+out:
+	if (h.fd != -1)
+		close(h.fd);
+	deinit_driver(h.ctx);
+	if (h.names)
+		for (n = 0; n < h.batch_size; n++)
+			free(h.names[n]);
+	free(h.names);
+	for (n = 0; n < h.empty_count; n++)
+		free(h.empty[n]);
+	free(h.empty);
+	free(h.data);
+	free(h.text);
+
+	return rc;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+
+static struct option options[] = {
+	{ "dry-run", no_argument, NULL, 'n' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] <image>...\n"
+		"This application compacts firmware variable store images such as OVMF_VARS.fd\n"
+		"in place, dropping deleted records so that the space can be used again.\n"
+		"The images must not be in use by a running VM.\n\n"
+		"Options:\n"
+		"\t--dry-run -n		only report the space that would be reclaimed\n"
+		"\t	ex. uefinvcompact -n vm001.fd\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefinvcompact");
+}
+
+static int compact(const char *path, bool dry_run)
+{
+	const varstore_var *var = NULL;
+	size_t total, used, remaining, reclaimed, live = 0;
+	varstore *vs;
+
+	vs = varstore_open(path, !dry_run);
+	if (!vs) {
+		if (errno == ENOEXEC)
+			printf ("%s: not a variable store image\n", path);
+		else
+			printf ("%s: %s\n", path, strerror(errno));
+		return UEFIOP_ERROR;
+	}
+
+	while ((var = varstore_next(vs, var)) != NULL)
+		live++;
+	varstore_usage(vs, &total, &used, &remaining);
+
+	if (dry_run)
+		reclaimed = total - remaining - used;
+	else
+		reclaimed = varstore_compact(vs);
+	printf ("%s: %zu variables, %zu of %zu bytes live, "
+		"%zu bytes %s, %zu bytes free\n",
+		path, live, used, total, reclaimed,
+		dry_run ? "reclaimable" : "reclaimed", remaining + reclaimed);
+
+	varstore_close(vs);
+
+	return UEFIOP_OK;
+}
+
+int UEFIOP_MAIN(uefinvcompact)(int argc, char **argv)
+{
+	bool dry_run = false;
+	int c, ret = EXIT_SUCCESS;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "nVh", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			dry_run = true;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind >= argc) {
+		printf ("need to input at least one image\n");
+		return EXIT_FAILURE;
+	}
+
+	for (; optind < argc; optind++) {
+		if (compact(argv[optind], dry_run))
+			ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "varstore.h"
+#include "manifest.h"
+
+static struct option options[] = {
+	{ "template", required_argument, NULL, 't' },
+	{ "common", required_argument, NULL, 'c' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "list", required_argument, NULL, 'l' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] --template <image> <delta>...\n"
+		"This application writes one variable store image per delta, each a copy of the\n"
+		"template with the variables of the delta set.\n\n"
+		"A delta is a manifest with one variable per line:\n"
+		"\t<guid> <name> <attributes> <hex data>|@<file>|-\n\n"
+		"Options:\n"
+		"\t--template -t <image>	the template image, e.g. an OVMF_VARS.fd\n"
+		"\t--common -c <delta>	a delta applied to the template first\n"
+		"\t--output -o <dir>	where to write <delta name>.fd (default .)\n"
+		"\t--list -l <file>	read \"<image> <delta>\" pairs, one per line\n"
+		"\t	ex. uefinvgen -t OVMF_VARS.fd -o vms/ vm001.vars vm002.vars\n"
+		"\t--jobs -j <n>		images written in parallel (default one per cpu)\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefinvgen");
+}
+
+typedef struct {
+	char *image;
+	char *delta;
+} job;
+
+typedef struct {
+	const uint8_t *tmpl;
+	size_t size;
+	job *jobs;
+	size_t count;
+	size_t next;		/* next job to take */
+	size_t failed;
+	pthread_mutex_t lock;
+} generator;
+
+static int add_job(job **jobs, size_t *count, size_t *cap,
+	const char *image, const char *delta)
+{
+	job *j;
+
+	if (*count == *cap) {
+		*cap = *cap ? *cap * 2 : 64;
+		j = realloc(*jobs, *cap * sizeof(*j));
+		if (!j)
+			return UEFIOP_ERROR;
+		*jobs = j;
+	}
+	j = &(*jobs)[*count];
+	j->image = strdup(image);
+	j->delta = strdup(delta);
+	if (!j->image || !j->delta) {
+		free(j->image);
+		free(j->delta);
+		return UEFIOP_ERROR;
+	}
+	(*count)++;
+
+	return UEFIOP_OK;
+}
+
+/* <dir>/<delta file name without its extension>.fd */
+static int add_delta(job **jobs, size_t *count, size_t *cap,
+	const char *dir, const char *delta)
+{
+	char *copy = strdup(delta), *base, *dot, *image;
+	int rc;
+
+	if (!copy)
+		return UEFIOP_ERROR;
+	base = basename(copy);
+	dot = strrchr(base, '.');
+	if (dot && dot != base)
+		*dot = '\0';
+	if (asprintf(&image, "%s/%s.fd", dir, base) < 0) {
+		free(copy);
+		return UEFIOP_ERROR;
+	}
+	rc = add_job(jobs, count, cap, image, delta);
+	free(image);
+	free(copy);
+
+	return rc;
+}
+
+static int add_list(job **jobs, size_t *count, size_t *cap, const char *path)
+{
+	char *line = NULL, image[4096], delta[4096];
+	size_t len = 0, lineno = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		printf ("error: cannot open %s\n", path);
+		return UEFIOP_ERROR;
+	}
+	while (getline(&line, &len, fp) != -1) {
+		lineno++;
+		if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#')
+			continue;
+		if (sscanf(line, "%4095s %4095s", image, delta) != 2) {
+			printf ("%s: line %zu: expected \"<image> <delta>\"\n",
+				path, lineno);
+			goto error;
+		}
+		if (add_job(jobs, count, cap, image, delta)) {
+			printf ("error: cannot alloc memory\n");
+			goto error;
+		}
+	}
+	free(line);
+	fclose(fp);
+	return UEFIOP_OK;
+
+error:
+	free(line);
+	fclose(fp);
+	return UEFIOP_ERROR;
+}
+
+static int compare_images(const void *p1, const void *p2)
+{
+	const job *j1 = *(const job * const *)p1, *j2 = *(const job * const *)p2;
+
+	return strcmp(j1->image, j2->image);
+}
+
+/* two deltas writing the same image would overwrite each other */
+static int check_images(const job *jobs, size_t count)
+{
+	const job **sorted;
+	size_t i;
+	int rc = UEFIOP_OK;
+
+	sorted = malloc(count * sizeof(*sorted));
+	if (!sorted) {
+		printf ("error: cannot alloc memory\n");
+		return UEFIOP_ERROR;
+	}
+	for (i = 0; i < count; i++)
+		sorted[i] = &jobs[i];
+	qsort(sorted, count, sizeof(*sorted), compare_images);
+	for (i = 1; i < count; i++) {
+		if (!strcmp(sorted[i - 1]->image, sorted[i]->image)) {
+			printf ("%s and %s both write %s\n",
+				sorted[i - 1]->delta, sorted[i]->delta,
+				sorted[i]->image);
+			rc = UEFIOP_ERROR;
+		}
+	}
+	free(sorted);
+
+	return rc;
+}
+
+static int load_template(const char *path, uint8_t **tmplp, size_t *sizep)
+{
+	struct stat statbuf;
+	uint8_t *tmpl;
+	size_t done = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &statbuf)) {
+		printf ("error: cannot open template %s\n", path);
+		if (fd != -1)
+			close(fd);
+		return UEFIOP_ERROR;
+	}
+	tmpl = malloc(statbuf.st_size ? statbuf.st_size : 1);
+	if (!tmpl) {
+		printf ("error: cannot alloc memory\n");
+		close(fd);
+		return UEFIOP_ERROR;
+	}
+	while (done < (size_t)statbuf.st_size) {
+		ssize_t n = read(fd, tmpl + done, statbuf.st_size - done);
+
+		if (n <= 0) {
+			printf ("error: cannot read template %s\n", path);
+			free(tmpl);
+			close(fd);
+			return UEFIOP_ERROR;
+		}
+		done += n;
+	}
+	close(fd);
+	*tmplp = tmpl;
+	*sizep = done;
+
+	return UEFIOP_OK;
+}
+
+static void print_manifest_error(const char *path, size_t line)
+{
+	if (line)
+		printf ("%s: line %zu: invalid variable\n", path, line);
+	else
+		printf ("%s: %s\n", path, strerror(errno));
+}
+
+static void print_apply_error(const char *path, const manifest *m,
+	size_t failed, uint64_t status)
+{
+	char name[3 * 255 + 1];
+	size_t len = 0;
+
+	if (failed < m->count) {
+		const uint16_t *ucs = m->entries[failed].name;
+
+		for (len = 0; ucs[len] && len < 255; len++)
+			;
+		ucs2_to_utf8(name, ucs, len);
+	} else {
+		strcpy(name, "(template)");
+	}
+	printf ("%s: %s: ", path, name);
+	print_status_info(status);
+}
+
+/* write a temporary file and rename it, a failed write leaves no image */
+static int write_image(const char *path, const uint8_t *buf, size_t size)
+{
+	char *tmp = NULL;
+	size_t done = 0;
+	int fd, err;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return UEFIOP_ERROR;
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd == -1) {
+		free(tmp);
+		return UEFIOP_ERROR;
+	}
+	while (done < size) {
+		ssize_t n = write(fd, buf + done, size - done);
+
+		if (n <= 0)
+			goto error;
+		done += n;
+	}
+	if (fchmod(fd, 0644) || close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	fd = -1;
+	if (rename(tmp, path))
+		goto error;
+	free(tmp);
+
+	return UEFIOP_OK;
+
+error:
+	err = errno;
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+	errno = err;
+	return UEFIOP_ERROR;
+}
+
+static void *worker(void *arg)
+{
+	generator *gen = arg;
+	uint8_t *buf;
+
+	buf = malloc(gen->size);
+	if (!buf) {
+		pthread_mutex_lock(&gen->lock);
+		printf ("error: cannot alloc memory\n");
+		pthread_mutex_unlock(&gen->lock);
+		return NULL;
+	}
+
+	for (;;) {
+		size_t i = __atomic_fetch_add(&gen->next, 1, __ATOMIC_RELAXED);
+		uint64_t status;
+		size_t line, failed = SIZE_MAX;
+		manifest *m;
+		job *j;
+
+		if (i >= gen->count)
+			break;
+		j = &gen->jobs[i];
+
+		m = manifest_load(j->delta, &line);
+		if (!m) {
+			pthread_mutex_lock(&gen->lock);
+			print_manifest_error(j->delta, line);
+			gen->failed++;
+			pthread_mutex_unlock(&gen->lock);
+			continue;
+		}
+
+		status = manifest_render(m, gen->tmpl, gen->size, buf, &failed);
+		if (status != EFI_SUCCESS) {
+			pthread_mutex_lock(&gen->lock);
+			print_apply_error(j->delta, m, failed, status);
+			gen->failed++;
+			pthread_mutex_unlock(&gen->lock);
+		} else if (write_image(j->image, buf, gen->size)) {
+			pthread_mutex_lock(&gen->lock);
+			printf ("%s: %s\n", j->image, strerror(errno));
+			gen->failed++;
+			pthread_mutex_unlock(&gen->lock);
+		}
+		manifest_free(m);
+	}
+	free(buf);
+
+	return NULL;
+}
+
+int UEFIOP_MAIN(uefinvgen)(int argc, char **argv)
+{
+	generator gen;
+	varstore *vs;
+	char *template = NULL, *common = NULL, *list = NULL, *outdir = ".";
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t *threads = NULL;
+	uint8_t *tmpl = NULL;
+	size_t cap = 0, i;
+	struct timespec t0, t1;
+	double secs;
+	int c, ret = EXIT_FAILURE;
+
+	memset(&gen, 0, sizeof(gen));
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "t:c:o:l:j:Vh", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 't':
+			template = optarg;
+			break;
+		case 'c':
+			common = optarg;
+			break;
+		case 'o':
+			outdir = optarg;
+			break;
+		case 'l':
+			list = optarg;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (!template) {
+		printf ("need to input the template image\n");
+		return EXIT_FAILURE;
+	}
+	if (jobs < 1)
+		jobs = 1;
+
+	if (list && add_list(&gen.jobs, &gen.count, &cap, list))
+		goto out;
+	for (i = optind; i < (size_t)argc; i++) {
+		if (add_delta(&gen.jobs, &gen.count, &cap, outdir, argv[i])) {
+			printf ("error: cannot alloc memory\n");
+			goto out;
+		}
+	}
+	if (gen.count == 0) {
+		printf ("need to input at least one delta\n");
+		goto out;
+	}
+	if (check_images(gen.jobs, gen.count))
+		goto out;
+
+	if (load_template(template, &tmpl, &gen.size))
+		goto out;
+
+	/* check the template, and fold the common delta into it */
+	vs = varstore_attach(tmpl, gen.size);
+	if (!vs) {
+		printf ("%s: not a variable store image\n", template);
+		goto out;
+	}
+	if (common) {
+		manifest *m;
+		size_t line, failed;
+		uint64_t status;
+
+		m = manifest_load(common, &line);
+		if (!m) {
+			print_manifest_error(common, line);
+			varstore_close(vs);
+			goto out;
+		}
+		status = manifest_apply_store(m, vs, &failed);
+		if (status != EFI_SUCCESS)
+			print_apply_error(common, m, failed, status);
+		manifest_free(m);
+		if (status != EFI_SUCCESS) {
+			varstore_close(vs);
+			goto out;
+		}
+	}
+	varstore_close(vs);
+	gen.tmpl = tmpl;
+
+	if ((size_t)jobs > gen.count)
+		jobs = gen.count;
+	threads = calloc(jobs, sizeof(*threads));
+	if (!threads) {
+		printf ("error: cannot alloc memory\n");
+		goto out;
+	}
+	pthread_mutex_init(&gen.lock, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < (size_t)jobs; i++) {
+		if (pthread_create(&threads[i], NULL, worker, &gen)) {
+			printf ("error: cannot create thread\n");
+			break;
+		}
+	}
+	if (i == 0)
+		worker(&gen);
+	jobs = i;
+	for (i = 0; i < (size_t)jobs; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	pthread_mutex_destroy(&gen.lock);
+
+	/* the jobs no worker took, if none could allocate its buffer */
+	if (gen.next < gen.count)
+		gen.failed += gen.count - gen.next;
+
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf ("Generated %zu of %zu images in %.3f s (%.0f images/s)\n",
+		gen.count - gen.failed, gen.count, secs,
+		secs > 0 ? (gen.count - gen.failed) / secs : 0.0);
+	if (gen.failed == 0)
+		ret = EXIT_SUCCESS;
+
+out:
+	for (i = 0; i < gen.count; i++) {
+		free(gen.jobs[i].image);
+		free(gen.jobs[i].delta);
+	}
+	free(gen.jobs);
+	free(threads);
+	free(tmpl);
+
+	return ret;
+}
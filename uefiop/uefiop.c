@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+typedef int (*applet_main)(int argc, char **argv);
+
+int uefivarget_main(int argc, char **argv);
+int uefivarset_main(int argc, char **argv);
+int uefitime_main(int argc, char **argv);
+int uefigetnextvarname_main(int argc, char **argv);
+int uefiresetsystem_main(int argc, char **argv);
+int uefinvgen_main(int argc, char **argv);
+int uefinvcompact_main(int argc, char **argv);
+int uefisnapshot_main(int argc, char **argv);
+int uefivardiff_main(int argc, char **argv);
+int uefivarinfo_main(int argc, char **argv);
+int uefivardu_main(int argc, char **argv);
+int uefihwerr_main(int argc, char **argv);
+
+typedef struct {
+	const char *name;
+	applet_main main;
+} applet;
+
+static const applet applets[] = {
+	{ "uefivarget",		uefivarget_main },
+	{ "uefivarset",		uefivarset_main },
+	{ "uefitime",		uefitime_main },
+	{ "uefigetnextvarname",	uefigetnextvarname_main },
+	{ "uefiresetsystem",	uefiresetsystem_main },
+	{ "uefinvgen",		uefinvgen_main },
+	{ "uefinvcompact",	uefinvcompact_main },
+	{ "uefisnapshot",	uefisnapshot_main },
+	{ "uefivardiff",	uefivardiff_main },
+	{ "uefivarinfo",	uefivarinfo_main },
+	{ "uefivardu",		uefivardu_main },
+	{ "uefihwerr",		uefihwerr_main },
+	{ NULL, NULL }
+};
+
+static struct option options[] = {
+	{ "keep-going", no_argument, NULL, 'k' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	const applet *a;
+
+	printf("Usage: %s <command> [options]\n"
+		"       %s batch [--keep-going] [--backend <spec>] [<script>]\n"
+		"This application runs the uefiop tools from a single binary.\n"
+		"The command may also be selected by invoking uefiop through a link\n"
+		"named after it.\n\n"
+		"Commands (the \"uefi\" prefix may be omitted):\n",
+		"uefiop", "uefiop");
+	for (a = applets; a->name; a++)
+		printf("\t%s\n", a->name);
+	printf("\tbatch		run one command per line from <script> or stdin,\n"
+		"\t		sharing one open efi runtime driver, a command\n"
+		"\t		cannot select another backend\n"
+		"\t	ex. uefiop batch vars.txt\n"
+		"\t	ex. echo 'varget -g <guid> -n Test' | uefiop batch\n"
+		"Batch options:\n"
+		"\t--keep-going -k	continue after a failed command\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n");
+}
+
+static const applet *find_applet(const char *name)
+{
+	const applet *a;
+
+	for (a = applets; a->name; a++) {
+		if (!strcmp(a->name, name))
+			return a;
+		if (!strcmp(a->name + strlen("uefi"), name))
+			return a;
+	}
+	return NULL;
+}
+
+static int run_applet(const applet *a, int argc, char **argv)
+{
+	/* each command parses its own options from scratch */
+	optind = 0;
+	return a->main(argc, argv);
+}
+
+/*
+ *  Split a script line into words. Words are separated by blanks, and may
+ *  be quoted with "" or '' so that hex data such as "11 22 33" survives.
+ *  The line is modified in place.
+ */
+static int split_line(char *line, char ***argvp, size_t *sizep)
+{
+	char *src = line, *dst = line;
+	int argc = 0;
+
+	for (;;) {
+		char quote = 0;
+
+		while (*src == ' ' || *src == '\t' || *src == '\n' || *src == '\r')
+			src++;
+		if (*src == '\0' || *src == '#')
+			break;
+
+		if ((size_t)argc + 2 > *sizep) {
+			size_t size = *sizep ? *sizep * 2 : 16;
+			char **argv = realloc(*argvp, size * sizeof(char *));
+
+			if (!argv)
+				return -1;
+			*argvp = argv;
+			*sizep = size;
+		}
+		(*argvp)[argc++] = dst;
+
+		for (; *src; src++) {
+			if (quote) {
+				if (*src == quote) {
+					quote = 0;
+					continue;
+				}
+			} else if (*src == '"' || *src == '\'') {
+				quote = *src;
+				continue;
+			} else if (*src == ' ' || *src == '\t' ||
+				   *src == '\n' || *src == '\r') {
+				break;
+			}
+			if (*src == '\\' && quote != '\'' && src[1])
+				src++;
+			*dst++ = *src;
+		}
+		if (quote)
+			return -1;
+		if (*src)
+			src++;
+		*dst++ = '\0';
+	}
+	if (argc)
+		(*argvp)[argc] = NULL;
+
+	return argc;
+}
+
+static int batch(int argc, char **argv)
+{
+	FILE *fp = stdin;
+	char *line = NULL, **cmd_argv = NULL;
+	size_t line_size = 0, argv_size = 0;
+	unsigned long lineno = 0, failed = 0;
+	bool keep_going = false;
+	char *backend = NULL;
+	uefiop_ctx *ctx;
+	int c, cmd_argc;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "kb:hV", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'k':
+			keep_going = true;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		fp = fopen(argv[optind], "r");
+		if (!fp) {
+			printf("error: cannot open file %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* hold the driver open, every command below reuses this context */
+	ctx = init_driver(backend);
+	if (!ctx) {
+		printf("Cannot open efi_runtime driver. Aborted.\n");
+		if (fp != stdin)
+			fclose(fp);
+		return EXIT_FAILURE;
+	}
+
+	while (getline(&line, &line_size, fp) != -1) {
+		const applet *a;
+
+		lineno++;
+		cmd_argc = split_line(line, &cmd_argv, &argv_size);
+		if (cmd_argc == 0)
+			continue;
+		if (cmd_argc < 0) {
+			printf("line %lu: cannot parse command\n", lineno);
+			failed++;
+		} else if ((a = find_applet(cmd_argv[0])) == NULL) {
+			printf("line %lu: unknown command \"%s\"\n", lineno,
+				cmd_argv[0]);
+			failed++;
+		} else if (run_applet(a, cmd_argc, cmd_argv) != EXIT_SUCCESS) {
+			printf("line %lu: command failed\n", lineno);
+			failed++;
+		} else {
+			continue;
+		}
+		if (!keep_going)
+			break;
+	}
+
+	deinit_driver(ctx);
+
+	free(cmd_argv);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	const applet *a;
+	char *name = basename(argv[0]);
+
+	/* invoked through a link named after a tool */
+	if ((a = find_applet(name)) != NULL)
+		return run_applet(a, argc, argv);
+
+	if (argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+		usage();
+		return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	if (!strcmp(argv[1], "-V") || !strcmp(argv[1], "--version")) {
+		version();
+		return EXIT_SUCCESS;
+	}
+
+	if (!strcmp(argv[1], "batch"))
+		return batch(argc - 1, argv + 1);
+
+	if ((a = find_applet(argv[1])) != NULL)
+		return run_applet(a, argc - 1, argv + 1);
+
+	printf("Unknown command \"%s\"\n", argv[1]);
+	usage();
+
+	return EXIT_FAILURE;
+}
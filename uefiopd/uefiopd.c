@@ -0,0 +1,868 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <efi_runtime.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "uefiopd_proto.h"
+
+#define MAX_CONNS	256
+#define MAX_PENDING_OUT	(4 * UEFIOPD_MAX_BODY)
+
+/*
+ *  The runtime services the daemon forwards. Every op returns the EFI
+ *  status of the call. Requests are run one at a time from the event loop,
+ *  so the ops never see concurrent calls.
+ */
+typedef struct {
+	uint64_t (*get_variable)(uint16_t *name, EFI_GUID *guid,
+		uint32_t *attr, uint64_t *size, void *data);
+	uint64_t (*set_variable)(uint16_t *name, EFI_GUID *guid,
+		uint32_t attr, uint64_t size, void *data);
+	uint64_t (*get_next_variable_name)(uint64_t *size, uint16_t *name,
+		EFI_GUID *guid);
+	uint64_t (*get_time)(EFI_TIME *time, EFI_TIME_CAPABILITIES *cap);
+	uint64_t (*query_variable_info)(uint32_t attr, uint64_t *max_storage,
+		uint64_t *remaining, uint64_t *max_size);
+} device_ops;
+
+typedef struct {
+	int fd;
+	uint8_t *in;
+	size_t in_len, in_cap;
+	uint8_t *out;
+	size_t out_len, out_off, out_cap;
+} conn;
+
+static const device_ops *dev;
+static uefiop_ctx *dev_ctx = NULL;
+static volatile sig_atomic_t terminate = 0;
+
+static struct option options[] = {
+	{ "socket", required_argument, NULL, 's' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "fake", no_argument, NULL, 'F' },
+	{ "foreground", no_argument, NULL, 'f' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] --socket <path> --backend <spec> --fake --foreground\n"
+		"This daemon serves UEFI runtime services requests over a Unix socket.\n\n"
+		"Options:\n"
+		"\t--socket -s <path>	the socket to listen on (default %s)\n"
+		"\t	ex. uefiopd -s /tmp/uefiopd.sock\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t--fake -F		serve an in-memory variable store instead of\n"
+		"\t			the efi runtime driver, for testing\n"
+		"\t--foreground -f	do not detach from the terminal\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefiopd", UEFIOPD_SOCKET);
+}
+
+/* efi runtime driver */
+
+static uint64_t driver_get_variable(uint16_t *name, EFI_GUID *guid,
+	uint32_t *attr, uint64_t *size, void *data)
+{
+	return uefiop_get_variable(dev_ctx, name, guid, attr, size, data);
+}
+
+static uint64_t driver_set_variable(uint16_t *name, EFI_GUID *guid,
+	uint32_t attr, uint64_t size, void *data)
+{
+	return uefiop_set_variable(dev_ctx, name, guid, attr, size, data);
+}
+
+static uint64_t driver_get_next_variable_name(uint64_t *size, uint16_t *name,
+	EFI_GUID *guid)
+{
+	return uefiop_get_next_variable_name(dev_ctx, size, name, guid);
+}
+
+static uint64_t driver_get_time(EFI_TIME *time, EFI_TIME_CAPABILITIES *cap)
+{
+	return uefiop_get_time(dev_ctx, time, cap);
+}
+
+static uint64_t driver_query_variable_info(uint32_t attr, uint64_t *max_storage,
+	uint64_t *remaining, uint64_t *max_size)
+{
+	return uefiop_query_variable_info(dev_ctx, attr, max_storage,
+		remaining, max_size);
+}
+
+static const device_ops driver_ops = {
+	.get_variable = driver_get_variable,
+	.set_variable = driver_set_variable,
+	.get_next_variable_name = driver_get_next_variable_name,
+	.get_time = driver_get_time,
+	.query_variable_info = driver_query_variable_info,
+};
+
+/* in-memory fake device, good enough to exercise clients */
+
+#define FAKE_STORAGE_SIZE	(256 * 1024)
+
+typedef struct fake_var {
+	struct fake_var *next;
+	EFI_GUID guid;
+	uint16_t *name;
+	size_t name_size;
+	uint32_t attr;
+	uint8_t *data;
+	uint64_t size;
+} fake_var;
+
+static fake_var *fake_vars;
+static uint64_t fake_used;
+
+static size_t ucs_size(const uint16_t *name)
+{
+	size_t i;
+
+	for (i = 0; name[i]; i++)
+		;
+	return (i + 1) * sizeof(uint16_t);
+}
+
+static fake_var **fake_find(const uint16_t *name, const EFI_GUID *guid)
+{
+	fake_var **var;
+	size_t size = ucs_size(name);
+
+	for (var = &fake_vars; *var; var = &(*var)->next) {
+		if ((*var)->name_size == size &&
+		    !memcmp((*var)->name, name, size) &&
+		    !memcmp(&(*var)->guid, guid, sizeof(*guid)))
+			break;
+	}
+	return var;
+}
+
+static uint64_t fake_get_variable(uint16_t *name, EFI_GUID *guid,
+	uint32_t *attr, uint64_t *size, void *data)
+{
+	fake_var *var = *fake_find(name, guid);
+
+	if (!var)
+		return EFI_NOT_FOUND;
+
+	*attr = var->attr;
+	if (*size < var->size) {
+		*size = var->size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = var->size;
+	memcpy(data, var->data, var->size);
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t fake_set_variable(uint16_t *name, EFI_GUID *guid,
+	uint32_t attr, uint64_t size, void *data)
+{
+	fake_var **pos = fake_find(name, guid), *var = *pos;
+	bool append = attr & EFI_VARIABLE_APPEND_WRITE;
+	uint8_t *buf;
+
+	if (size == 0 && !append) {
+		if (!var)
+			return EFI_NOT_FOUND;
+		*pos = var->next;
+		fake_used -= var->name_size + var->size;
+		free(var->name);
+		free(var->data);
+		free(var);
+		return EFI_SUCCESS;
+	}
+
+	if (fake_used + size > FAKE_STORAGE_SIZE)
+		return EFI_OUT_OF_RESOURCES;
+
+	if (!var) {
+		var = calloc(1, sizeof(*var));
+		if (!var)
+			return EFI_OUT_OF_RESOURCES;
+		var->name_size = ucs_size(name);
+		var->name = malloc(var->name_size);
+		if (!var->name) {
+			free(var);
+			return EFI_OUT_OF_RESOURCES;
+		}
+		memcpy(var->name, name, var->name_size);
+		var->guid = *guid;
+		fake_used += var->name_size;
+		*pos = var;
+	}
+
+	buf = malloc(size + (append ? var->size : 0) + 1);
+	if (!buf)
+		return EFI_OUT_OF_RESOURCES;
+	if (append) {
+		memcpy(buf, var->data, var->size);
+		memcpy(buf + var->size, data, size);
+		size += var->size;
+	} else {
+		memcpy(buf, data, size);
+	}
+	fake_used += size - var->size;
+	free(var->data);
+	var->data = buf;
+	var->size = size;
+	var->attr = attr & ~EFI_VARIABLE_APPEND_WRITE;
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t fake_get_next_variable_name(uint64_t *size, uint16_t *name,
+	EFI_GUID *guid)
+{
+	fake_var *var;
+
+	if (name[0] == 0) {
+		var = fake_vars;
+	} else {
+		var = *fake_find(name, guid);
+		if (!var)
+			return EFI_INVALID_PARAMETER;
+		var = var->next;
+	}
+	if (!var)
+		return EFI_NOT_FOUND;
+
+	if (*size < var->name_size) {
+		*size = var->name_size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	*size = var->name_size;
+	memcpy(name, var->name, var->name_size);
+	*guid = var->guid;
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t fake_get_time(EFI_TIME *time, EFI_TIME_CAPABILITIES *cap)
+{
+	struct timespec ts;
+	struct tm tm;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	gmtime_r(&ts.tv_sec, &tm);
+
+	memset(time, 0, sizeof(*time));
+	time->Year = tm.tm_year + 1900;
+	time->Month = tm.tm_mon + 1;
+	time->Day = tm.tm_mday;
+	time->Hour = tm.tm_hour;
+	time->Minute = tm.tm_min;
+	time->Second = tm.tm_sec;
+	time->Nanosecond = ts.tv_nsec;
+	time->TimeZone = 2047;		/* EFI_UNSPECIFIED_TIMEZONE */
+
+	cap->Resolution = 1;
+	cap->Accuracy = 50000000;
+	cap->SetsToZero = 0;
+
+	return EFI_SUCCESS;
+}
+
+static uint64_t fake_query_variable_info(uint32_t attr, uint64_t *max_storage,
+	uint64_t *remaining, uint64_t *max_size)
+{
+	*max_storage = FAKE_STORAGE_SIZE;
+	*remaining = FAKE_STORAGE_SIZE - fake_used;
+	*max_size = FAKE_STORAGE_SIZE;
+
+	return EFI_SUCCESS;
+}
+
+static const device_ops fake_ops = {
+	.get_variable = fake_get_variable,
+	.set_variable = fake_set_variable,
+	.get_next_variable_name = fake_get_next_variable_name,
+	.get_time = fake_get_time,
+	.query_variable_info = fake_query_variable_info,
+};
+
+/* connections */
+
+static int buf_reserve(uint8_t **buf, size_t *cap, size_t need)
+{
+	size_t size = *cap ? *cap : 4096;
+	uint8_t *tmp;
+
+	if (need <= *cap)
+		return UEFIOP_OK;
+	while (size < need)
+		size *= 2;
+	tmp = realloc(*buf, size);
+	if (!tmp)
+		return UEFIOP_ERROR;
+	*buf = tmp;
+	*cap = size;
+
+	return UEFIOP_OK;
+}
+
+/*
+ *  Reserve room for a response with a body of up to max bytes at the end
+ *  of the output buffer, returning a pointer to the body.
+ */
+static uint8_t *resp_begin(conn *c, size_t max)
+{
+	if (buf_reserve(&c->out, &c->out_cap,
+			c->out_len + sizeof(uefiopd_resp_hdr) + max))
+		return NULL;
+	return c->out + c->out_len + sizeof(uefiopd_resp_hdr);
+}
+
+static void resp_end(conn *c, const uefiopd_req_hdr *req, uint64_t status,
+	size_t len)
+{
+	uefiopd_resp_hdr hdr;
+
+	hdr.length = len;
+	hdr.op = req->op;
+	hdr.reserved = 0;
+	hdr.id = req->id;
+	hdr.status = status;
+	memcpy(c->out + c->out_len, &hdr, sizeof(hdr));
+	c->out_len += sizeof(hdr) + len;
+}
+
+/* check a UCS-2 name of size bytes is NULL terminated */
+static bool valid_name(const uint8_t *name, uint64_t size)
+{
+	uint16_t last;
+
+	if (size < sizeof(uint16_t) || size % sizeof(uint16_t))
+		return false;
+	memcpy(&last, name + size - sizeof(uint16_t), sizeof(last));
+
+	return last == 0;
+}
+
+static int handle_request(conn *c, const uefiopd_req_hdr *req, uint8_t *body)
+{
+	uint64_t status = EFI_INVALID_PARAMETER;
+	size_t len = 0;
+	uint8_t *out;
+	EFI_GUID guid;
+	uint32_t attr;
+	uint64_t size;
+
+	switch (req->op) {
+	case UEFIOPD_GET_VARIABLE: {
+		uefiopd_getvariable_req r;
+		uefiopd_getvariable_resp resp;
+		uint16_t *name = (uint16_t *)(body + sizeof(r));
+
+		if (req->length < sizeof(r))
+			break;
+		memcpy(&r, body, sizeof(r));
+		if (req->length != sizeof(r) + r.VariableNameSize ||
+		    !valid_name(body + sizeof(r), r.VariableNameSize))
+			break;
+		if (r.DataSize > UEFIOPD_MAX_BODY - sizeof(resp))
+			r.DataSize = UEFIOPD_MAX_BODY - sizeof(resp);
+
+		if ((out = resp_begin(c, sizeof(resp) + r.DataSize)) == NULL)
+			return UEFIOP_ERROR;
+		guid = r.VendorGuid;
+		attr = 0;
+		size = r.DataSize;
+		status = dev->get_variable(name, &guid, &attr, &size,
+			out + sizeof(resp));
+		resp.Attributes = attr;
+		resp.DataSize = size;
+		memcpy(out, &resp, sizeof(resp));
+		len = sizeof(resp) + (status == EFI_SUCCESS ? size : 0);
+		break;
+	}
+	case UEFIOPD_SET_VARIABLE: {
+		uefiopd_setvariable_req r;
+
+		if (req->length < sizeof(r))
+			break;
+		memcpy(&r, body, sizeof(r));
+		/* subtract from the length, a client's sizes may overflow */
+		if (r.VariableNameSize > req->length - sizeof(r) ||
+		    r.DataSize != req->length - sizeof(r) - r.VariableNameSize ||
+		    !valid_name(body + sizeof(r), r.VariableNameSize))
+			break;
+
+		guid = r.VendorGuid;
+		status = dev->set_variable((uint16_t *)(body + sizeof(r)),
+			&guid, r.Attributes, r.DataSize,
+			body + sizeof(r) + r.VariableNameSize);
+		break;
+	}
+	case UEFIOPD_GET_NEXT_VARIABLE_NAME: {
+		uefiopd_getnextvariablename_req r;
+		uefiopd_getnextvariablename_resp resp;
+
+		if (req->length < sizeof(r))
+			break;
+		memcpy(&r, body, sizeof(r));
+		if (req->length != sizeof(r) + r.VariableNameSize ||
+		    !valid_name(body + sizeof(r), r.VariableNameSize) ||
+		    r.BufferSize < r.VariableNameSize)
+			break;
+		if (r.BufferSize > UEFIOPD_MAX_BODY - sizeof(resp))
+			r.BufferSize = UEFIOPD_MAX_BODY - sizeof(resp);
+
+		if ((out = resp_begin(c, sizeof(resp) + r.BufferSize)) == NULL)
+			return UEFIOP_ERROR;
+		memcpy(out + sizeof(resp), body + sizeof(r), r.VariableNameSize);
+		guid = r.VendorGuid;
+		size = r.BufferSize;
+		status = dev->get_next_variable_name(&size,
+			(uint16_t *)(out + sizeof(resp)), &guid);
+		resp.VendorGuid = guid;
+		resp.VariableNameSize = size;
+		memcpy(out, &resp, sizeof(resp));
+		len = sizeof(resp) + (status == EFI_SUCCESS ? size : 0);
+		break;
+	}
+	case UEFIOPD_GET_TIME: {
+		uefiopd_gettime_resp resp;
+		EFI_TIME time;
+		EFI_TIME_CAPABILITIES cap;
+
+		memset(&time, 0, sizeof(time));
+		memset(&cap, 0, sizeof(cap));
+		status = dev->get_time(&time, &cap);
+		resp.Time = time;
+		resp.Capabilities = cap;
+		if ((out = resp_begin(c, sizeof(resp))) == NULL)
+			return UEFIOP_ERROR;
+		memcpy(out, &resp, sizeof(resp));
+		len = sizeof(resp);
+		break;
+	}
+	case UEFIOPD_QUERY_VARIABLE_INFO: {
+		uefiopd_queryvariableinfo_req r;
+		uefiopd_queryvariableinfo_resp resp;
+		uint64_t max_storage = 0, remaining = 0, max_size = 0;
+
+		if (req->length != sizeof(r))
+			break;
+		memcpy(&r, body, sizeof(r));
+		status = dev->query_variable_info(r.Attributes, &max_storage,
+			&remaining, &max_size);
+		resp.MaximumVariableStorageSize = max_storage;
+		resp.RemainingVariableStorageSize = remaining;
+		resp.MaximumVariableSize = max_size;
+		if ((out = resp_begin(c, sizeof(resp))) == NULL)
+			return UEFIOP_ERROR;
+		memcpy(out, &resp, sizeof(resp));
+		len = sizeof(resp);
+		break;
+	}
+	default:
+		status = EFI_UNSUPPORTED;
+		break;
+	}
+
+	if (resp_begin(c, len) == NULL)
+		return UEFIOP_ERROR;
+	resp_end(c, req, status, len);
+
+	return UEFIOP_OK;
+}
+
+/*
+ *  Run the next complete request queued on a connection. Returns 1 if a
+ *  request was handled, 0 if none is complete yet and -1 to drop the
+ *  connection.
+ */
+static int conn_run_one(conn *c)
+{
+	uefiopd_req_hdr req;
+	size_t frame;
+
+	if (c->in_len < sizeof(req) || c->out_len - c->out_off > MAX_PENDING_OUT)
+		return 0;
+	memcpy(&req, c->in, sizeof(req));
+	if (req.length > UEFIOPD_MAX_BODY)
+		return -1;
+	frame = sizeof(req) + req.length;
+	if (c->in_len < frame)
+		return 0;
+
+	if (handle_request(c, &req, c->in + sizeof(req)) != UEFIOP_OK)
+		return -1;
+
+	memmove(c->in, c->in + frame, c->in_len - frame);
+	c->in_len -= frame;
+
+	return 1;
+}
+
+static int conn_read(conn *c)
+{
+	ssize_t n;
+
+	if (buf_reserve(&c->in, &c->in_cap, c->in_len + 65536))
+		return UEFIOP_ERROR;
+	n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+		return UEFIOP_ERROR;
+	if (n > 0)
+		c->in_len += n;
+
+	return UEFIOP_OK;
+}
+
+static int conn_write(conn *c)
+{
+	ssize_t n;
+
+	n = write(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+	if (n < 0)
+		return (errno == EAGAIN || errno == EINTR) ? UEFIOP_OK : UEFIOP_ERROR;
+	c->out_off += n;
+	if (c->out_off == c->out_len)
+		c->out_off = c->out_len = 0;
+
+	return UEFIOP_OK;
+}
+
+static void conn_free(conn *c)
+{
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+static int listen_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long.\n", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	(void)mkdir(UEFIOP_RUN_DIR, 0755);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    chmod(path, 0600) || listen(fd, 64)) {
+		printf("Cannot listen on %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * daemon(), except that the parent waits for the child to report whether
+ * it started: *ready is written once the daemon serves, and the parent
+ * exits non zero if it is closed first, e.g. the driver failed to open.
+ */
+static int detach(int *ready)
+{
+	int fds[2];
+	char c = 1;
+	pid_t pid;
+
+	if (pipe2(fds, O_CLOEXEC))
+		return -1;
+	fflush(NULL);
+	pid = fork();
+	if (pid == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid) {
+		close(fds[1]);
+		while (read(fds[0], &c, 1) == -1 && errno == EINTR)
+			;
+		_exit(c ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	close(fds[0]);
+	if (setsid() == -1 || chdir("/")) {
+		close(fds[1]);
+		return -1;
+	}
+	*ready = fds[1];
+
+	return 0;
+}
+
+/* the startup went fine, let the parent go and drop the terminal */
+static void detached(int ready)
+{
+	char c = 0;
+	int fd;
+
+	fflush(NULL);
+	fd = open("/dev/null", O_RDWR);
+	if (fd != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+	/* the parent may be gone already, nothing to tell then */
+	(void)write(ready, &c, 1);
+	close(ready);
+}
+
+static void handle_signal(int sig)
+{
+	terminate = 1;
+}
+
+static void serve(int lfd)
+{
+	static conn *conns[MAX_CONNS];
+	struct pollfd pfds[MAX_CONNS + 1];
+	int nconns = 0, i;
+
+	while (!terminate) {
+		bool busy;
+
+		pfds[0].fd = lfd;
+		pfds[0].events = nconns < MAX_CONNS ? POLLIN : 0;
+		for (i = 0; i < nconns; i++) {
+			conn *c = conns[i];
+
+			pfds[i + 1].fd = c->fd;
+			pfds[i + 1].events = 0;
+			if (c->in_len < sizeof(uefiopd_req_hdr) + UEFIOPD_MAX_BODY)
+				pfds[i + 1].events |= POLLIN;
+			if (c->out_len > c->out_off)
+				pfds[i + 1].events |= POLLOUT;
+		}
+
+		if (poll(pfds, nconns + 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < nconns; i++) {
+			conn *c = conns[i];
+			short rev = pfds[i + 1].revents;
+
+			if (((rev & (POLLIN | POLLHUP | POLLERR)) && conn_read(c)) ||
+			    ((rev & POLLOUT) && conn_write(c))) {
+				conn_free(c);
+				conns[i] = NULL;
+			}
+		}
+
+		/*
+		 *  All device access happens here, one request at a time, taking
+		 *  one request from each connection in turn so a client with a
+		 *  deep pipeline cannot starve the others.
+		 */
+		do {
+			busy = false;
+			for (i = 0; i < nconns; i++) {
+				int ret;
+
+				if (!conns[i])
+					continue;
+				ret = conn_run_one(conns[i]);
+				if (ret < 0) {
+					conn_free(conns[i]);
+					conns[i] = NULL;
+				} else if (ret > 0) {
+					busy = true;
+				}
+			}
+		} while (busy);
+
+		/* push responses out right away, poll only when it would block */
+		for (i = 0; i < nconns; i++) {
+			if (conns[i] && conns[i]->out_len > conns[i]->out_off &&
+			    conn_write(conns[i])) {
+				conn_free(conns[i]);
+				conns[i] = NULL;
+			}
+		}
+
+		for (i = 0; i < nconns; ) {
+			if (!conns[i])
+				conns[i] = conns[--nconns];
+			else
+				i++;
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			int fd = accept4(lfd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+			conn *c;
+
+			if (fd == -1)
+				continue;
+			c = calloc(1, sizeof(*c));
+			if (!c) {
+				close(fd);
+				continue;
+			}
+			c->fd = fd;
+			conns[nconns++] = c;
+		}
+	}
+
+	for (i = 0; i < nconns; i++)
+		conn_free(conns[i]);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+	int lfd, ready = -1;
+	const char *path = UEFIOPD_SOCKET;
+	bool fake = false;
+	char *backend = NULL;
+	bool foreground = false;
+	struct sigaction sa;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "s:b:FfVh", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 's':
+			path = optarg;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'F':
+			fake = true;
+			break;
+		case 'f':
+			foreground = true;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	lfd = listen_socket(path);
+	if (lfd == -1)
+		return EXIT_FAILURE;
+
+	/*
+	 * Detach before opening the driver, which registers the pid of the
+	 * process as a user of the module, and that has to be the daemon.
+	 * Errors still go to the terminal until the startup is reported.
+	 */
+	if (!foreground && detach(&ready)) {
+		printf("Cannot detach from the terminal.\n");
+		goto error;
+	}
+
+	if (fake) {
+		dev = &fake_ops;
+	} else {
+		dev_ctx = init_driver(backend);
+		if (!dev_ctx) {
+			printf ("Cannot open efi_runtime driver. Aborted.\n");
+			goto error;
+		}
+		dev = &driver_ops;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (ready != -1)
+		detached(ready);
+	serve(lfd);
+
+	close(lfd);
+	unlink(path);
+	if (!fake)
+		deinit_driver(dev_ctx);
+
+	return EXIT_SUCCESS;
+
+error:
+	close(lfd);
+	unlink(path);
+	if (!fake)
+		deinit_driver(dev_ctx);
+
+	return EXIT_FAILURE;
+}
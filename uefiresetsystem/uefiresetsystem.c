@@ -36,7 +36,6 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <getopt.h>
 
 #include <efi_runtime.h>
@@ -44,13 +43,12 @@
 #include "uefiop.h"
 #include "utils.h"
 
-static int fd = -1;
-
 static struct option options[] = {
 	{ "type", required_argument, NULL, 't' },
 	{ "status", required_argument, NULL, 's' },
 	{ "size", required_argument, NULL, 'z' },
 	{ "data", required_argument, NULL, 'd' },
+	{ "backend", required_argument, NULL, 'b' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
@@ -68,63 +66,48 @@ static void usage(void)
 		"\t--data -d <data>		the date buffer\n"
 		"\t	ex. uefiresetsystem -t 0 -s 0 -z 0\n"
 		"\t	ex. uefiresetsystem -t 0 -s 0 -z 5 -d \"01 02 10 12 33\"\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
 		"\t--version -V		show version\n"
 		"\t--help -h		show this menu\n",
 		"uefiresetsystem");
 }
 
-static size_t get_data_len(char *str)
+/* the hex bytes of --data, blanks or commas allowed between them */
+static int get_data(const char *str, uint8_t **data, uint64_t *datalen)
 {
-	int i = 0;
-	char *pch;
-        char *saveptr1;
-	pch = strtok_r(str," ,", &saveptr1);
-	while (pch != NULL) {
-		if (strlen(pch) != 2 || check_segment(pch, 2)) {
-			printf ("Data error!\n");
-			return -1;
-		}
-		i++;
-		pch = strtok_r(NULL," ,", &saveptr1);
-	}
+	size_t len = strlen(str);
+	ssize_t n;
 
-	return i;
-}
-
-static void get_data(char *str, uint8_t *data)
-{
-	int i = 0;
-	char *pch;
-        char *saveptr1;
-	pch = strtok_r(str," ,", &saveptr1);
-	while (pch != NULL) {
-		if (strlen(pch) != 2 || check_segment(pch, 2)) {
-			printf ("Data error!\n");
-			return;
-		}
-		data[i] = strtol(pch, NULL, 16);
-		i++;
-		pch = strtok_r(NULL," ,", &saveptr1);
+	*data = malloc(len / 2 + 1);
+	if (!*data) {
+		printf ("error: cannot alloc memory\n");
+		return -1;
 	}
+	n = hex_decode(*data, str, len);
+	if (n < 0) {
+		printf ("Data error!\n");
+		return -1;
+	}
+	*datalen = n;
 
-	return;
+	return 0;
 }
 
-int main(int argc, char **argv)
+int UEFIOP_MAIN(uefiresetsystem)(int argc, char **argv)
 {
 
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
 	int c;
 	int type = 0;
 	uint64_t data_size = 0;
 	uint8_t *data = NULL;
 	uint64_t status = 0;
-	char *str = NULL;
 	uint64_t datalen = 0;
-	struct efi_resetsystem resetsystem;
 
 	for (;;) {
 		int idx;
-		c = getopt_long(argc, argv, "t:s:z:d:Vh", options, &idx);
+		c = getopt_long(argc, argv, "t:s:z:d:Vhb:", options, &idx);
 		if (c == -1)
 			break;
 
@@ -139,23 +122,16 @@ int main(int argc, char **argv)
 			data_size = strtoul(optarg, NULL, 10);
 			break;
 		case 'd':
-			str = strdup(optarg);
-			if (!str) {
-				printf ("error: insufficient memory was available\n");
-				goto error;
-			}
-			datalen = get_data_len(optarg);
-			if (datalen < 0)
+			free(data);
+			if (get_data(optarg, &data, &datalen))
 				goto error;
-			if (datalen != 0) {
-				data = (uint8_t *)malloc(datalen + 1);
-				if (!data) {
-					printf ("error: cannot alloc memory\n");
-					goto error;
-				}
+			if (datalen == 0) {
+				free(data);
+				data = NULL;
 			}
-			get_data(str, data);
-			free(str);
+			break;
+		case 'b':
+			backend = optarg;
 			break;
 		case 'V':
 			version();
@@ -166,23 +142,18 @@ int main(int argc, char **argv)
 		}
 	}
 
-	fd = init_driver();
-	if (fd == -1) {
+	ctx = init_driver(backend);
+	if (!ctx) {
 		printf ("Cannot open efi_test or efi_runtime driver. Aborted.\n");
 		goto error;
 	}
 
-	resetsystem.reset_type = type;
-	resetsystem.status = status;
-	resetsystem.data_size = data_size;
-	resetsystem.data = (uint16_t *)data;
-
-	ioctl(fd, EFI_RUNTIME_RESET_SYSTEM, &resetsystem);
+	uefiop_reset_system(ctx, type, status, data_size, data);
 
 	if (data)
 		free(data);
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_SUCCESS;
 
@@ -190,10 +161,7 @@ error:
 	if (data)
 		free(data);
 
-	if (str)
-		free(str);
-
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_FAILURE;
 }
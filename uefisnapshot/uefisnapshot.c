@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "snapshot.h"
+
+static struct option options[] = {
+	{ "list", no_argument, NULL, 'l' },
+	{ "guid", required_argument, NULL, 'g' },
+	{ "name", required_argument, NULL, 'n' },
+	{ "attr", required_argument, NULL, 'a' },
+	{ "min-size", required_argument, NULL, 'z' },
+	{ "max-size", required_argument, NULL, 'Z' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] <snapshot>\n"
+		"This application saves all UEFI variables, with their attributes and data, to a\n"
+		"snapshot file in one pass. The snapshot can be read back with the backend\n"
+		"snapshot:<snapshot>.\n\n"
+		"Options:\n"
+		"\t--list -l		list the variables of the snapshot\n"
+		"\t	ex. uefisnapshot -l host.snap\n"
+		"\t--guid -g <guid>	only save the variables of this guid\n"
+		"\t--name -n <glob>	only save the variables whose name matches the glob\n"
+		"\t--attr -a <attr>	only save the variables with all these attributes set\n"
+		"\t--min-size -z <size>	only save the variables of at least this size\n"
+		"\t--max-size -Z <size>	only save the variables of at most this size\n"
+		"\t	ex. uefisnapshot -g hwerr -a 1 -z 4K errors.snap\n"
+		"\t	the data of the other variables is never read\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t	ex. uefisnapshot -b image:vm001.fd vm001.snap\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefisnapshot");
+}
+
+static int list_snapshot(const char *path)
+{
+	const snapshot_entry *e;
+	snapshot *snap;
+	char guidstr[37];
+	char *name;
+	size_t i;
+
+	snap = snapshot_open(path);
+	if (!snap) {
+		if (errno == ENOEXEC)
+			printf ("%s: not a snapshot\n", path);
+		else
+			printf ("%s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0, e = snapshot_entries(snap); i < snapshot_count(snap);
+	     i++, e++) {
+		efi_guid guid;
+
+		name = malloc(e->name_size / sizeof(uint16_t) * 3 + 1);
+		if (!name) {
+			printf ("error: cannot alloc memory\n");
+			snapshot_close(snap);
+			return EXIT_FAILURE;
+		}
+		ucs2_to_utf8(name, snapshot_name(snap, e),
+			e->name_size / sizeof(uint16_t) - 1);
+		memcpy(&guid, &e->guid, sizeof(guid));
+		guid_to_string(&guid, guidstr);
+		printf ("%s %-32s 0x%08x %8lu %016lx\n", guidstr, name,
+			e->attr, (unsigned long)e->data_size,
+			(unsigned long)e->hash);
+		free(name);
+	}
+	snapshot_close(snap);
+
+	return EXIT_SUCCESS;
+}
+
+int UEFIOP_MAIN(uefisnapshot)(int argc, char **argv)
+{
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
+	bool list = false;
+	efi_guid matchguid;
+	variter_match match = { 0 };
+	uint64_t status;
+	size_t count;
+	int c;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "lg:n:a:z:Z:b:Vh", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			list = true;
+			break;
+		case 'g':
+			if (string_to_guid(optarg, &matchguid)) {
+				printf ("Invalid guid:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			match.guid = (EFI_GUID *)&matchguid;
+			break;
+		case 'n':
+			match.name = optarg;
+			break;
+		case 'a':
+			match.attr = strtoul(optarg, NULL, 16);
+			break;
+		case 'z':
+		case 'Z':
+			if (parse_size(optarg, c == 'z' ? &match.min_size :
+				       &match.max_size)) {
+				printf ("Invalid size:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind != argc - 1) {
+		printf ("need to input the snapshot file\n");
+		return EXIT_FAILURE;
+	}
+
+	if (list)
+		return list_snapshot(argv[optind]);
+
+	ctx = init_driver(backend);
+	if (!ctx) {
+		printf ("Cannot open efi_runtime driver. Aborted.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (snapshot_take_match(ctx, argv[optind], &match, &count, &status)) {
+		if (status != EFI_SUCCESS)
+			print_status_info(status);
+		else
+			printf ("%s: %s\n", argv[optind], strerror(errno));
+		deinit_driver(ctx);
+		return EXIT_FAILURE;
+	}
+	printf ("Saved %zu variables to %s\n", count, argv[optind]);
+	deinit_driver(ctx);
+
+	return EXIT_SUCCESS;
+}
@@ -34,20 +34,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <sys/ioctl.h>
 #include <getopt.h>
 #include <string.h>
 
 #include <efi_runtime.h>
 #include "utils.h"
 
-static int fd = -1;
-
 static struct option options[] = {
 	{ "gettime", no_argument, NULL, 'g' },
 	{ "settime", required_argument, NULL, 's' },
 	{ "getwakeup", no_argument, NULL, 'G' },
 	{ "setwakeup", required_argument, NULL, 'S' },
+	{ "backend", required_argument, NULL, 'b' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
@@ -69,6 +67,7 @@ static void usage(void)
 		"\t	uefitime -S <enable>,<time>\n"
 		"\t	ex. uefitime -S \"True,2016:10:01:02:10:20:0:0:8:1:0\"\n"
 		"\t	ex. uefitime -S \"False\"\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
 		"\t--version -V		show version\n"
 		"\t--help -h		show this menu\n",
 		"uefitime");
@@ -175,13 +174,11 @@ static void parse_time(char *str, EFI_TIME **time, bool *enable)
 	return;
 }
 
-int main(int argc, char **argv)
+int UEFIOP_MAIN(uefitime)(int argc, char **argv)
 {
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
 	int c;
-	struct efi_gettime gettime;
-	struct efi_settime settime;
-	struct efi_getwakeuptime getwakeuptime;
-	struct efi_setwakeuptime setwakeuptime;
 	EFI_TIME efi_time;
 	EFI_TIME *p_time = NULL;
 	EFI_TIME_CAPABILITIES efi_time_cap;
@@ -195,7 +192,7 @@ int main(int argc, char **argv)
 
 	for (;;) {
 		int idx;
-		c = getopt_long(argc, argv, "gs:GS:Vh", options, &idx);
+		c = getopt_long(argc, argv, "gs:GS:Vhb:", options, &idx);
 		if (c == -1)
 			break;
 
@@ -216,6 +213,9 @@ int main(int argc, char **argv)
 			p_time = &efi_time;
 			parse_time(optarg, &p_time, &enable);
 			break;
+		case 'b':
+			backend = optarg;
+			break;
 		case 'V':
 			version();
 			return EXIT_SUCCESS;
@@ -225,8 +225,8 @@ int main(int argc, char **argv)
 		}
 	}
 
-	fd = init_driver();
-	if (fd == -1) {
+	ctx = init_driver(backend);
+	if (!ctx) {
 		printf ("Cannot open efi_runtime driver. Aborted.\n");
 		return EXIT_FAILURE;
 	}
@@ -247,41 +247,28 @@ int main(int argc, char **argv)
 	}
 
 	if (get) {
-		gettime.Capabilities = &efi_time_cap;
-		gettime.Time = &efi_time;
-		gettime.status = &status;
-
-		ioctl(fd, EFI_RUNTIME_GET_TIME, &gettime);
+		status = uefiop_get_time(ctx, &efi_time, &efi_time_cap);
 
 		if (status == EFI_SUCCESS)
-			print_time_info(gettime.Time, gettime.Capabilities);
+			print_time_info(&efi_time, &efi_time_cap);
 
 		print_status_info(status);
 	}
 
 	if (set) {
-		settime.Time = &efi_time;
-		settime.status = &status;
-
-		ioctl(fd, EFI_RUNTIME_SET_TIME, &settime);
+		status = uefiop_set_time(ctx, &efi_time);
 
 		print_status_info(status);
 	}
 
 	if (getwakeup) {
-		getwakeuptime.Enabled = &enabled;
-		getwakeuptime.Pending = &pending;
-		getwakeuptime.Time = &efi_time;
-		getwakeuptime.status = &status;
-
-		ioctl(fd, EFI_RUNTIME_GET_WAKETIME, &getwakeuptime);
+		status = uefiop_get_wakeup_time(ctx, &enabled, &pending,
+				&efi_time);
 
 		if (status == EFI_SUCCESS) {
-			printf ("Enable: %s\n", *getwakeuptime.Enabled == 1
-							? "TRUE" : "FALSE");
-			printf ("Pending: %s\n", *getwakeuptime.Pending == 1
-							? "TRUE" : "FALSE");
-			print_time_info(getwakeuptime.Time, NULL);
+			printf ("Enable: %s\n", enabled == 1 ? "TRUE" : "FALSE");
+			printf ("Pending: %s\n", pending == 1 ? "TRUE" : "FALSE");
+			print_time_info(&efi_time, NULL);
 		}
 		print_status_info(status);
 	}
@@ -292,21 +279,17 @@ int main(int argc, char **argv)
 			goto error;
 		}
 		
-		setwakeuptime.Enabled = enable;
-		setwakeuptime.Time = (EFI_TIME *)p_time;
-		setwakeuptime.status = &status;
-
-		ioctl(fd, EFI_RUNTIME_SET_WAKETIME, &setwakeuptime);
+		status = uefiop_set_wakeup_time(ctx, enable, p_time);
 
 		print_status_info(status);
 	}
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_SUCCESS;
 
 error:
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_FAILURE;
 
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "snapshot.h"
+
+#define RANGE_GAP	8	/* equal bytes that still join two ranges */
+#define HEX_LIMIT	32	/* bytes shown per range without --full */
+
+static struct option options[] = {
+	{ "brief", no_argument, NULL, 'q' },
+	{ "full", no_argument, NULL, 'F' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] <old snapshot> [<new snapshot>]\n"
+		"This application compares two snapshots taken by uefisnapshot, or a snapshot with\n"
+		"the current variables when only one snapshot is given.\n\n"
+		"\t+ added, - removed, ~ changed variable, followed for changed data by the\n"
+		"\t  byte ranges that differ, @<offset>+<length>: <new bytes>\n\n"
+		"Options:\n"
+		"\t--brief -q		only list the variables that differ\n"
+		"\t--full -F		show all bytes of each range\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t	ex. uefivardiff before.snap after.snap\n"
+		"\t	ex. uefivardiff -b image:vm001.fd golden.snap\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefivardiff");
+}
+
+typedef struct {
+	bool brief;
+	bool full;
+	size_t added;
+	size_t removed;
+	size_t changed;
+} diff_state;
+
+static void print_var(char tag, snapshot *snap, const snapshot_entry *e)
+{
+	const uint16_t *name = snapshot_name(snap, e);
+	size_t len = e->name_size / sizeof(uint16_t) - 1, n;
+	char guidstr[37], buf[3 * 256 + 1];
+	efi_guid guid;
+
+	memcpy(&guid, &e->guid, sizeof(guid));
+	guid_to_string(&guid, guidstr);
+	printf ("%c %s ", tag, guidstr);
+	for (; len; len -= n, name += n) {
+		n = len < 256 ? len : 256;
+		fwrite(buf, 1, ucs2_to_utf8(buf, name, n), stdout);
+	}
+}
+
+static void print_hex(const uint8_t *data, size_t len, bool full)
+{
+	size_t n = full || len <= HEX_LIMIT ? len : HEX_LIMIT;
+	char buf[2 * 4096 + 1];
+	size_t i, chunk;
+
+	for (i = 0; i < n; i += chunk) {
+		chunk = n - i < 4096 ? n - i : 4096;
+		fwrite(buf, 1, hex_encode(buf, data + i, chunk), stdout);
+	}
+	if (n < len)
+		printf ("...");
+}
+
+/* the ranges of the new payload that differ from the old one */
+static void print_ranges(const uint8_t *old, size_t old_size,
+	const uint8_t *new, size_t new_size, bool full)
+{
+	size_t common = old_size < new_size ? old_size : new_size;
+	size_t i = 0, start, last;
+
+	while (i < common) {
+		if (old[i] == new[i]) {
+			i++;
+			continue;
+		}
+		start = last = i;
+		for (i++; i < common && i - last <= RANGE_GAP; i++) {
+			if (old[i] != new[i])
+				last = i;
+		}
+		printf ("    @0x%zx+%zu: ", start, last + 1 - start);
+		print_hex(new + start, last + 1 - start, full);
+		printf ("\n");
+		i = last + 1;
+	}
+
+	if (new_size > old_size) {
+		printf ("    @0x%zx+%zu: ", common, new_size - common);
+		print_hex(new + common, new_size - common, full);
+		printf (" (appended)\n");
+	} else if (old_size > new_size) {
+		printf ("    @0x%zx+%zu: (truncated)\n", common,
+			old_size - common);
+	}
+}
+
+static int print_change(snapshot *old_snap, const snapshot_entry *old_e,
+	snapshot *new_snap, const snapshot_entry *new_e,
+	unsigned int changes, void *arg)
+{
+	diff_state *st = arg;
+
+	if (!old_e) {
+		print_var('+', new_snap, new_e);
+		printf (" attr 0x%08x, %lu bytes\n", new_e->attr,
+			(unsigned long)new_e->data_size);
+		st->added++;
+		return 0;
+	}
+	if (!new_e) {
+		print_var('-', old_snap, old_e);
+		printf (" attr 0x%08x, %lu bytes\n", old_e->attr,
+			(unsigned long)old_e->data_size);
+		st->removed++;
+		return 0;
+	}
+
+	print_var('~', new_snap, new_e);
+	if (changes & SNAPSHOT_ATTR_CHANGED)
+		printf (" attr 0x%08x -> 0x%08x", old_e->attr, new_e->attr);
+	if (changes & SNAPSHOT_DATA_CHANGED)
+		printf (" data %lu -> %lu bytes",
+			(unsigned long)old_e->data_size,
+			(unsigned long)new_e->data_size);
+	printf ("\n");
+	if ((changes & SNAPSHOT_DATA_CHANGED) && !st->brief)
+		print_ranges(snapshot_data(old_snap, old_e), old_e->data_size,
+			snapshot_data(new_snap, new_e), new_e->data_size,
+			st->full);
+	st->changed++;
+
+	return 0;
+}
+
+static snapshot *open_snapshot(const char *path)
+{
+	snapshot *snap = snapshot_open(path);
+
+	if (!snap) {
+		if (errno == ENOEXEC)
+			printf ("%s: not a snapshot\n", path);
+		else
+			printf ("%s: %s\n", path, strerror(errno));
+	}
+	return snap;
+}
+
+/* the current variables, through a snapshot in a temporary file */
+static snapshot *live_snapshot(const char *backend)
+{
+	const char *dir = getenv("TMPDIR");
+	snapshot *snap = NULL;
+	uefiop_ctx *ctx;
+	uint64_t status;
+	size_t count;
+	char path[4096];
+
+	ctx = init_driver(backend);
+	if (!ctx) {
+		printf ("Cannot open efi_runtime driver. Aborted.\n");
+		return NULL;
+	}
+
+	snprintf(path, sizeof(path), "%s/uefivardiff.%d",
+		dir ? dir : "/tmp", (int)getpid());
+	if (snapshot_take(ctx, path, &count, &status)) {
+		if (status != EFI_SUCCESS)
+			print_status_info(status);
+		else
+			printf ("%s: %s\n", path, strerror(errno));
+	} else {
+		snap = open_snapshot(path);
+		unlink(path);
+	}
+	deinit_driver(ctx);
+
+	return snap;
+}
+
+int UEFIOP_MAIN(uefivardiff)(int argc, char **argv)
+{
+	snapshot *old_snap = NULL, *new_snap = NULL;
+	char *backend = NULL;
+	diff_state st;
+	int c, ret = EXIT_FAILURE;
+
+	memset(&st, 0, sizeof(st));
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "qFb:Vh", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'q':
+			st.brief = true;
+			break;
+		case 'F':
+			st.full = true;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind >= argc || argc - optind > 2) {
+		printf ("need to input one or two snapshots\n");
+		return EXIT_FAILURE;
+	}
+
+	old_snap = open_snapshot(argv[optind]);
+	if (!old_snap)
+		goto out;
+	if (argc - optind == 2)
+		new_snap = open_snapshot(argv[optind + 1]);
+	else
+		new_snap = live_snapshot(backend);
+	if (!new_snap)
+		goto out;
+
+	snapshot_diff(old_snap, new_snap, print_change, &st);
+	printf ("%zu added, %zu removed, %zu changed\n",
+		st.added, st.removed, st.changed);
+	ret = EXIT_SUCCESS;
+
+out:
+	snapshot_close(new_snap);
+	snapshot_close(old_snap);
+
+	return ret;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <efi_runtime.h>
+
+#include "uefiop.h"
+#include "utils.h"
+#include "variter.h"
+
+/*
+ * The header of a record in an authenticated variable store, which the
+ * firmware of most machines uses, and the alignment of the records.
+ */
+#define AUTH_HEADER_SIZE	60
+#define RECORD_ALIGN(x)		(((x) + 3) & ~(uint64_t)3)
+#define PREFIX_MAX		64
+
+static struct option options[] = {
+	{ "group", required_argument, NULL, 'G' },
+	{ "top", required_argument, NULL, 't' },
+	{ "header", required_argument, NULL, 'H' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] --group <guid|prefix|attr> --top <count>\n"
+		"This application shows how the variable storage is used, sizing each variable\n"
+		"with a zero length GetVariable call, so no variable data is read.\n\n"
+		"Options:\n"
+		"\t--group -G <group>	only show the usage by guid, name prefix or\n"
+		"\t			attributes, can be given more than once (default all)\n"
+		"\t	ex. uefivardu -G guid -G prefix\n"
+		"\t	the prefix of a name is the name without its trailing\n"
+		"\t	number, as Boot for Boot0001 or HwErrRec for HwErrRec0003\n"
+		"\t--top -t <count>	only show the largest groups (default all)\n"
+		"\t--header -H <size>	the record header size used in the estimate\n"
+		"\t			of the storage used (default 60)\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefivardu");
+}
+
+typedef struct {
+	char key[PREFIX_MAX * 3 + 1];	/* the GUID, prefix or attributes */
+	uint64_t count;
+	uint64_t data;		/* bytes of data */
+	uint64_t records;	/* estimated bytes of storage */
+} du_group;
+
+typedef struct {
+	du_group *groups;
+	size_t count;
+	size_t cap;
+} du_table;
+
+enum { BY_GUID, BY_PREFIX, BY_ATTR, GROUPINGS };
+
+static const char *group_names[GROUPINGS] = { "guid", "prefix", "attr" };
+
+typedef struct {
+	du_table tables[GROUPINGS];
+	unsigned int show;	/* a bit for each grouping */
+	uint64_t header;
+	uint64_t count;
+	uint64_t data;
+	uint64_t records;
+	uint64_t nv_count;	/* the non volatile ones among them */
+	uint64_t nv_records;
+	uint64_t hr_count;	/* the hardware error records among them */
+	uint64_t hr_records;
+	uint64_t vol_count;	/* and the volatile ones, kept in RAM */
+	uint64_t vol_records;
+} du_state;
+
+/* few groups in each table, a linear search is enough */
+static du_group *find_group(du_table *t, const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < t->count; i++)
+		if (!strcmp(t->groups[i].key, key))
+			return &t->groups[i];
+
+	if (t->count == t->cap) {
+		size_t cap = t->cap ? t->cap * 2 : 32;
+		du_group *p = realloc(t->groups, cap * sizeof(*p));
+
+		if (!p)
+			return NULL;
+		t->groups = p;
+		t->cap = cap;
+	}
+	memset(&t->groups[t->count], 0, sizeof(du_group));
+	strcpy(t->groups[t->count].key, key);
+
+	return &t->groups[t->count++];
+}
+
+/* the name without a trailing number, 4 or more hex digits or decimals */
+static size_t prefix_len(const uint16_t *name, size_t len)
+{
+	size_t hex = len, dec;
+
+	while (hex && ((name[hex - 1] >= '0' && name[hex - 1] <= '9') ||
+		       (name[hex - 1] >= 'A' && name[hex - 1] <= 'F')))
+		hex--;
+	if (len - hex >= 4 && hex)
+		return hex;
+	for (dec = len; dec && name[dec - 1] >= '0' && name[dec - 1] <= '9';)
+		dec--;
+
+	return dec ? dec : len;
+}
+
+static int add_var(const variter_var *var, void *arg)
+{
+	du_state *st = arg;
+	size_t len = ucs2_len(var->name), plen;
+	uint64_t records;
+	char key[PREFIX_MAX * 3 + 1];
+	du_group *g;
+	int i;
+
+	records = RECORD_ALIGN(st->header + (len + 1) * sizeof(uint16_t) +
+		var->size);
+	st->count++;
+	st->data += var->size;
+	st->records += records;
+	if (var->attr & EFI_VARIABLE_HARDWARE_ERROR_RECORD) {
+		st->hr_count++;
+		st->hr_records += records;
+	} else if (var->attr & EFI_VARIABLE_NON_VOLATILE) {
+		st->nv_count++;
+		st->nv_records += records;
+	} else {
+		st->vol_count++;
+		st->vol_records += records;
+	}
+
+	for (i = 0; i < GROUPINGS; i++) {
+		if (!(st->show & (1 << i)))
+			continue;
+		switch (i) {
+		case BY_GUID:
+			guid_to_string((const efi_guid *)var->guid, key);
+			if (guid_name((const efi_guid *)var->guid))
+				snprintf(key + 36, sizeof(key) - 36, " (%s)",
+					guid_name((const efi_guid *)var->guid));
+			break;
+		case BY_PREFIX:
+			plen = prefix_len(var->name, len);
+			if (plen > PREFIX_MAX)
+				plen = PREFIX_MAX;
+			ucs2_to_utf8(key, var->name, plen);
+			break;
+		case BY_ATTR:
+			snprintf(key, sizeof(key), "0x%08x", var->attr);
+			break;
+		}
+		g = find_group(&st->tables[i], key);
+		if (!g)
+			return UEFIOP_ERROR;
+		g->count++;
+		g->data += var->size;
+		g->records += records;
+	}
+
+	return 0;
+}
+
+static int compare_groups(const void *p1, const void *p2)
+{
+	const du_group *g1 = p1, *g2 = p2;
+
+	if (g1->records != g2->records)
+		return g1->records < g2->records ? 1 : -1;
+	return strcmp(g1->key, g2->key);
+}
+
+static void print_table(du_table *t, const char *title, size_t top)
+{
+	size_t i, n = top && top < t->count ? top : t->count;
+
+	qsort(t->groups, t->count, sizeof(*t->groups), compare_groups);
+	printf ("By %s:\n", title);
+	printf ("  %10s %12s %12s  %s\n", "Variables", "Data", "Storage",
+		title);
+	for (i = 0; i < n; i++)
+		printf ("  %10llu %12llu %12llu  %s\n",
+			(unsigned long long)t->groups[i].count,
+			(unsigned long long)t->groups[i].data,
+			(unsigned long long)t->groups[i].records,
+			t->groups[i].key);
+	if (n < t->count)
+		printf ("  ... %zu more\n", t->count - n);
+	printf ("\n");
+}
+
+/* the estimate for the variables of a storage against the firmware's */
+static void compare_storage(uefiop_ctx *ctx, const char *title,
+	uint32_t attr, uint64_t count, uint64_t records)
+{
+	uint64_t status, max_storage, remaining, max_size, used;
+
+	printf ("%s: %llu variables, about %llu bytes\n", title,
+		(unsigned long long)count, (unsigned long long)records);
+	status = uefiop_query_variable_info(ctx, attr, &max_storage,
+		&remaining, &max_size);
+	if (status != EFI_SUCCESS || remaining > max_storage) {
+		printf ("  QueryVariableInfo 0x%x: ", attr);
+		print_status_info(status);
+		return;
+	}
+	used = max_storage - remaining;
+	printf ("  QueryVariableInfo 0x%x: %llu of %llu bytes used, %llu "
+		"remaining\n", attr, (unsigned long long)used,
+		(unsigned long long)max_storage,
+		(unsigned long long)remaining);
+	/*
+	 * What the variables do not account for is mostly deleted records
+	 * the firmware has not reclaimed yet.
+	 */
+	printf ("  Not accounted for by the variables: %lld bytes\n",
+		(long long)(used - records));
+}
+
+int UEFIOP_MAIN(uefivardu)(int argc, char **argv)
+{
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
+	du_state st;
+	uint64_t status;
+	unsigned long top = 0;
+	int c, i, rc = EXIT_FAILURE;
+
+	memset(&st, 0, sizeof(st));
+	st.header = AUTH_HEADER_SIZE;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "G:t:H:Vhb:", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'G':
+			for (i = 0; i < GROUPINGS; i++)
+				if (!strcmp(optarg, group_names[i]))
+					break;
+			if (i == GROUPINGS) {
+				printf ("Invalid group:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			st.show |= 1 << i;
+			break;
+		case 't':
+			top = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			st.header = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+	if (!st.show)
+		st.show = (1 << GROUPINGS) - 1;
+
+	ctx = init_driver(backend);
+	if (!ctx) {
+		printf ("Cannot open efi_runtime driver. Aborted.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* one zero length GetVariable per variable, on top of the walk */
+	if (variter_walk(ctx, VARITER_PROBE, NULL, NULL, add_var, &st,
+			 &status)) {
+		if (status != EFI_SUCCESS)
+			print_status_info(status);
+		else
+			printf ("error: cannot alloc memory\n");
+		goto out;
+	}
+
+	for (i = 0; i < GROUPINGS; i++)
+		if (st.show & (1 << i))
+			print_table(&st.tables[i], group_names[i], top);
+
+	printf ("Total: %llu variables, %llu bytes of data, about %llu "
+		"bytes of storage\n", (unsigned long long)st.count,
+		(unsigned long long)st.data, (unsigned long long)st.records);
+
+	/* firmware usually keeps hardware error records in storage apart */
+	compare_storage(ctx, "Variable storage",
+		EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS |
+		EFI_VARIABLE_RUNTIME_ACCESS, st.nv_count, st.nv_records);
+	if (st.hr_count)
+		compare_storage(ctx, "Hardware error record storage",
+			EFI_VARIABLE_NON_VOLATILE |
+			EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			EFI_VARIABLE_RUNTIME_ACCESS |
+			EFI_VARIABLE_HARDWARE_ERROR_RECORD, st.hr_count,
+			st.hr_records);
+	if (st.vol_count)
+		printf ("Volatile variables: %llu variables, about %llu bytes, "
+			"not in the variable storage\n",
+			(unsigned long long)st.vol_count,
+			(unsigned long long)st.vol_records);
+	rc = EXIT_SUCCESS;
+
+out:
+	for (i = 0; i < GROUPINGS; i++)
+		free(st.tables[i].groups);
+	deinit_driver(ctx);
+
+	return rc;
+}
@@ -36,20 +36,26 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 
 #include <efi_runtime.h>
 
 #include "uefiop.h"
+#include "sizehint.h"
 #include "utils.h"
 
-static int fd = -1;
-
 static struct option options[] = {
 	{ "guid", required_argument, NULL, 'g' },
 	{ "name", required_argument, NULL, 'n' },
 	{ "file", required_argument, NULL, 'f' },
+	{ "hexdump", no_argument, NULL, 'x' },
+	{ "probe", no_argument, NULL, 'p' },
+	{ "cache", no_argument, NULL, 'c' },
+	{ "stats", no_argument, NULL, 'S' },
+	{ "backend", required_argument, NULL, 'b' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
@@ -61,61 +67,61 @@ static void usage(void)
 			"--file <varfile>\n"
 		"This application helps to get UEFI variable with runtime services.\n\n"
 		"Options:\n"
-		"\t--guid -g <guid>	the guid of the variable\n"
+		"\t--guid -g <guid>	the guid of the variable, or a well known name:\n"
+		"\t			global, security, shim, hwerr, microsoft,\n"
+		"\t			systemd, capsule or fwupd\n"
 		"\t	ex. uefivarget -g 12345678-1234-1234-1234-112233445566\n"
 		"\t--name -n <varname>	the name of the variable\n"
-		"\t	ex. uefivarget -n Test\n" 		
-		"\t--file -f <file>	store the date of the variable to the file\n"
+		"\t	ex. uefivarget -n Test\n"
+		"\t	the guid can be given with the name, as well known\n"
+		"\t	name or in full, ex. uefivarget -n global:BootOrder\n" 		
+		"\t--file -f <file>	store the date of the variable to the file,\n"
+		"\t			- for stdout\n"
 		"\t	ex. uefivarget -f test.dat\n"
+		"\t--hexdump -x		show the data as a hexdump with offsets\n"
+		"\t--probe -p		only get the size and attributes of the variable\n"
+		"\t--cache -c		keep the size of the variable in a size hint cache,\n"
+		"\t			so the next read takes a single GetVariable call\n"
+		"\t			($" SIZEHINT_DIR_ENV " selects the cache directory)\n"
+		"\t--stats -S		show the number of GetVariable calls of the read\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
 		"\t--version -V		show version\n"
 		"\t--help -h		show this menu\n",
 		"uefivarget");
 }
 
-static int variableget(
-	int fd,
-	uint64_t *datasize,
-	uint16_t *varname,
-	uint8_t *data,
-	efi_guid *guid,
-	uint32_t *attr,
-	uint64_t *status)
-{
-	int ioret;
-	struct efi_getvariable getvariable;
-
-	getvariable.VariableName = varname;
-	getvariable.VendorGuid = (EFI_GUID *)guid;
-	getvariable.Attributes = attr;
-	getvariable.DataSize = datasize;
-	getvariable.Data = data;
-	getvariable.status = status;
-	ioret = ioctl(fd, EFI_RUNTIME_GET_VARIABLE, &getvariable);
-
-	return ioret;
-
-}
-
-int main(int argc, char **argv)
+int UEFIOP_MAIN(uefivarget)(int argc, char **argv)
 {
 
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
 	int c;
 	int rc;
 	efi_guid guid;
 	uint16_t *varname = NULL;
+	const char *name;
 	size_t varlen = 0;
 	uint64_t datalen = 1024;
 	uint8_t *data = NULL;
 	uint64_t status;
 	bool got_guid = false;
 	uint32_t attributes;
-	int i;
-	FILE *fp = NULL;
-	size_t iwrite;
+	char *file = NULL;
+	FILE *msg = stdout;
+	struct iovec iov[3];
+	int fd;
+	bool dump = false;
+	char *hex = NULL;
+	bool probe = false;
+	bool stats = false;
+	char *cachedir = NULL;
+	bool cache = false;
+	uint64_t hint = 0;
+	unsigned int calls = 0;
 
 	for (;;) {
 		int idx;
-		c = getopt_long(argc, argv, "g:n:f:Vh", options, &idx);
+		c = getopt_long(argc, argv, "g:n:f:xpcSVhb:", options, &idx);
 		if (c == -1)
 			break;
 
@@ -129,21 +135,44 @@ int main(int argc, char **argv)
 			got_guid = true;
 			break;
 		case 'n':
-			varlen = strlen(optarg);
+			/* <guid>:<name>, as global:BootOrder */
+			name = optarg;
+			if (!parse_var_spec(optarg, &guid, &name))
+				got_guid = true;
+			varlen = strlen(name);
+			free(varname);
 			varname = malloc((varlen + 1) * 2);
 			if (!varname) {
 				printf ("error: cannot alloc memory\n");
 				goto error;
 			}
-			str_to_ucs(varname, optarg, varlen);
-			break;
-		case 'f':
-			fp = fopen(optarg, "wb");
-			if (!fp) {
-			printf("error: cannot open file\n");
+			if (utf8_to_ucs2(varname, name, varlen) < 0) {
+				printf ("Invalid variable name:  \"%s\"\n",
+					name);
 				goto error;
 			}
 			break;
+		case 'f':
+			file = optarg;
+			/* the data goes to stdout, the messages to stderr */
+			if (!strcmp(file, "-"))
+				msg = stderr;
+			break;
+		case 'x':
+			dump = true;
+			break;
+		case 'p':
+			probe = true;
+			break;
+		case 'c':
+			cache = true;
+			break;
+		case 'S':
+			stats = true;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
 		case 'V':
 			version();
 			return EXIT_SUCCESS;
@@ -162,19 +191,53 @@ int main(int argc, char **argv)
 		goto error;
 	}
 
-	data = malloc(datalen);
-	if (!data) {
-		printf ("error: cannot alloc memory for data\n");
-		goto error;
+	if (cache) {
+		cachedir = sizehint_dir();
+		if (!cachedir)
+			printf ("warning: size hint cache unavailable: %s\n",
+				strerror(errno));
+		else if (!probe)
+			hint = sizehint_get(cachedir, varname, (EFI_GUID *)&guid);
+		if (hint)
+			datalen = hint;
 	}
 
-	fd = init_driver();
-	if (fd == -1) {
+	ctx = init_driver(backend);
+	if (!ctx) {
 		printf ("Cannot open efi_runtime driver. Aborted.\n");
 		goto error;
 	}
 
-	variableget(fd, &datalen, varname, data, &guid, &attributes, &status);
+	/*
+	 * With no buffer the firmware only returns the size and attributes
+	 * of the variable, as EFI_BUFFER_TOO_SMALL unless it is empty.
+	 */
+	if (probe) {
+		datalen = 0;
+		status = uefiop_get_variable(ctx, varname, (EFI_GUID *)&guid,
+				&attributes, &datalen, NULL);
+		calls++;
+		if (status == EFI_BUFFER_TOO_SMALL)
+			status = EFI_SUCCESS;
+		if (status == EFI_SUCCESS) {
+			printf ("DataSize: %" PRIu64 "\n", datalen);
+			printf ("Attributes: 0x%x\n", attributes);
+			if (cachedir && datalen)
+				(void)sizehint_put(cachedir, varname,
+					(EFI_GUID *)&guid, datalen);
+		}
+		goto done;
+	}
+
+	data = malloc(datalen);
+	if (!data) {
+		printf ("error: cannot alloc memory for data\n");
+		goto error;
+	}
+
+	status = uefiop_get_variable(ctx, varname, (EFI_GUID *)&guid,
+			&attributes, &datalen, data);
+	calls++;
 
 	if (status == EFI_BUFFER_TOO_SMALL) {
 		data = realloc(data, datalen);
@@ -182,26 +245,65 @@ int main(int argc, char **argv)
 			printf ("error: cannot realloc memory for data\n");
 			goto error;
 		}
-		variableget(fd, &datalen, varname, data, &guid, &attributes,
-				&status);
+		status = uefiop_get_variable(ctx, varname, (EFI_GUID *)&guid,
+				&attributes, &datalen, data);
+		calls++;
 	}
 
+	/* only hints worth a second call are kept */
+	if (cachedir && status == EFI_SUCCESS && datalen != hint &&
+	    (hint || calls > 1))
+		(void)sizehint_put(cachedir, varname, (EFI_GUID *)&guid,
+			datalen);
+
 	if (status == EFI_SUCCESS) {
-		if (fp) {
-			iwrite = fwrite(data, 1, datalen, fp);
-			if (iwrite < datalen) {
-				printf ("error: fail to write data to file\n");
+		if (file) {
+			if (msg == stderr)
+				fd = STDOUT_FILENO;
+			else
+				fd = open(file, O_WRONLY | O_CREAT | O_TRUNC |
+					O_CLOEXEC, 0644);
+			iov[0].iov_base = data;
+			iov[0].iov_len = datalen;
+			if (fd == -1 || write_iov(fd, iov, 1)) {
+				fprintf (msg, "error: fail to write data to "
+					"file: %s\n", strerror(errno));
+				if (fd > STDOUT_FILENO)
+					close(fd);
 				goto error;
 			}
-			fclose(fp);
-		} else  {
-			printf ("Data: \n");
-			for (i = 0; i < datalen; i++)
-				printf("%2.2x", data[i]);
-			printf ("\n");
+			if (fd > STDOUT_FILENO && close(fd)) {
+				printf ("error: fail to write data to file: "
+					"%s\n", strerror(errno));
+				goto error;
+			}
+		} else if (dump) {
+			hexdump(stdout, data, datalen);
+		} else {
+			hex = malloc(2 * datalen + 1);
+			if (!hex) {
+				printf ("error: cannot alloc memory\n");
+				goto error;
+			}
+			/* one write for the whole text */
+			iov[0].iov_base = "Data: \n";
+			iov[0].iov_len = 7;
+			iov[1].iov_base = hex;
+			iov[1].iov_len = hex_encode(hex, data, datalen);
+			iov[2].iov_base = "\n";
+			iov[2].iov_len = 1;
+			fflush(stdout);
+			if (write_iov(STDOUT_FILENO, iov, 3))
+				goto error;
 		}
 	}
-	print_status_info(status);
+done:
+	fprint_status_info(msg, status);
+	if (stats)
+		fprintf (msg, "Stats: %u GetVariable call%s, size hint %s\n", calls,
+			calls == 1 ? "" : "s",
+			!cachedir || probe ? "off" : !hint ? "miss" :
+			calls == 1 ? "hit" : "stale");
 
 	if (varname)
 		free(varname);
@@ -209,7 +311,11 @@ int main(int argc, char **argv)
 	if (data)
 		free(data);
 
-	deinit_driver(fd);
+	free(hex);
+
+	free(cachedir);
+
+	deinit_driver(ctx);
 
 	return EXIT_SUCCESS;
 
@@ -220,10 +326,11 @@ error:
 	if (data)
 		free(data);
 
-	if (fp)
-		fclose(fp);
+	free(hex);
+
+	free(cachedir);
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_FAILURE;
 }
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2017 Ivan Hu <ivan.hu@canonical.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the OpenSSL
+ * library under certain conditions as described in each individual source file,
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all
+ * of the code used other than OpenSSL. If you modify file(s) with this
+ * exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <errno.h>
+
+#include <efi_runtime.h>
+
+#include "uefiop.h"
+#include "utils.h"
+
+static struct option options[] = {
+	{ "attr", required_argument, NULL, 'a' },
+	{ "interval", required_argument, NULL, 'i' },
+	{ "count", required_argument, NULL, 'n' },
+	{ "warn", required_argument, NULL, 'w' },
+	{ "backend", required_argument, NULL, 'b' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(void)
+{
+	printf("Usage: %s [options] --attr <attr> --interval <seconds> --warn <threshold>\n"
+		"This application helps to get the variable storage information with runtime services.\n\n"
+		"Options:\n"
+		"\t--attr -a <attr>	the attributes of the storage to query (default 0x00000007)\n"
+		"\t	ex. uefivarinfo -a 0xf\n"
+		"\t--interval -i <seconds>	keep sampling at this interval, printing a line only\n"
+		"\t			when the remaining storage changes\n"
+		"\t	ex. uefivarinfo -i 60\n"
+		"\t--count -n <count>	stop after this many samples (default no limit)\n"
+		"\t--warn -w <threshold>	warn when the remaining storage falls below a size,\n"
+		"\t			with K, M or G suffix, or a percentage of the storage\n"
+		"\t	ex. uefivarinfo -w 10%% -i 60\n"
+		"\t	without --interval the exit status is 2 below the threshold\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
+		"\t--version -V		show version\n"
+		"\t--help -h		show this menu\n",
+		"uefivarinfo");
+}
+
+typedef struct {
+	uint64_t max_storage;
+	uint64_t remaining;
+	uint64_t max_size;
+} var_info;
+
+/* the threshold in bytes of storage, a percentage or a size */
+typedef struct {
+	bool set;
+	bool percent;
+	double value;
+} threshold;
+
+static int parse_threshold(const char *str, threshold *t)
+{
+	size_t len = strlen(str);
+	uint64_t size;
+	char *end;
+
+	if (len && str[len - 1] == '%') {
+		errno = 0;
+		t->value = strtod(str, &end);
+		if (errno || end != str + len - 1 || t->value < 0 ||
+		    t->value > 100)
+			return -1;
+		t->percent = true;
+	} else {
+		if (parse_size(str, &size))
+			return -1;
+		t->value = size;
+		t->percent = false;
+	}
+	t->set = true;
+
+	return 0;
+}
+
+static bool below(const threshold *t, const var_info *info)
+{
+	if (!t->set)
+		return false;
+	if (t->percent)
+		return info->max_storage &&
+			info->remaining * 100.0 / info->max_storage < t->value;
+	return info->remaining < t->value;
+}
+
+static double percent_free(const var_info *info)
+{
+	return info->max_storage ?
+		info->remaining * 100.0 / info->max_storage : 0;
+}
+
+static void print_info(const var_info *info)
+{
+	printf ("MaximumVariableStorageSize:   %llu\n",
+		(unsigned long long)info->max_storage);
+	printf ("RemainingVariableStorageSize: %llu (%.1f%% free)\n",
+		(unsigned long long)info->remaining, percent_free(info));
+	printf ("MaximumVariableSize:          %llu\n",
+		(unsigned long long)info->max_size);
+}
+
+static void print_sample(const var_info *info, const var_info *last,
+	bool warn)
+{
+	char stamp[32];
+	struct tm tm;
+	time_t now = time(NULL);
+
+	localtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+	printf ("%s remaining %llu of %llu bytes (%.1f%% free)", stamp,
+		(unsigned long long)info->remaining,
+		(unsigned long long)info->max_storage, percent_free(info));
+	if (last)
+		printf (" %+lld",
+			(long long)(info->remaining - last->remaining));
+	printf ("%s\n", warn ? " WARNING: below threshold" : "");
+	fflush(stdout);
+}
+
+/*
+ * One QueryVariableInfo call per sample on the context opened once, and
+ * a line only when the remaining storage moved.
+ */
+static uint64_t monitor(uefiop_ctx *ctx, uint32_t attr, double interval,
+	unsigned long count, const threshold *t)
+{
+	struct timespec ts;
+	var_info info, last;
+	unsigned long i;
+	uint64_t status;
+	bool warned = false;
+
+	ts.tv_sec = (time_t)interval;
+	ts.tv_nsec = (long)((interval - ts.tv_sec) * 1e9);
+
+	for (i = 0; !count || i < count; i++) {
+		if (i)
+			while (nanosleep(&ts, &ts) && errno == EINTR)
+				;
+		ts.tv_sec = (time_t)interval;
+		ts.tv_nsec = (long)((interval - ts.tv_sec) * 1e9);
+
+		status = uefiop_query_variable_info(ctx, attr,
+			&info.max_storage, &info.remaining, &info.max_size);
+		if (status != EFI_SUCCESS)
+			return status;
+
+		/* warn once when crossing the threshold, again after recovery */
+		if (i == 0 || info.remaining != last.remaining) {
+			bool low = below(t, &info);
+
+			print_sample(&info, i ? &last : NULL, low && !warned);
+			warned = low;
+		}
+		last = info;
+	}
+
+	return EFI_SUCCESS;
+}
+
+int UEFIOP_MAIN(uefivarinfo)(int argc, char **argv)
+{
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
+	int c;
+	uint64_t status;
+	var_info info;
+	threshold t = { 0 };
+	double interval = 0;
+	unsigned long count = 0;
+	char *end;
+	uint32_t attributes =
+		EFI_VARIABLE_NON_VOLATILE |
+		EFI_VARIABLE_BOOTSERVICE_ACCESS |
+		EFI_VARIABLE_RUNTIME_ACCESS;
+
+	for (;;) {
+		int idx;
+		c = getopt_long(argc, argv, "a:i:n:w:Vhb:", options, &idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'a':
+			attributes = strtoul(optarg, NULL, 16);
+			break;
+		case 'i':
+			interval = strtod(optarg, &end);
+			if (*end || interval <= 0) {
+				printf ("Invalid interval:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			if (parse_threshold(optarg, &t)) {
+				printf ("Invalid threshold:  \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'V':
+			version();
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		}
+	}
+
+	ctx = init_driver(backend);
+	if (!ctx) {
+		printf ("Cannot open efi_runtime driver. Aborted.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (interval > 0) {
+		status = monitor(ctx, attributes, interval, count, &t);
+		if (status != EFI_SUCCESS)
+			print_status_info(status);
+		deinit_driver(ctx);
+		return status == EFI_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	status = uefiop_query_variable_info(ctx, attributes,
+		&info.max_storage, &info.remaining, &info.max_size);
+	if (status == EFI_SUCCESS) {
+		print_info(&info);
+		if (below(&t, &info))
+			printf ("WARNING: the remaining storage is below the "
+				"threshold\n");
+	}
+	print_status_info(status);
+	deinit_driver(ctx);
+
+	if (status != EFI_SUCCESS)
+		return EXIT_FAILURE;
+
+	return below(&t, &info) ? 2 : EXIT_SUCCESS;
+}
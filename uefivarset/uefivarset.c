@@ -36,15 +36,16 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 
 #include <efi_runtime.h>
 
 #include "uefiop.h"
 #include "utils.h"
-
-static int fd = -1;
+#include "manifest.h"
 
 static struct option options[] = {
 	{ "guid", required_argument, NULL, 'g' },
@@ -53,6 +54,10 @@ static struct option options[] = {
 	{ "attr", required_argument, NULL, 'a' },
 	{ "file", required_argument, NULL, 'f' },
 	{ "delete", required_argument, NULL, 'D' },
+	{ "chunk", required_argument, NULL, 'c' },
+	{ "apply", required_argument, NULL, 'A' },
+	{ "dry-run", no_argument, NULL, 'N' },
+	{ "backend", required_argument, NULL, 'b' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
@@ -64,10 +69,14 @@ static void usage(void)
 			"--file <varfile>\n"
 		"This application helps to set UEFI variable with runtime services.\n\n"
 		"Options:\n"
-		"\t--guid -g <guid>	the guid of the variable\n"
+		"\t--guid -g <guid>	the guid of the variable, or a well known name:\n"
+		"\t			global, security, shim, hwerr, microsoft,\n"
+		"\t			systemd, capsule or fwupd\n"
 		"\t	ex. uefivarset -g 12345678-1234-1234-1234-112233445566\n"
 		"\t--name -n <varname>	the name of the variable\n"
-		"\t	ex. uefivarset -n Test\n" 		
+		"\t	ex. uefivarset -n Test\n"
+		"\t	the guid can be given with the name, as well known\n"
+		"\t	name or in full, ex. uefivarset -n global:BootOrder\n" 		
 		"\t--data -d <data>	the date in hex of the variable\n"
 		"\t	ex. uefivarset -d \"11 22 33 ff\"\n"
 		"\t--attr -a <attr>     the attribute of the variable(default 0x00000007)\n"
@@ -78,94 +87,237 @@ static void usage(void)
 		"\t	EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS 0x00000020\n"
 		"\t	EFI_VARIABLE_APPEND_WRITE	0x00000040\n"
 		"\t	ex. uefivarset -a 0x7\n"
-		"\t--file -f <file>	the date of the variable\n"
+		"\t--file -f <file>	the date of the variable, - for stdin\n"
 		"\t	ex. uefivarset -f test.dat\n"
 		"\t	if data and file exist at the same time, the data will be set\n"
 		"\t--delete -D <file>	delete the variable\n"
 		"\t	ex. uefivarset -g 12345678-1234-1234-1234-112233445566 -n Test -D\n"
+		"\t--chunk -c <size>	write the data in chunks of this size, the first\n"
+		"\t			as a normal set and the others with APPEND_WRITE,\n"
+		"\t			so no single call carries more than a chunk\n"
+		"\t	ex. uefivarset -n global:Test -f big.bin -c 4K\n"
+		"\t	the file, or stdin, is read a chunk at a time\n"
+		"\t	the write is not atomic, if a chunk fails the variable keeps\n"
+		"\t	the chunks written before it and the exit status is 2\n"
+		"\t--apply -A <manifest>	bring the variables to the state of a manifest,\n"
+		"\t			writing only the variables that differ\n"
+		"\t	ex. uefivarset -A host.manifest\n"
+		"\t	each line is \"<guid> <name> <attr> <hex data>|@<file>|-\"\n"
+		"\t--dry-run -N		with --apply, only list the writes to make\n"
+		"\t--backend -b <spec>	the backend, ioctl[:<dev>], efivarfs[:<dir>] or image:<file>\n"
 		"\t--version -V		show version\n"
 		"\t--help -h		show this menu\n",
 		"uefivarset");
 }
 
-static size_t get_data_len(char *str)
+/* the hex bytes of --data, blanks or commas allowed between them */
+static int get_data(const char *str, uint8_t **data, uint64_t *datalen)
+{
+	size_t len = strlen(str);
+	ssize_t n;
+
+	*data = malloc(len / 2 + 1);
+	if (!*data) {
+		printf ("error: cannot alloc memory\n");
+		return -1;
+	}
+	n = hex_decode(*data, str, len);
+	if (n < 0) {
+		printf ("Data error!\n");
+		return -1;
+	}
+	*datalen = n;
+
+	return 0;
+}
+
+static uint64_t now_ns(void)
 {
-	int i = 0;
-	char *pch;
-        char *saveptr1;
-	pch = strtok_r(str," ,", &saveptr1);
-	while (pch != NULL) {
-		if (strlen(pch) != 2 || check_segment(pch, 2)) {
-			printf ("Data error!\n");
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* fill buf from fd, short only at the end of the file */
+static ssize_t read_chunk(int fd, uint8_t *buf, size_t size)
+{
+	size_t got = 0;
+	ssize_t n;
+
+	while (got < size) {
+		n = read(fd, buf + got, size - got);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
 			return -1;
-		}
-		i++;
-		pch = strtok_r(NULL," ,", &saveptr1);
+		if (n == 0)
+			break;
+		got += n;
 	}
 
-	return i;
+	return got;
 }
 
-static void get_data(char *str, uint8_t *data)
+/*
+ * Set the variable a chunk at a time, from data or else from the file,
+ * which is never held in memory as a whole. *partial is set when a chunk
+ * failed after others were written, the variable then holds those only.
+ */
+static uint64_t write_chunks(uefiop_ctx *ctx, const uint16_t *varname,
+	const efi_guid *guid, uint32_t attributes, const uint8_t *data,
+	uint64_t datalen, const char *file, uint64_t chunk, bool *partial)
 {
-	int i = 0;
-	char *pch;
-        char *saveptr1;
-	pch = strtok_r(str," ,", &saveptr1);
-	while (pch != NULL) {
-		if (strlen(pch) != 2 || check_segment(pch, 2)) {
-			printf ("Data error!\n");
-			return;
+	uint64_t status = EFI_SUCCESS, offset = 0, t, longest = 0;
+	uint8_t *buf = NULL;
+	unsigned int count = 0;
+	int fd = -1;
+
+	if (!data) {
+		buf = malloc(chunk);
+		if (!buf) {
+			printf ("error: cannot alloc memory\n");
+			return EFI_OUT_OF_RESOURCES;
+		}
+		fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+		if (fd == -1) {
+			printf ("error: cannot read file %s: %s\n", file,
+				strerror(errno));
+			free(buf);
+			return EFI_LOAD_ERROR;
 		}
-		data[i] = strtol(pch, NULL, 16);
-		i++;
-		pch = strtok_r(NULL," ,", &saveptr1);
 	}
 
-	return;
+	for (;; count++) {
+		const uint8_t *p;
+		uint64_t size;
+
+		if (data) {
+			p = data + offset;
+			size = datalen - offset < chunk ? datalen - offset : chunk;
+		} else {
+			ssize_t n = read_chunk(fd, buf, chunk);
+
+			if (n < 0) {
+				printf ("error: cannot read file %s: %s\n",
+					file, strerror(errno));
+				status = EFI_LOAD_ERROR;
+				break;
+			}
+			p = buf;
+			size = n;
+		}
+		if (size == 0) {
+			if (count == 0) {
+				printf ("No data to write\n");
+				status = EFI_INVALID_PARAMETER;
+			}
+			break;
+		}
+
+		t = now_ns();
+		status = uefiop_set_variable(ctx, varname, (EFI_GUID *)guid,
+			count ? attributes | EFI_VARIABLE_APPEND_WRITE :
+			attributes, size, p);
+		t = now_ns() - t;
+		if (t > longest)
+			longest = t;
+		printf ("Chunk %u: %llu bytes at offset %llu, %.3f ms\n",
+			count + 1, (unsigned long long)size,
+			(unsigned long long)offset, t / 1e6);
+		if (status != EFI_SUCCESS)
+			break;
+		offset += size;
+	}
+	if (status == EFI_SUCCESS)
+		printf ("Wrote %llu bytes in %u chunk(s), the longest call "
+			"took %.3f ms\n", (unsigned long long)offset, count,
+			longest / 1e6);
+	*partial = status != EFI_SUCCESS && offset > 0;
+	if (*partial)
+		printf ("The variable is partial, it only holds the first "
+			"%llu bytes\n", (unsigned long long)offset);
+
+	if (fd > STDIN_FILENO)
+		close(fd);
+	free(buf);
+
+	return status;
 }
 
-static int variableset(
-	int fd,
-	const uint64_t datasize,
-	uint16_t *varname,
-	uint8_t *data,
-	efi_guid *gtestguid,
-	uint32_t attr,
-	uint64_t *status)
+static void print_write(const manifest_entry *e, void *arg)
 {
-	int ioret;
-	struct efi_setvariable setvariable;
+	size_t len = ucs2_len(e->name);
+	char guidstr[37], *name;
+	efi_guid guid;
 
-	setvariable.VariableName = varname;
-	setvariable.VendorGuid = (EFI_GUID *)gtestguid;
-	setvariable.Attributes = attr;
-	setvariable.DataSize = datasize;
-	setvariable.Data = data;
-	setvariable.status = status;
-	ioret = ioctl(fd, EFI_RUNTIME_SET_VARIABLE, &setvariable);
+	name = malloc(len * 3 + 1);
+	if (!name)
+		return;
+	ucs2_to_utf8(name, e->name, len);
+	memcpy(&guid, &e->guid, sizeof(guid));
+	guid_to_string(&guid, guidstr);
+	if (e->remove)
+		printf ("delete %s:%s\n", guidstr, name);
+	else
+		printf ("set %s:%s attr 0x%x size %zu\n", guidstr, name,
+			e->attr, e->size);
+	free(name);
+}
 
-	return ioret;
+static int apply_manifest(uefiop_ctx *ctx, const char *path, bool dry_run)
+{
+	manifest_stats stats;
+	uint64_t status;
+	manifest *m;
+	size_t line = 0, failed = 0;
+
+	m = manifest_load(path, &line);
+	if (!m) {
+		if (line)
+			printf ("%s:%zu: invalid manifest entry\n", path, line);
+		else
+			printf ("error: cannot read file %s: %s\n", path,
+				strerror(errno));
+		return EXIT_FAILURE;
+	}
 
+	status = manifest_apply(m, ctx, dry_run ? MANIFEST_DRY_RUN : 0,
+		print_write, NULL, &stats, &failed);
+	printf ("%s %zu write(s), skipped %zu unchanged, coalesced %zu "
+		"repeated entries\n", dry_run ? "Would make" : "Made",
+		stats.writes, stats.unchanged, stats.coalesced);
+	if (status != EFI_SUCCESS) {
+		printf ("Failed at entry %zu of the manifest\n", failed + 1);
+		print_status_info(status);
+	}
+	manifest_free(m);
+
+	return status == EFI_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-int main(int argc, char **argv)
+int UEFIOP_MAIN(uefivarset)(int argc, char **argv)
 {
 
+	uefiop_ctx *ctx = NULL;
+	char *backend = NULL;
 	int c;
 	int rc;
 	efi_guid guid;
 	uint16_t *varname = NULL;
+	const char *name;
 	size_t varlen = 0;
 	uint64_t datalen = 0;
 	uint8_t *data = NULL;
-	uint8_t *fdata = NULL;
+	char *file = NULL;
+	payload fdata = { 0 };
 	uint64_t status;
-	char *str = NULL;
 	bool got_guid = false;
-	FILE *fp = NULL;
-	uint64_t flen = 0, frlen = 0;
 	bool del_var = false;
+	uint64_t chunk = 0;
+	bool partial = false;
+	char *apply = NULL;
+	bool dry_run = false;
 	uint32_t attributes =
 		EFI_VARIABLE_NON_VOLATILE |
 		EFI_VARIABLE_BOOTSERVICE_ACCESS |
@@ -173,7 +325,7 @@ int main(int argc, char **argv)
 
 	for (;;) {
 		int idx;
-		c = getopt_long(argc, argv, "g:n:a:d:f:VhD", options, &idx);
+		c = getopt_long(argc, argv, "g:n:a:d:f:c:A:NVhDb:", options, &idx);
 		if (c == -1)
 			break;
 
@@ -187,62 +339,56 @@ int main(int argc, char **argv)
 			got_guid = true;
 			break;
 		case 'n':
-			varlen = strlen(optarg);
+			/* <guid>:<name>, as global:BootOrder */
+			name = optarg;
+			if (!parse_var_spec(optarg, &guid, &name))
+				got_guid = true;
+			varlen = strlen(name);
+			free(varname);
 			varname = malloc((varlen + 1) * 2);
 			if (!varname) {
 				printf ("error: cannot alloc memory\n");
 				goto error;
 			}
-			str_to_ucs(varname, optarg, varlen);
-			break;
-		case 'd':
-			str = strdup(optarg);
-			if (!str) {
-				printf ("error: insufficient memory was available\n");
+			if (utf8_to_ucs2(varname, name, varlen) < 0) {
+				printf ("Invalid variable name:  \"%s\"\n",
+					name);
 				goto error;
 			}
-			datalen = get_data_len(optarg);
-			if (datalen < 0)
+			break;
+		case 'd':
+			free(data);
+			if (get_data(optarg, &data, &datalen))
 				goto error;
-			if (datalen != 0) {
-				data = (uint8_t *)malloc(datalen + 1);
-				if (!data) {
-					printf ("error: cannot alloc memory\n");
-					goto error;
-				}
+			if (datalen == 0) {
+				free(data);
+				data = NULL;
 			}
-			get_data(str, data);
-			free(str);
 			break;
 		case 'a':
 			attributes = strtoul(optarg, NULL, 16);
 			break;
 		case 'f':
-			fp = fopen(optarg, "rb");
-    			if (!fp) {
-        			printf("error: cannot open file\n");
-				goto error;
-			}
-			fseek(fp, 0L, SEEK_END);
-			flen = ftell(fp);
-			rewind(fp);
-			if (flen != 0) {
-				fdata = (uint8_t *)malloc(flen + 1);
-				if (!fdata) {
-					printf ("error: cannot alloc memory\n");
-					goto error;
-				}
-				frlen = fread(fdata, flen, 1, fp);
-				if (!frlen) {
-					printf ("error: cannot read file\n");
-					goto error;
-				}
-			}
-			fclose(fp);
+			file = optarg;
 			break;
 		case 'D':
 			del_var = true;
 			break;
+		case 'c':
+			if (parse_size(optarg, &chunk) || chunk == 0) {
+				printf ("Invalid chunk size:  \"%s\"\n", optarg);
+				goto error;
+			}
+			break;
+		case 'A':
+			apply = optarg;
+			break;
+		case 'N':
+			dry_run = true;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
 		case 'V':
 			version();
 			return EXIT_SUCCESS;
@@ -252,6 +398,19 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (apply) {
+		ctx = init_driver(backend);
+		if (!ctx) {
+			printf ("Cannot open efi_runtime driver. Aborted.\n");
+			goto error;
+		}
+		rc = apply_manifest(ctx, apply, dry_run);
+		free(varname);
+		free(data);
+		deinit_driver(ctx);
+		return rc;
+	}
+
 	if (varlen == 0) {
 		printf ("need to input the variable name\n");
 		goto error;
@@ -261,39 +420,62 @@ int main(int argc, char **argv)
 		goto error;
 	}
 
-	if (datalen == 0 && flen != 0)	{
-		datalen = flen;
-		if (!data)
-			free(data);
-		data = fdata;
-		fdata = NULL;
+	if (chunk && !del_var) {
+		if (!data && !file) {
+			printf ("need to input the data or file to write in "
+				"chunks\n");
+			goto error;
+		}
+		if (attributes & (EFI_VARIABLE_AUTHENTICATED_WRITE_ACCESS |
+		    EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS)) {
+			printf ("authenticated variables cannot be written in "
+				"chunks\n");
+			goto error;
+		}
+	}
+
+	/*
+	 * The file is only read when there is no --data to set, and a chunk
+	 * at a time when writing in chunks.
+	 */
+	if (datalen == 0 && file && !chunk) {
+		if (payload_load(file, &fdata)) {
+			printf ("error: cannot read file %s: %s\n", file,
+				strerror(errno));
+			goto error;
+		}
+		datalen = fdata.size;
 	}
 
 	if (del_var)
 		datalen = 0;
 	printf ("attribute is 0x%x\n", attributes);
 
-	fd = init_driver();
-	if (fd == -1) {
+	ctx = init_driver(backend);
+	if (!ctx) {
 		printf ("Cannot open efi_runtime driver. Aborted.\n");
 		goto error;
 	}
 
-	variableset(fd, datalen, varname, data, &guid, attributes, &status);
+	if (chunk && !del_var)
+		status = write_chunks(ctx, varname, &guid, attributes, data,
+			datalen, file, chunk, &partial);
+	else
+		status = uefiop_set_variable(ctx, varname, (EFI_GUID *)&guid,
+				attributes, datalen, data ? data : fdata.data);
 	print_status_info(status);
 
 	if (varname)
 		free(varname);
 
 	if (data)
-		free(fdata);
-
-	if (fdata)
 		free(data);
 
-	deinit_driver(fd);
+	payload_free(&fdata);
 
-	return EXIT_SUCCESS;
+	deinit_driver(ctx);
+
+	return partial ? 2 : EXIT_SUCCESS;
 
 error:
 	if (varname)
@@ -302,16 +484,9 @@ error:
 	if (data)
 		free(data);
 
-	if (str)
-		free(str);
-
-	if (fdata)
-		free(fdata);
-
-	if (fp)
-		fclose(fp);
+	payload_free(&fdata);
 
-	deinit_driver(fd);
+	deinit_driver(ctx);
 
 	return EXIT_FAILURE;
 }